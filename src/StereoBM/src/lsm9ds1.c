@@ -134,3 +134,88 @@ unsigned int Lsm9ds1_XlgWrite(unsigned char reg_addr, unsigned char reg_value) {
 
 	return sts;
 }
+
+//=============================================================================
+//! LSM9DS1 Initialize Accelerometer/Gyroscope
+//-----------------------------------------------------------------------------
+//! @return	1 if the device is found, 0 otherwise
+//-----------------------------------------------------------------------------
+//! @brief This function starts the accelerometer and gyroscope at 238Hz.
+//! Both outputs are queued in the FIFO so that no sample is lost between
+//! the reads.
+//=============================================================================
+int Lsm9ds1_XlgInit (void) {
+	unsigned int sts;
+	unsigned char reg_value;
+
+	sts = Lsm9ds1_XlgRead(XLG_ADDR_WHO_AM_I, &reg_value);
+	if (!I2c_IsTransferComplete(sts) || (reg_value != XLG_WHO_AM_I)) {
+		return 0;
+	}
+
+	Lsm9ds1_XlgWrite(XLG_ADDR_CTRL_REG8,	XLG_CTRL_REG8);
+	Lsm9ds1_XlgWrite(XLG_ADDR_CTRL_REG1_G,	XLG_CTRL_REG1_G);
+	Lsm9ds1_XlgWrite(XLG_ADDR_CTRL_REG6_XL,	XLG_CTRL_REG6_XL);
+	Lsm9ds1_XlgWrite(XLG_ADDR_FIFO_CTRL,	XLG_FIFO_CTRL);
+	Lsm9ds1_XlgWrite(XLG_ADDR_CTRL_REG9,	XLG_CTRL_REG9);
+
+	return 1;
+}
+
+//=============================================================================
+//! LSM9DS1 Number of Samples in FIFO
+//-----------------------------------------------------------------------------
+//! @return	Number of unread samples, 0 on I2C error
+//=============================================================================
+int Lsm9ds1_XlgFifoCount (void) {
+	unsigned int sts;
+	unsigned char reg_value;
+
+	sts = Lsm9ds1_XlgRead(XLG_ADDR_FIFO_SRC, &reg_value);
+	if (!I2c_IsTransferComplete(sts)) {
+		return 0;
+	}
+
+	return reg_value & XLG_FIFO_SRC_FSS;
+}
+
+//=============================================================================
+//! LSM9DS1 Read Accelerometer/Gyroscope Sample
+//-----------------------------------------------------------------------------
+//! @param *gyro	Angular rate X/Y/Z is stored here
+//! @param *accel	Linear acceleration X/Y/Z is stored here
+//-----------------------------------------------------------------------------
+//! @return	Value of I2C interrupt status register
+//-----------------------------------------------------------------------------
+//! @brief This function pops the oldest sample from the FIFO. The output
+//! registers are read in bursts by the address auto-increment.
+//=============================================================================
+unsigned int Lsm9ds1_XlgReadSample (short *gyro, short *accel) {
+	unsigned int sts;
+	unsigned char reg_addr;
+	unsigned char data[6];
+
+	// gyroscope
+	reg_addr = XLG_ADDR_OUT_X_L_G;
+	sts = I2c_Write(I2C_ADDR_9DOF_XLG, &reg_addr, 1);
+	if ((sts & I2C_INTR_STS_COMP) != I2C_INTR_STS_COMP) {
+		return sts;
+	}
+	sts = I2c_Read(I2C_ADDR_9DOF_XLG, data, 6);
+	for (int i = 0; i < 3; i++) {
+		gyro[i] = (short)((data[i * 2 + 1] << 8) | data[i * 2]);
+	}
+
+	// accelerometer
+	reg_addr = XLG_ADDR_OUT_X_L_XL;
+	sts = I2c_Write(I2C_ADDR_9DOF_XLG, &reg_addr, 1);
+	if ((sts & I2C_INTR_STS_COMP) != I2C_INTR_STS_COMP) {
+		return sts;
+	}
+	sts = I2c_Read(I2C_ADDR_9DOF_XLG, data, 6);
+	for (int i = 0; i < 3; i++) {
+		accel[i] = (short)((data[i * 2 + 1] << 8) | data[i * 2]);
+	}
+
+	return sts;
+}
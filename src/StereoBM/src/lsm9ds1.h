@@ -113,6 +113,15 @@
 #define XLG_WHO_AM_I	0x68
 #define MAG_WHO_AM_I	0x3D
 
+// Accelerometer and Gyroscope settings
+#define XLG_CTRL_REG1_G		0x88 // ODR 238Hz, 500dps
+#define XLG_CTRL_REG6_XL	0x90 // ODR 238Hz, +/-4g
+#define XLG_CTRL_REG8		0x44 // BDU, IF_ADD_INC
+#define XLG_CTRL_REG9		0x02 // FIFO_EN
+#define XLG_FIFO_CTRL		0xC0 // continuous mode
+#define XLG_FIFO_SRC_FSS	0x3F // number of unread samples
+#define XLG_PERIOD_US		4202 // 1 / 238Hz
+
 //=============================================================================
 // Function Prototypes
 //=============================================================================
@@ -121,6 +130,9 @@ unsigned int Lsm9ds1_MagRead (unsigned char reg_addr, unsigned char *reg_value);
 unsigned int Lsm9ds1_MagWrite (unsigned char reg_addr, unsigned char reg_value);
 unsigned int Lsm9ds1_XlgRead (unsigned char reg_addr, unsigned char *reg_value);
 unsigned int Lsm9ds1_XlgWrite(unsigned char reg_addr, unsigned char reg_value);
+int Lsm9ds1_XlgInit (void);
+int Lsm9ds1_XlgFifoCount (void);
+unsigned int Lsm9ds1_XlgReadSample (short *gyro, short *accel);
 
 
 #endif // LSM9DS1_H
@@ -81,6 +81,67 @@ int Xusb_Init (void)
 	return XST_SUCCESS;
 }
 
+//=============================================================================
+//! XUSB Initialize IMU
+//-----------------------------------------------------------------------------
+//! @brief This function looks for the 9DOF click on MB1/2 sites and starts
+//! the sample ring. The ring is left invalid if no device is found.
+//! The cameras are not accessed after initialization, so the I2C switch
+//! stays on the 9DOF site.
+//=============================================================================
+void Xusb_InitImu (void)
+{
+	volatile struct IMU_RING *ring = (volatile struct IMU_RING *)BUF_IMU;
+	ring->Magic = 0;
+	ring->WriteCount = 0;
+	ring->Period = XLG_PERIOD_US;
+
+	for (int ch = 0; ch < 2; ch++) {
+		I2c_SetCh((ch == 0) ? I2C_SEL_CH0 : I2C_SEL_CH1);
+		if (Lsm9ds1_XlgInit()) {
+			xil_printf("IMU found on MB%d\r\n", ch + 1);
+			ring->Magic = IMU_RING_MAGIC;
+			break;
+		}
+	}
+	Xil_DCacheFlushRange((UINTPTR)ring, sizeof(struct IMU_RING));
+}
+
+//=============================================================================
+//! XUSB Poll IMU
+//-----------------------------------------------------------------------------
+//! @brief This function moves up to IMU_POLL_MAX samples from the LSM9DS1
+//! FIFO to the sample ring. The newest sample in the FIFO is stamped with
+//! the current time and the older ones are back-dated by the sample period.
+//=============================================================================
+void Xusb_PollImu (void)
+{
+	volatile struct IMU_RING *ring = (volatile struct IMU_RING *)BUF_IMU;
+	if (ring->Magic != IMU_RING_MAGIC) {
+		return;
+	}
+
+	int count = Lsm9ds1_XlgFifoCount();
+	if (count == 0) {
+		return;
+	}
+	unsigned int now = fpga->com.Timer;
+
+	int num = (count < IMU_POLL_MAX) ? count : IMU_POLL_MAX;
+	unsigned int index = ring->WriteCount;
+	for (int i = 0; i < num; i++) {
+		struct IMU_RAW_SAMPLE *sample = (struct IMU_RAW_SAMPLE *)&ring->Sample[index % IMU_RING_SIZE];
+		Lsm9ds1_XlgReadSample(sample->Gyro, sample->Accel);
+		sample->Timer = now - (count - 1 - i) * XLG_PERIOD_US;
+		Xil_DCacheFlushRange((UINTPTR)sample, sizeof(struct IMU_RAW_SAMPLE));
+		index++;
+	}
+
+	// publish the samples after they reach the memory
+	ring->WriteCount = index;
+	Xil_DCacheFlushRange((UINTPTR)ring, 32);
+}
+
 //=============================================================================
 //! XUSB Main
 //-----------------------------------------------------------------------------
@@ -101,6 +162,9 @@ int Xusb_Main (struct REMOTE_SETTING *remoteSetting)
 	// start the controller so that Host can see our device
 	Usb_Start(UsbInstance.PrivateData);
 
+	// inertial samples are streamed to the linux app
+	Xusb_InitImu();
+
 	int num_frame = 0;
 	int usb_tx = 0;
 	if (remoteSetting->opMode == REMOTE_OP_MODE_AUTO) {
@@ -118,7 +182,10 @@ int Xusb_Main (struct REMOTE_SETTING *remoteSetting)
 		}
 
 		// wait for new frame
-		while(app_data->intr_received == 0) {}
+		while(app_data->intr_received == 0) {
+			Xusb_PollImu();
+		}
+		unsigned int frame_time = fpga->com.Timer;
 		unsigned int param = 0;
 		if (app_data->grb_received != 0) {
 			param += RETURN_DATA_RAW_FRAME;
@@ -142,6 +209,7 @@ int Xusb_Main (struct REMOTE_SETTING *remoteSetting)
 		app_data->intr_received = 0;
 		fpga->com.IpcParameter1 = param;
 		fpga->com.IpcParameter2 = app_data->bank;
+		fpga->com.IpcParameter3 = frame_time;
 
 		// brightness control
 		/*
@@ -188,7 +256,9 @@ int Xusb_Main (struct REMOTE_SETTING *remoteSetting)
 				Xil_AssertNonvoid(Status == XST_SUCCESS);
 
 				// wait for transfer complete
-				while(app_data->busy == 1) {}
+				while(app_data->busy == 1) {
+					Xusb_PollImu();
+				}
 
 				// next transfer
 				data_ptr += payload_size;
@@ -41,6 +41,8 @@ u8 Buffer[MEMORY_SIZE] __attribute__ ((aligned(64)));
 
 #define CH9_DEBUG
 
+#define IMU_POLL_MAX	4 // samples moved per poll, bounds the frame latency
+
 //=============================================================================
 // Function Prototypes
 //=============================================================================
@@ -53,6 +55,8 @@ void Xusb_ReceiveData (
 	struct UVC_APP_DATA *app_data,
 	struct REMOTE_SETTING *remoteSetting,
 	u8 **data_ptr);
+void Xusb_InitImu (void);
+void Xusb_PollImu (void);
 
 
 //=============================================================================
@@ -0,0 +1,262 @@
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/Odometry.h"
+#include "core/CameraStereoImages.h"
+#include "core/StereoCameraModel.h"
+#include "core/GFTT.h"
+#include "core/SoftBM.h"
+#include "core/SoftGFTT.h"
+#include "core/OrbDescriptor.h"
+#include "core/Stereo.h"
+#include "core/Parameters.h"
+#include "core/Perf.h"
+#include "core/xThread.h"
+#include "core/FramePool.h"
+#include "opencv/CvORB.h"
+
+
+//******************************************************************************
+// Odometry allocation check
+//------------------------------------------------------------------------------
+// Runs the visual odometry over a recorded stereo sequence and counts the
+// heap allocations made inside Odometry::process(), on all threads. The
+// malloc() family is replaced by counting wrappers of the glibc allocator,
+// so operator new and cv::fastMalloc() (posix_memalign) of the cv::Mat
+// buffers are both counted. The features are computed outside of the
+// counted section by the CPU methods of the slam application. The count of
+// each frame is printed, the exit code is 1 if a frame after the warm-up
+// allocates.
+// Built with the slam sources except core/main.cpp, glibc only.
+//
+// usage: odom_alloc [-warmup frames] -l left_dir -r right_dir -lc left_calib
+//                   -rc right_calib [-n frames] [-depth CV_BM|SOFT_BM]
+//                   [-kpts CV_GFTT|SOFT_GFTT] [-threads N] ...
+//   the other options are those of the slam application
+//******************************************************************************
+APP_SETTING appSetting;
+Perf perf;
+xThreadPool threadPool;
+FramePool framePool;
+
+static std::atomic<bool> counting(false);
+static std::atomic<long> numAllocs(0);
+
+
+//******************************************************************************
+// Counting malloc
+//------------------------------------------------------------------------------
+// Defined in the executable, they take the place of the libc ones in every
+// shared library, and forward to the glibc allocator. free() is not replaced.
+//******************************************************************************
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t align, size_t size);
+
+static inline void countAlloc(void)
+{
+	if (counting) {
+		numAllocs++;
+	}
+}
+
+void *malloc(size_t size)
+{
+	countAlloc();
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+	countAlloc();
+	return __libc_calloc(num, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+	countAlloc();
+	return __libc_realloc(p, size);
+}
+
+void *memalign(size_t align, size_t size)
+{
+	countAlloc();
+	return __libc_memalign(align, size);
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+	countAlloc();
+	return __libc_memalign(align, size);
+}
+
+int posix_memalign(void **p, size_t align, size_t size)
+{
+	if ((align == 0) || (align % sizeof(void*)) || (align & (align - 1))) {
+		return EINVAL;
+	}
+	countAlloc();
+	void *q = __libc_memalign(align, size);
+	if (q == 0) {
+		return ENOMEM;
+	}
+	*p = q;
+	return 0;
+}
+}
+
+
+//******************************************************************************
+// Allocation check main function
+//******************************************************************************
+int main(int argc, char** argv)
+{
+	//================================================================
+	// Command Parse
+	//================================================================
+	int warmup = 5;
+	std::vector<char*> argvSlam;
+	argvSlam.push_back(argv[0]);
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "-warmup") == 0) && (i + 1 < argc)) {
+			warmup = atoi(argv[++i]);
+		}
+		else {
+			argvSlam.push_back(argv[i]);
+		}
+	}
+
+	ARG_PARAMS args;
+	REMOTE_SETTING remoteSetting;
+	parseArguments((int)argvSlam.size(), argvSlam.data(), &args, &appSetting, &remoteSetting);
+
+	if ((appSetting.inputType != INPUT_TYPE_FILE) || args.pathLeftImages.empty() ||
+		((appSetting.depthMethod != DEPTH_METHOD_CV_BM) && (appSetting.depthMethod != DEPTH_METHOD_SOFT_BM)) ||
+		((appSetting.kptsMethod != KPTS_METHOD_CV_GFTT) && (appSetting.kptsMethod != KPTS_METHOD_SOFT_GFTT)))
+	{
+		printf("usage: odom_alloc [-warmup frames] -l left_dir -r right_dir -lc left_calib -rc right_calib [-n frames] [-depth CV_BM|SOFT_BM] [-kpts CV_GFTT|SOFT_GFTT] ...\n");
+		return 1;
+	}
+
+	threadPool.create(appSetting.numThreads);
+
+	//================================================================
+	// Initialize
+	//================================================================
+	CameraStereoImages camera(args.pathLeftImages, args.pathRightImages);
+	camera.setTimestamps(args.pathTimes);
+	camera.init(appSetting.inputType);
+
+	StereoCameraModel stereoCameraModel;
+	stereoCameraModel.load(args.pathLeftCalib, args.pathRightCalib, appSetting.doResize);
+
+	// same settings as the slam application
+	cv::Ptr<cv::StereoBM> bm = cv::StereoBM::create(16, 9);
+	bm->setPreFilterCap(31);
+	bm->setBlockSize(21);
+	bm->setMinDisparity(0);
+	bm->setNumDisparities(64);
+	bm->setTextureThreshold(10);
+	bm->setUniquenessRatio(10);
+	bm->setSpeckleWindowSize(50);
+	bm->setSpeckleRange(32);
+	bm->setDisp12MaxDiff(1);
+
+	SOFT_BM_PARAM softBMParam;
+	softBMParam.blockSize = 21;
+	softBMParam.numDisparities = 64;
+	softBMParam.uniEnable = 0;
+	softBMParam.uniMode = 0;
+	softBMParam.uniThreshold = 0;
+	SoftBM softBM(softBMParam);
+	SoftGFTT softGFTT;
+	OrbDescriptor orb(appSetting.descMethod);
+
+	Odometry odom;
+	odom.setTracking(appSetting.odomTracking != 0);
+	odom.setLocalMap(appSetting.odomLocalMap != 0);
+	ODOM_INFO odomInfo;
+
+	//================================================================
+	// Odometry loop
+	//================================================================
+	int numFrames = 0;
+	int numFailed = 0;
+	long totalAllocs = 0;
+	while ((args.numImages < 0) || (numFrames < args.numImages))
+	{
+		SensorData data(stereoCameraModel);
+		camera.captureFromFile(data, appSetting);
+		if (data.imageLeft().empty()) {
+			break;
+		}
+
+		// features, not counted
+		if (appSetting.depthMethod == DEPTH_METHOD_CV_BM) {
+			cv::Mat disp = framePool.acquire(data.imageLeft().size(), CV_16SC1);
+			bm->compute(data.imageLeft(), data.imageRight(), disp);
+			data.setImageDepth(disp);
+		}
+		else {
+			cv::Mat disp;
+			softBM.compute(data.imageLeft(), data.imageRight(), disp);
+			data.setImageDepth(disp);
+		}
+
+		std::vector<cv::KeyPoint> kpts2d;
+		if (appSetting.kptsMethod == KPTS_METHOD_CV_GFTT) {
+			generateKeypoints(data.imageLeft(), kpts2d);
+		}
+		else {
+			cv::Mat eig;
+			unsigned short maxEigen;
+			softGFTT.compute(data.imageLeft(), eig, &maxEigen);
+			data.setImageEigen(eig);
+			data.setMaxEigen(maxEigen);
+			generateKeypoints2(data.imageEigen(), data.maxEigen(), kpts2d);
+		}
+		runByImageBorder(kpts2d, data.imageLeft().size(), ORB_EDGE_THRESHOLD);
+
+		std::vector<cv::KeyPoint> kpts2dCopy = kpts2d;
+		std::vector<cv::Point3f> kpts3d;
+		generateKeypoints3D(data, stereoCameraModel, kpts2dCopy, kpts3d, data.imageDepth(), appSetting.depthMethod, nullptr); // dense depth only
+		cv::Mat desc;
+		orb.compute(data.imageLeft(), kpts2d, desc);
+		data.setFeatures(kpts2d, kpts3d, desc, data.imageDepth());
+
+		// odometry, counted
+		long before = numAllocs;
+		counting = true;
+		odom.process(data, &odomInfo);
+		counting = false;
+		long allocs = numAllocs - before;
+
+		bool steady = (numFrames >= warmup);
+		if (steady) {
+			totalAllocs += allocs;
+			if (allocs) {
+				numFailed++;
+			}
+		}
+		printf("frame %d: %ld allocations%s%s\n", numFrames, allocs,
+			steady ? "" : " (warm-up)", odomInfo.lost ? " (lost)" : "");
+		numFrames++;
+	}
+
+	//================================================================
+	// Result
+	//================================================================
+	int numSteady = std::max(numFrames - warmup, 0);
+	printf("%d frames after %d warm-up frames, %d with allocations, %ld allocations\n",
+		numSteady, warmup, numFailed, totalAllocs);
+
+	return ((numSteady > 0) && (numFailed == 0)) ? 0 : 1;
+}
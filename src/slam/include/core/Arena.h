@@ -0,0 +1,84 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#define ARENA_BLOCK_SIZE	(256 * 1024)	// initial block size [bytes]
+#define ARENA_ALIGN			16				// default alignment, fits SIMD loads
+
+//=============================================================================
+// Per-frame Arena
+//-----------------------------------------------------------------------------
+// Monotonic allocator for the scratch buffers of a frame. Memory is never
+// freed one by one, reset() releases everything at once. The blocks are
+// kept and merged into one on reset(), so once the arena has seen its
+// largest frame, later frames do not touch the heap.
+// An arena is not thread-safe, local() returns the arena of the calling
+// thread. Nothing allocated from it may outlive the next reset().
+//=============================================================================
+class Arena
+{
+public:
+	Arena(size_t blockSize = ARENA_BLOCK_SIZE);
+	~Arena();
+
+	void *allocate(size_t size, size_t align = ARENA_ALIGN);
+	template<class T> T *alloc(size_t n) {
+		return (T*)allocate(n * sizeof(T), alignof(T) > ARENA_ALIGN ? alignof(T) : ARENA_ALIGN);
+	}
+	void reset(void);
+
+	size_t used(void) const;
+	size_t capacity(void) const;
+
+	static Arena &local(void);
+
+private:
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+	struct BLOCK {
+		char *data;
+		size_t size;
+	};
+
+	std::vector<BLOCK> _blocks;
+	size_t _current;	// block in use
+	size_t _offset;		// first free byte in the current block
+	size_t _blockSize;
+};
+
+//=============================================================================
+// STL allocator on an arena, deallocate() is a no-op
+//=============================================================================
+template<class T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	ArenaAllocator() : _arena(&Arena::local()) {}
+	ArenaAllocator(Arena &arena) : _arena(&arena) {}
+	template<class U> ArenaAllocator(const ArenaAllocator<U> &a) : _arena(a.arena()) {}
+
+	T *allocate(size_t n) { return _arena->alloc<T>(n); }
+	void deallocate(T *, size_t) {}
+
+	Arena *arena(void) const { return _arena; }
+
+private:
+	Arena *_arena;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena() == b.arena(); }
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena() != b.arena(); }
+
+// vector on the arena of the thread that constructs it
+template<class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,37 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+struct EPIPOLAR_LK_PARAM {
+	int winWidth;			// window width [pixel]
+	int winHeight;			// window height [pixel]
+	int maxLevel;			// coarsest pyramid level, x is halved per level
+	int iterations;			// max iterations per level
+	float epsilon;			// stop when the update is smaller [pixel]
+	float minDisparity;		// exclusive
+	float maxDisparity;		// inclusive
+	float minEigThreshold;	// mean squared x-gradient in the window, same scale as calcOpticalFlowPyrLK
+	float maxError;			// max RMS residual in the window [intensity], 0:no check
+};
+
+//=============================================================================
+// 1D Lucas-Kanade along the Epipolar Line
+//-----------------------------------------------------------------------------
+// For rectified stereo pairs, the correspondence of a left keypoint lies
+// on the same row of the right image. The pyramid is decimated in x only,
+// the disparity is initialized by an exhaustive search within the bounds
+// at the coarsest level and refined by 1D LK at each level, clamped to
+// [minDisparity, maxDisparity].
+//=============================================================================
+void calcEpipolarLK(
+	const cv::Mat &leftImage,
+	const cv::Mat &rightImage,
+	const std::vector<cv::Point2f> &leftCorners,
+	std::vector<cv::Point2f> &rightCorners,
+	std::vector<unsigned char> &status,
+	const EPIPOLAR_LK_PARAM &param);
@@ -8,6 +8,7 @@
 #include "opencv2/highgui.hpp"
 #include "core/Parameters.h"
 #include "core/SensorData.h"
+#include "core/Imu.h"
 
 
 //==========================================================================
@@ -31,6 +32,7 @@
 //  BUF_DISP_B: 7310_0000 - 731F_FFFF (1MB)
 //  BUF_GFTT_A: 7320_0000 - 732F_FFFF (1MB)
 //  BUF_GFTT_B: 7330_0000 - 733F_FFFF (1MB)
+//  BUF_IMU   : 7340_0000 - 7340_FFFF (64KB)
 //==========================================================================
 #define MEM_BASE_ADDR	0x72000000
 #define GRB_MAX_SIZE	0x00200000 // 2MB (512H * 1024W * 2YUV * 2LR)
@@ -39,6 +41,7 @@
 #define RECT_MAX_SIZE	0x00100000 // 1MB (512H * 1024W * 2LR)
 #define DISP_MAX_SIZE	0x00100000 // 1MB (512H * 1024W * 2bytes)
 #define GFTT_MAX_SIZE	0x00100000 // 1MB (512H * 1024W * 2bytes)
+#define IMU_MAX_SIZE	0x00010000 // 64KB (IMU_RING)
 #define BUF_GRB_A		MEM_BASE_ADDR
 #define BUF_GRB_B		(BUF_GRB_A  + GRB_MAX_SIZE)
 #define BUF_XSBL_A		(BUF_GRB_B  + GRB_MAX_SIZE)
@@ -51,10 +54,36 @@
 #define BUF_DISP_B		(BUF_DISP_A + DISP_MAX_SIZE)
 #define BUF_GFTT_A		(BUF_DISP_B + DISP_MAX_SIZE)
 #define BUF_GFTT_B		(BUF_GFTT_A + GFTT_MAX_SIZE)
+#define BUF_IMU			(BUF_GFTT_B + GFTT_MAX_SIZE)
 
 #define IMAGE_HEIGHT	480
 #define IMAGE_WIDTH		640
 
+
+//=============================================================================
+// IMU Sample Ring
+//-----------------------------------------------------------------------------
+// Written by the remote app, read by the linux app. Samples are the raw
+// LSM9DS1 outputs stamped by the FPGA timer [us], the k-th sample is stored
+// in Sample[k % IMU_RING_SIZE].
+//=============================================================================
+#define IMU_RING_MAGIC	0x494D5531 // "IMU1", sensor is running
+#define IMU_RING_SIZE	2048       // 8.6s at 238Hz
+
+struct IMU_RAW_SAMPLE {
+	unsigned int Timer;		//!< FPGA timer [us]
+	short Gyro[3];			//!< angular rate X/Y/Z
+	short Accel[3];			//!< linear acceleration X/Y/Z
+};
+
+struct IMU_RING {
+	volatile unsigned int Magic;		//!< [0000h] IMU_RING_MAGIC
+	volatile unsigned int WriteCount;	//!< [0004h] number of samples written
+	volatile unsigned int Period;		//!< [0008h] sample period [us]
+	volatile unsigned int rsvd[5];		//!< [000Ch-001Ch]
+	struct IMU_RAW_SAMPLE Sample[IMU_RING_SIZE];
+};
+
 #define RECT_ALIGN_HEIGHT	512
 #define RECT_ALIGN_WIDTH	1024
 #define RECT_FRAME_OFFSET	(RECT_ALIGN_HEIGHT * RECT_ALIGN_WIDTH)
@@ -374,12 +403,15 @@ public:
 	void receiveDepthMap(int bank, cv::Mat &matDepth);
 	void receiveEigen(int bank, cv::Mat &matEigen, unsigned short *maxEigen);
 	void receiveData(SensorData &data, APP_SETTING appSetting);
+	int receiveImu(Imu &imu);
+	double frameStamp(void) { return timerToSec(_frameTimer); }
 	int readSwitch(void);
 	int isSwitchPressed(void);
 	void ledOn(void);
 	void ledOff(void);
 	void ledBlink(int rate);
 	unsigned int readTimer(void);
+	double timerToSec(unsigned int timer);
 
 	volatile struct FPGA_REG *reg;
 
@@ -390,8 +422,15 @@ private:
 	int fd_mem_bm;
 	int fd_mem_disp;
 	int fd_mem_gftt;
+	int fd_mem_imu;
 	volatile unsigned char *iomap_rect;
 	volatile unsigned char *iomap_bm;
 	volatile unsigned char *iomap_disp;
 	volatile unsigned char *iomap_gftt;
+	volatile struct IMU_RING *iomap_imu;
+
+	unsigned int _imuReadCount;	// samples taken from the IMU ring
+	unsigned int _frameTimer;	// FPGA timer at the last frame [us]
+	unsigned int _timerLast;	// last converted FPGA timer [us]
+	double _timerSec;			// "_timerLast" in seconds, wrap-around removed
 };
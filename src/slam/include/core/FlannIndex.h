@@ -18,6 +18,9 @@ public:
 	void buildKDTreeIndex(const cv::Mat &features, int trees);
 	bool isBuilt();
 	std::vector<unsigned int> addPoints(const cv::Mat & features);
+	void removePoint(unsigned int index);
+	unsigned int removedFeatures();
+	void compact();
 	void knnSearch(const cv::Mat &query, cv::Mat &indices, cv::Mat &dists, int knn, int checks);
 
 	unsigned long getSize();
@@ -29,5 +32,6 @@ private:
 	int featuresDim_;
 	unsigned long featureSize_;
 	std::map<int, cv::Mat> addedDescriptors_;
+	std::map<int, cv::Mat> removedDescriptors_; // kept alive until the index is rebuilt
 };
 
@@ -0,0 +1,42 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+
+#define FRAME_POOL_MAX_SLABS	8		// slabs kept per size and type
+#define FRAME_POOL_KEYPOINTS	2048	// feature storage reserved per frame
+
+//=============================================================================
+// Frame Buffer Pool
+//-----------------------------------------------------------------------------
+// Image, disparity and eigenvalue slabs recycled across frames. The pool
+// keeps one reference to each slab, a slab is free again once all other
+// cv::Mat referring to it are released, e.g. when clearRawData() drops the
+// images of a frame or the key frame is replaced. In the steady state the
+// frame loop allocates no image memory.
+// Slabs are matched by size and type. Beyond FRAME_POOL_MAX_SLABS busy
+// slabs of a kind a plain cv::Mat is returned. Thread-safe.
+//=============================================================================
+class FramePool
+{
+public:
+	FramePool();
+	~FramePool();
+
+	cv::Mat acquire(int rows, int cols, int type);
+	cv::Mat acquire(cv::Size size, int type) { return acquire(size.height, size.width, type); }
+	void clear(void);
+
+	unsigned long getSize() const;
+
+private:
+	static bool isFree(const cv::Mat &slab);
+
+	mutable std::mutex _mutex;
+	std::vector<cv::Mat> _slabs;
+};
@@ -0,0 +1,56 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <deque>
+#include <string>
+#include "core/Transform.h"
+
+#define IMU_MAX_GAP			0.05	// longest interval without samples [s]
+#define IMU_BIAS_GAIN		0.05f	// gyro bias update per frame
+#define IMU_BIAS_MAX_ERROR	0.05f	// gyro/visual rotation mismatch to update the bias [rad]
+
+//=============================================================================
+// Inertial sample in SI units
+//=============================================================================
+struct IMU_SAMPLE {
+	double stamp;		// [s], same clock as the frame stamps
+	float gyro[3];		// angular rate [rad/s]
+	float accel[3];		// linear acceleration [m/s^2]
+};
+
+//=============================================================================
+// Inertial Measurements
+//-----------------------------------------------------------------------------
+// Sample history fed by the FPGA sample ring or by a recorded log. The gyro
+// rates between two frame stamps are integrated into the rotation of the
+// base frame, which replaces the rotation part of the odometry guess.
+// The extrinsic rotates the IMU axes to the base frame (x forward, y left,
+// z up). The gyro bias is tracked against the visual rotation.
+//=============================================================================
+class Imu
+{
+public:
+	Imu();
+	~Imu();
+
+	bool load(const std::string &path);
+	bool loadExtrinsic(const std::string &path);
+	void push(const IMU_SAMPLE &sample);
+	void discard(double stamp);
+
+	bool integrate(double from, double to, Transform &rotation) const;
+	void updateBias(const Transform &motion, double from, double to);
+
+	bool empty() const { return _samples.empty(); }
+	unsigned long getSize();
+
+private:
+	bool integrateImu(double from, double to, Eigen::Matrix3f &rotation) const;
+
+	std::deque<IMU_SAMPLE> _samples; // ordered by stamp
+	Eigen::Matrix3f _imuToBase;
+	Eigen::Vector3f _bias;           // gyro bias in the IMU axes [rad/s]
+};
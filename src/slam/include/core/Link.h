@@ -36,8 +36,12 @@ public:
 	void setType(Type type) { type_ = type; }
 	Type type() const { return type_; }
 
-	void setInfMatrix(const cv::Mat &infMatrix) { infMatrix_ = infMatrix; }
-	const cv::Mat &infMatrix() const { return infMatrix_; }
+	// "infMatrix" is copied in and out
+	void setInfMatrix(const cv::Mat &infMatrix);
+	cv::Mat infMatrix() const;
+	Eigen::Map<const Eigen::Matrix<double, 6, 6, Eigen::RowMajor>> information() const {
+		return Eigen::Map<const Eigen::Matrix<double, 6, 6, Eigen::RowMajor>>(infMatrix_);
+	}
 
 	bool isValid();
 	Link inverse() const;
@@ -49,6 +53,6 @@ private:
 	int to_;
 	Transform transform_;
 	Type type_;
-	cv::Mat infMatrix_; // Information matrix = covariance matrix ^ -1
+	double infMatrix_[36]; // Information matrix = covariance matrix ^ -1, row-major
 };
 
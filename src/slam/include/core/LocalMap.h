@@ -0,0 +1,56 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include "core/SensorData.h"
+
+#define LOCAL_MAP_VOXEL_SIZE	0.1f	// voxel size and fusion radius [m]
+#define LOCAL_MAP_FUSE_HAMMING	50		// max descriptor distance to fuse a keypoint
+#define LOCAL_MAP_MAX_AGE		5		// key frames a landmark survives unobserved
+#define LOCAL_MAP_MAX_LANDMARKS	4000
+
+//=============================================================================
+// Local Map of Landmarks
+//-----------------------------------------------------------------------------
+// 3D keypoints of the recent key frames fused into landmarks in the world
+// coords, in SoA layout indexed by landmark. A keypoint within the fusion
+// radius of a landmark with a similar descriptor is merged into it, the
+// candidates are found by a voxel hash. Each landmark carries the latest
+// descriptor, the number of observations and the key frame it was last
+// observed in, landmarks not observed for LOCAL_MAP_MAX_AGE key frames are
+// removed.
+// getFrame() exposes the landmarks as the keypoints of a frame at a given
+// pose, so the registration matches a frame against the map as it does
+// against a key frame.
+//=============================================================================
+class LocalMap
+{
+public:
+	LocalMap();
+	~LocalMap();
+
+	void clear();
+	void addKeyFrame(const SensorData &keyFrame, const Transform &pose);
+	void observe(const std::vector<std::pair<int, int>> &inlierIndex);
+	void getFrame(const Transform &pose, SensorData &frame) const;
+	int size() const { return (int)_points.size(); }
+	unsigned long getSize() const;
+
+private:
+	long long key(int vx, int vy, int vz) const;
+	int voxel(float val) const;
+	int findLandmark(const cv::Point3f &pt, const unsigned char *descriptor) const;
+	void prune();
+	void buildVoxels();
+
+	std::vector<cv::Point3f> _points;	// world coords
+	cv::Mat _descriptors;				// latest descriptor of each landmark
+	std::vector<int> _observations;		// number of key frames and frames it was found in
+	std::vector<int> _lastSeen;			// key frame count at the last observation
+	int _keyFrameCount;
+	std::unordered_map<long long, std::vector<int>> _voxels; // landmark indices
+};
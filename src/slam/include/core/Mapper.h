@@ -10,6 +10,19 @@
 #include "core/Odometry.h"
 #include "core/xThread.h"
 #include "core/Parameters.h"
+#include "core/SpatialIndex.h"
+
+// node insertion policy, a node holding features is created when the
+// motion since the previous one, the view change or the parallax is
+// large enough. No node is created while the vehicle stands still.
+#define MAP_NODE_MIN_INTERVAL	3		// min frames between nodes holding features
+#define MAP_NODE_MAX_INTERVAL	20		// max frames between nodes holding features
+#define MAP_NODE_DIST			1.0f	// translation [m]
+#define MAP_NODE_ANGLE			0.26f	// rotation [rad], 15deg
+#define MAP_NODE_INLIER_RATIO	0.3f	// inliers per keypoint of the frame
+#define MAP_NODE_PARALLAX		5.0f	// median parallax since the key frame [deg]
+#define MAP_STILL_DIST			0.02f	// translation since the last node [m]
+#define MAP_STILL_ANGLE			0.017f	// rotation since the last node [rad], 1deg
 
 void getConnectedGraph(
 	int fromId,
@@ -18,6 +31,13 @@ void getConnectedGraph(
 	std::map<int, Transform> & posesOut,
 	std::multimap<int, Link> & linksOut);
 
+struct LC_PARAM {
+	int topK;			// number of hypotheses to be verified
+	float timeBudget;	// time budget for verification [ms], 0:unlimited
+	bool spatial;		// compare only "candidates", false:all nodes in WM
+	std::vector<int> candidates; // nodes around the current node, sorted
+};
+
 struct TH_PARAM {
 	Node *node;
 	VWDictionary *vwd;
@@ -25,12 +45,18 @@ struct TH_PARAM {
 	std::map<int, double> *workingMem;
 	Link link;
 	int state;
+	LC_PARAM lcParam;
+	int vwPrune;
+	int vwMaxWords;
+	std::vector<int> nodesLeftStm; // nodes moved to WM since the last thread
 };
 
 void* thread(void* arg);
 void* addWordIds(Node *node, VWDictionary *vwd);
-void detectLoopClosure(std::map<int, Node*> &nodes, std::map<int, double> &workingMem, VWDictionary *_vwd, int id, Link *link);
+void pruneWords(std::map<int, Node*> &nodes, VWDictionary *vwd, const std::vector<int> &ids, int prune, int maxWords);
+void detectLoopClosure(std::map<int, Node*> &nodes, std::map<int, double> &workingMem, VWDictionary *_vwd, int id, Link *link, const LC_PARAM &param);
 std::map<int, float> computeLikelihood(Node *node, std::map<int, Node*> &_nodes, VWDictionary *_vwd, const std::list<int> & ids);
+std::map<int, float> computeLikelihood(const std::vector<int> &wordIds, std::map<int, Node*> &_nodes, VWDictionary *_vwd, const std::list<int> & ids);
 
 class Mapper
 {
@@ -39,7 +65,10 @@ public:
 	virtual ~Mapper();
 
 	bool process(SensorData &data, ODOM_INFO odomInfo, APP_SETTING appSetting);
+	bool relocalize(const SensorData &data, int topK, Transform &pose, cv::Mat &covariance);
+	bool needsFeatures() const { return _nodeDue; } // next node may not be intermediate
 	void init();
+	bool loadVocabulary(const std::string &path) { return _vwd->loadVocabulary(path); }
 	void getGraph(std::map<int, Transform> &poses, std::multimap<int, Link> &links);
 	cv::Mat getInformation(const cv::Mat & covariance) const;
 	void cleanupThread();
@@ -63,15 +92,24 @@ private:
 	int getNextId();
 	void initCountId();
 	Node *createNode(SensorData &data, ODOM_INFO odomInfo);
+	bool isStill(const ODOM_INFO &odomInfo) const;
+	bool isNodeDue(const Transform &pose, const ODOM_INFO &odomInfo, int interval) const;
 
 	int _frameProcessed;
 	int _intermediateCount;
-	int _mapUpdate;
+	bool _nodeDue; // the next frame is expected to become a node holding features
+	Transform _featureNodePose; // pose of the last node holding features
 	std::map<int, float> _likelihood;
 	int _key_id;
 	int _maxStMemSize;
 	int _idCount;
 	int _idMapCount; // map id, reserved for multi-map session
+	int _loopClosureCount;
+	int _lcCount; // number of loop-closure detections
+	float _driftVariance; // accumulated odometry variance
+	std::map<int, float> _stMemVariance; // <node ID, accumulated variance> in STM
+	SpatialIndex _spatialIndex; // positions of the nodes in WM
+	std::vector<int> _nodesLeftStm; // nodes moved to WM, pending VW pruning
 	Node *_lastNode;
 	std::map<int, Node*> _nodes;
 	std::set<int> _stMem; // contains node IDs
@@ -7,37 +7,34 @@
 #include "core/Transform.h"
 #include "opencv2/opencv.hpp"
 #include "core/StereoCameraModel.h"
+#include "core/Arena.h"
+#include "core/PnPRansac.h"
 
 Transform estimateMotion3DTo2D(
-	const std::map<int, cv::Point3f> &words3A,
-	const std::map<int, cv::KeyPoint> &words2B,
+	const cv::Point3f *objectPoints,	// 3D coords in "from", finite
+	const cv::Point2f *imagePoints,		// 2D coords in "to"
+	const cv::Point3f *objectPointsB,	// 3D coords in "to", for the covariance
+	const float *quality,				// NNDR ratio of each match, orders the PnP samples
+	int num,
 	const StereoCameraModel &cameraModel,
 	int minInliers,
 	int refineIterations,
 	const Transform &guess,
-	const std::map<int, cv::Point3f> &words3B,
-	cv::Mat *covariance, // mean reproj error if words3B is not set
-	std::vector<int> *matchesOut,
-	std::vector<int> *inliersOut);
-
-std::vector<float> computeReprojErrors(
-	std::vector<cv::Point3f> opoints,
-	std::vector<cv::Point2f> ipoints,
-	const cv::Mat &cameraMatrix,
-	const cv::Mat &distCoeffs,
-	const cv::Mat &rvec,
-	const cv::Mat &tvec,
-	float threshold,
-	std::vector<int> &inliers);
+	cv::Mat *covariance,
+	ArenaVector<int> &inliers,
+	const PNP_CANCEL *cancel = nullptr);
 
 void solvePnPRansac(
-	const std::vector<cv::Point3f> &objectPoints,
-	const std::vector<cv::Point2f> &imagePoints,
+	const cv::Point3f *objectPoints,
+	const cv::Point2f *imagePoints,
+	int num,
 	const cv::Mat &cameraMatrix,
 	const cv::Mat &distCoeffs,
-	cv::Mat &rvec,
-	cv::Mat &tvec,
+	double R[9],
+	double t[3],
 	int minInliersCount,
 	int refineIterations,
-	std::vector<int> &inliers);
+	ArenaVector<int> &inliers,
+	const float *quality = nullptr,
+	const PNP_CANCEL *cancel = nullptr);
 
@@ -33,8 +33,14 @@ public:
 	bool hasLink(int idTo, Link::Type type = Link::Undefined) const;
 	const std::multimap<int, Link> & getLinks() const { return _links; }
 
-	void setWords(std::multimap<int, int> words) { _words = words; }
-	const std::multimap<int, int> & getWords() const { return _words; }
+	// words, sorted by VW ID
+	void setWords(const std::vector<int> &kptWordIds);
+	int getNumWords() const { return _numWords; }
+	int getNumUniqueWords() const { return _numUniqueWords; }
+	const std::vector<unsigned int> &getWordIds() const { return _wordIds; }
+	const std::vector<int> &getWordKptIndices() const { return _wordKptIndices; }
+	void getWordRange(unsigned int wordId, int &first, int &last) const;
+	int getWordCount(unsigned int wordId) const;
 
 	void setVelocity(Transform velocity) { _velocity = velocity; }
 	const Transform getVelocity() const { return _velocity; }
@@ -54,7 +60,10 @@ private:
 	std::multimap<int, Link> _links; // <node ID, Link>
 	int _weight;
 
-	std::multimap<int, int> _words; // word <VW ID, keypoint index>
+	std::vector<unsigned int> _wordIds; // VW IDs in ascending order
+	std::vector<int> _wordKptIndices; // keypoint index of each VW
+	int _numUniqueWords;
+	int _numWords; // including keypoints without VW
 
 	Transform _pose;
 	Transform _velocity;
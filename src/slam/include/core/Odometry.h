@@ -7,6 +7,8 @@
 #include "core/Transform.h"
 #include "core/SensorData.h"
 #include "core/Registration.h"
+#include "core/Imu.h"
+#include "core/LocalMap.h"
 
 struct ODOM_INFO {
 	Transform pose;
@@ -17,6 +19,9 @@ struct ODOM_INFO {
 	Transform transform;
 	float distanceTravelled;
 	cv::Mat covariance;
+	float inlierRatio;  // inliers per keypoint of the frame
+	float parallax;     // median parallax of the inliers since the key frame [deg]
+	bool tracked;       // keypoints were tracked by track(), the frame has no features of its own
 };
 
 class Odometry
@@ -30,12 +35,19 @@ public:
 
 	Odometry();
 	~Odometry();
-	void process(SensorData data, ODOM_INFO *odomInfo);
+	void process(const SensorData &data, ODOM_INFO *odomInfo);
 
 	const Transform &getPose() const { return _pose; }
 	unsigned int framesProcessed() const { return framesProcessed_; }
 
-	Transform updateMotion(SensorData data, const Transform guess);
+	Transform updateMotion(const SensorData &data, const Transform &guess);
+	void relocalize(const SensorData &data, const Transform &pose, const cv::Mat &covariance, ODOM_INFO *odomInfo);
+
+	void setTracking(bool enable) { _tracking = enable; }
+	void setImu(Imu *imu) { _imu = imu; }
+	void setLocalMap(bool enable) { _localMapMode = enable; }
+	void setRelocalization(bool enable) { _relocalization = enable; }
+	bool track(SensorData &data, std::vector<cv::KeyPoint> &kpts2d, cv::Mat &desc);
 
 	void setNumObjects(int numObjects) { _numObjects = numObjects; }
 	int getNumObjects() { return _numObjects; }
@@ -45,6 +57,8 @@ public:
 	void getMemoryUsed();
 
 private:
+	void trackKeyFrame(const SensorData &data);
+
 	Transform _pose; // current pose
 	double previousStamp_;
 	Transform velocityGuess_;
@@ -58,4 +72,27 @@ private:
 	float _distanceTravelled;
 	REG_INFO _regInfo;
 	int _state;
+	float _inlierRatio;
+	float _parallax;
+	bool _relocalization; // stay lost until relocalize(), the key frame is kept
+
+	// inertial motion prior
+	Imu *_imu;              // gyro rotation between frames, null if unused
+	float _guessWinSize;    // search radius of the guided matching [px]
+
+	// keypoint tracking between key frames
+	bool _tracking;         // track key frame keypoints instead of detection
+	bool _trackedFrame;     // keypoints of the current frame are tracked
+	bool _keyFramePending;  // create a key frame at the next detection
+	int _minTracked;        // minimum number of tracks to skip detection
+	cv::Mat _prevImage;     // left image of the previous frame
+	std::vector<cv::Mat> _prevPyramid; // LK pyramid of "_prevImage"
+	std::vector<cv::Point2f> _trackPts; // track positions in "_prevImage"
+	std::vector<int> _trackIndex;       // keypoint indices in the key frame
+
+	// frame-to-map registration
+	bool _localMapMode;       // register against the local map instead of the key frame
+	bool _localMapUsed;       // the current frame was registered against the local map
+	LocalMap _localMap;       // landmarks of the recent key frames
+	SensorData _localMapFrame; // landmarks in the coords of the key frame
 };
@@ -0,0 +1,51 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#define ORB_PATCH_SIZE		31
+#define ORB_HALF_PATCH_SIZE	15
+#define ORB_EDGE_THRESHOLD	19
+#define ORB_DESC_BYTES		32
+#define ORB_NUM_POINTS		512 // 256 pairs
+
+//=============================================================================
+// ORB Descriptor for Single-Level Keypoints
+//-----------------------------------------------------------------------------
+// Same descriptor as computeDescriptor() for keypoints at octave 0, without
+// the padded image pyramid. The rotated sampling pattern is kept as pixel
+// offset tables per integer angle [deg], built on first use.
+//   DESC_METHOD_ORB          : keypoint angle as is (same output as CV_ORB)
+//   DESC_METHOD_ORB_UPRIGHT  : no rotation
+//   DESC_METHOD_ORB_ORIENTED : intensity centroid angle, rounded to 1 deg
+//=============================================================================
+class OrbDescriptor
+{
+public:
+	OrbDescriptor(int method);
+	~OrbDescriptor();
+
+	void compute(
+		const cv::Mat &image,
+		std::vector<cv::KeyPoint> &keypoints,
+		cv::Mat &desc);
+	unsigned long getSize() const;
+
+private:
+	void buildTable(float angle, int *table) const;
+	const int* table(int angle);
+	float icAngle(const unsigned char *center, int step) const;
+	void describe(const unsigned char *center, const int *table, unsigned char *desc) const;
+
+	int _method;
+	int _step; // image step the tables are built for
+	int _umax[ORB_HALF_PATCH_SIZE + 2];
+	short _maskU[ORB_HALF_PATCH_SIZE + 1][32];   // u inside the circular patch, 0 outside
+	short _maskOne[ORB_HALF_PATCH_SIZE + 1][32]; // 1 inside the circular patch, 0 outside
+	std::vector<int*> _tables; // [-360, 360] deg
+	cv::Mat _blurred;
+};
@@ -27,14 +27,27 @@ enum DEPTH_METHOD {
 	DEPTH_METHOD_CV_LK,		// OpenCV LK Method (sparse)
 	DEPTH_METHOD_CV_BM,		// OpenCV Block Matching
 	DEPTH_METHOD_CV_SGBM,	// OpenCV Semi-GLobal Block Matching
-	DEPTH_METHOD_FPGA_BM	// FPGA Block Matching
+	DEPTH_METHOD_FPGA_BM,	// FPGA Block Matching
+	DEPTH_METHOD_EPI_LK,	// 1D LK along the epipolar line (sparse)
+	DEPTH_METHOD_SPARSE_BM,	// Block Matching at keypoints (sparse)
+	DEPTH_METHOD_SOFT_BM	// FPGA Block Matching on CPU
 };
 
 // how to detect keypoints
 enum KPTS_METHOD {
 	KPTS_METHOD_NONE,
 	KPTS_METHOD_CV_GFTT,	// OpenCV GFTT
-	KPTS_METHOD_FPGA_GFTT	// FPGA GFTT
+	KPTS_METHOD_FPGA_GFTT,	// FPGA GFTT
+	KPTS_METHOD_SOFT_GFTT	// FPGA GFTT on CPU
+};
+
+// how to compute descriptors
+enum DESC_METHOD {
+	DESC_METHOD_NONE,
+	DESC_METHOD_CV_ORB,			// ORB copied from OpenCV
+	DESC_METHOD_ORB,			// ORB for single-level keypoints, same output as CV_ORB
+	DESC_METHOD_ORB_UPRIGHT,	// ORB without rotation
+	DESC_METHOD_ORB_ORIENTED	// ORB with intensity centroid orientation
 };
 
 enum INPUT_TYPE {
@@ -47,10 +60,26 @@ struct APP_SETTING {
 	int inputType;   // file input or sensor input
 	int depthMethod; // depth map generation method
 	int kptsMethod;  // keypoint generation method
+	int descMethod;  // descriptor computation method
 	int doResize;    // resize images to 640x480
 	int useFpga;     // implicitly declare use of FPGA
 	int quiet;       // no log message
 	int memory;      // enable memory consumption report
+	int numThreads;  // number of worker threads in the thread pool
+	int lcTopK;      // number of loop-closure hypotheses to be verified
+	float lcTimeBudget; // time budget for loop-closure verification [ms], 0:unlimited
+	float lcRadius;  // loop-closure candidate search radius [m], 0:all nodes
+	float lcRadiusScale; // search radius per standard deviation of the drift
+	int lcGlobalInterval; // search all nodes every N loop-closure detections
+	int vwPrune;     // remove VWs referred by a single node when it leaves STM
+	int vwMaxWords;  // maximum number of VWs in the dictionary, 0:unlimited
+	int saveDescriptor; // dump descriptors of every frame for vocabulary training
+	int rawInput;    // input images are not rectified, rectified on the CPU
+	int odomTracking; // track keypoints between key frames instead of detection
+	int lazyFeatures; // descriptors only for keypoints with valid depth
+	int useImu;      // gyro rotation as the odometry motion prior
+	int relocTopK;   // number of relocalization candidates to be verified, 0:disabled
+	int odomLocalMap; // register frames against the local map of recent key frames
 };
 
 
@@ -106,8 +135,27 @@ struct ARG_PARAMS {
 	int numImages;
 	std::string pathLeftCalib;
 	std::string pathRightCalib;
+	std::string pathVocabulary;
+	std::string depthMethod;
+	std::string kptsMethod;
+	std::string descMethod;
 	int quiet;
 	int memory;
+	int numThreads;
+	int lcTopK;
+	float lcTimeBudget;
+	float lcRadius;
+	int vwPrune;
+	int vwMaxWords;
+	int saveDescriptor;
+	int rawInput;
+	int odomTracking;
+	int lazyFeatures;
+	int useImu;
+	int relocTopK;
+	int odomLocalMap;
+	std::string pathImu;
+	std::string pathImuCalib;
 };
 
 
@@ -0,0 +1,115 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <opencv2/core/core.hpp>
+#include "core/Arena.h"
+
+//=============================================================================
+// Cancellation of a running estimation, checked between the RANSAC rounds.
+// Cancelled when a better ranked job has succeeded (*bestRank < rank) or
+// the deadline has passed.
+//=============================================================================
+struct PNP_CANCEL {
+	const std::atomic<int> *bestRank;	// null if not ranked
+	int rank;
+	std::chrono::steady_clock::time_point deadline; // time_point::max():none
+};
+
+bool isCancelled(const PNP_CANCEL *cancel);
+
+struct PNP_RANSAC_PARAM {
+	int maxIterations;		// maximum number of samples
+	float reprojError;		// inlier threshold [px]
+	double confidence;		// probability that an outlier free sample is drawn
+	int refineIterations;	// Gauss-Newton iterations on the inliers
+	int numStreams;			// RNG streams, run in parallel on the thread pool
+	uint64 seed;			// seed of the 1st stream
+	const PNP_CANCEL *cancel;	// stops between rounds, null if never
+};
+
+//=============================================================================
+// PnP RANSAC for Pinhole Cameras
+//-----------------------------------------------------------------------------
+// Pose RANSAC for the 3D-2D motion estimation.
+//  - P3P minimal solver (Lambda Twist), every solution is a hypothesis
+//  - PROSAC sampling when match qualities are given, smaller is better
+//  - SPRT test rejects a bad hypothesis after a few points
+//  - points in SoA buffers, scored 4 at a time with SIMD
+//  - Gauss-Newton refinement of the best pose on its inliers
+// The samples are drawn by "numStreams" RNG streams in rounds. All streams
+// see the state of the previous round, and the round results are merged in
+// stream order, so the pose depends on the seed and the number of streams
+// only, not on the number of threads or the scheduling. A cancelled
+// estimation stops at the next round and fails.
+// A pose maps model points into the camera frame, x = R * X + t, where R is
+// a row-major 3x3 matrix. Image points must be free of lens distortion.
+// All buffers are on the arena of the constructing thread.
+//=============================================================================
+class PnPRansac
+{
+public:
+	PnPRansac(const PNP_RANSAC_PARAM &param);
+	~PnPRansac();
+
+	void setCamera(double fx, double fy, double cx, double cy);
+	void setPoints(
+		const cv::Point3f *objectPoints,
+		const cv::Point2f *imagePoints,
+		int num,
+		const float *quality = nullptr);
+
+	bool compute(double R[9], double t[3], bool useGuess, ArenaVector<int> &inliers) const;
+	int score(
+		const double R[9],
+		const double t[3],
+		float threshold,
+		ArenaVector<int> *inliers,
+		ArenaVector<float> *err) const;
+	void refine(double R[9], double t[3], const ArenaVector<int> &inliers, int iterations) const;
+
+private:
+	struct SPRT {
+		double epsilon;	// inlier ratio of a good hypothesis
+		double delta;	// inlier ratio of a bad hypothesis
+		double logA;	// decision threshold
+		float logPass;	// log likelihood ratio of an inlier
+		float logFail;	// log likelihood ratio of an outlier
+	};
+
+	struct PROSAC {
+		int subset;		// samples are drawn from the best "subset" points
+		int TnPrime;	// the last of them is in every sample up to here
+		double Tn;
+	};
+
+	struct STREAM {
+		cv::RNG rng;
+		PROSAC prosac;
+		int count;			// inliers of the best hypothesis in the round
+		double R[9], t[3];
+		double deltaSum;	// inlier ratio sum of the rejected hypotheses
+		int numRejected;
+	};
+
+	void updateSprt(SPRT &sprt) const;
+	void initProsac(PROSAC &prosac) const;
+	void drawSample(int iter, STREAM &stream, int *sample) const;
+	void search(int iter, STREAM &stream, const SPRT &sprt, float thr2) const;
+	int verify(const double R[9], const double t[3], float thr2, const SPRT *sprt, int *tested, unsigned char *mask) const;
+	int hypotheses(const int *sample, double R[4][9], double t[4][3]) const;
+
+	PNP_RANSAC_PARAM _param;
+	double _fx, _fy, _cx, _cy;
+	int _num;					// number of points
+	ArenaVector<float> _X, _Y, _Z;	// model points, padded to multiple of 4
+	ArenaVector<float> _u, _v;		// image points, padded to multiple of 4
+	ArenaVector<int> _order;		// PROSAC order, best quality first
+};
+
+int solveP3P(const double X[3][3], const double y[3][3], double R[4][9], double t[4][3]);
@@ -12,58 +12,87 @@
 #include "core/Logger.h"
 #include "core/Stereo.h"
 
+#define REG_GUESS_WIN_SIZE		40.0f	// radius search around the projected point [px]
+#define REG_GUESS_WIN_SIZE_IMU	20.0f	// same, rotation of the guess from the gyro
+
 struct REG_INFO {
 	cv::Mat covariance;
 	int num_inliers;
 	int num_matches;
+	std::vector<std::pair<int, int>> inlierIndex; // inlier pairs <from:to>
+};
+
+//=============================================================================
+// Correspondences between two frames
+//-----------------------------------------------------------------------------
+// Index aligned arrays on the frame arena, the k-th match pairs keypoint
+// from[k] in "from" image with keypoint to[k] in "to" image. "ratio" is
+// the NNDR ratio of each match (smaller is better), null if unknown.
+//=============================================================================
+struct MATCHES {
+	int num;
+	int *from;
+	int *to;
+	float *ratio;
+};
+
+//=============================================================================
+// Keypoints bucketed in square cells for the radius search
+//=============================================================================
+struct KPTS_GRID {
+	int cols;
+	int rows;
+	float cellSize;
+	int *start;		// first item of each cell, cols * rows + 1 entries
+	int *items;		// keypoint indices ordered by cell
 };
 
 Transform computeTransform(
-	SensorData sensorFrom,
-	SensorData sensorTo,
+	const SensorData &sensorFrom,
+	const SensorData &sensorTo,
 	Transform guess,
-	struct REG_INFO *info);
+	struct REG_INFO *info,
+	float guessWinSize = REG_GUESS_WIN_SIZE,
+	const PNP_CANCEL *cancel = nullptr);
 
-void matchingGuess_Projection(
-	std::vector<cv::Point3f> kptsFrom3D,
-	std::vector<cv::Point2f> &projectedPoint,
-	std::vector<int> &projectedIndex,
-	StereoCameraModel cameraModel,
-	Transform guess);
+int matchingGuess_Projection(
+	const std::vector<cv::Point3f> &kptsFrom3D,
+	cv::Point2f *projectedPoint,
+	int *projectedIndex,
+	const StereoCameraModel &cameraModel,
+	const Transform &guess);
 
-void matchingGuess_radiusSearch(
-	std::vector<cv::KeyPoint> kptsTo,
-	std::vector<cv::Point2f> projectedPoint,
-	std::vector<std::vector<int>> &indices);
-
-void matchingGuess_Nndr(
-	cv::Mat descriptorsFrom,
-	cv::Mat descriptorsTo,
-	std::vector<int> projectedIndex,
-	std::vector<cv::Point2f> projectedPoint,
-	std::vector<std::vector<int>> indices,
-	std::multimap<int, int> &matchedIndex);
+void matchingGuess_Grid(
+	const std::vector<cv::Point2f> &kptsTo,
+	const cv::Size &imageSize,
+	float cellSize,
+	KPTS_GRID &grid);
 
 int matchingGuess_search(
-	cv::Mat descriptorFrom,
-	cv::Mat descriptorsTo,
-	std::vector<int> indices);
+	const unsigned char *descriptorFrom,
+	const cv::Mat &descriptorsTo,
+	const std::vector<cv::Point2f> &kptsTo,
+	const KPTS_GRID &grid,
+	const cv::Point2f &projectedPoint,
+	float *ratio = nullptr);
 
 void matchingGuess(
-	SensorData sensorFrom,
-	SensorData sensorTo,
-	Transform guess,
-	std::multimap<int, int> &matchedIndex);
+	const SensorData &sensorFrom,
+	const SensorData &sensorTo,
+	const Transform &guess,
+	MATCHES &matches,
+	float guessWinSize = REG_GUESS_WIN_SIZE);
 
 void matchingNoGuess(
-	SensorData sensorFrom,
-	SensorData sensorTo,
-	std::multimap<int, int> &matchedIndex);
+	const SensorData &sensorFrom,
+	const SensorData &sensorTo,
+	MATCHES &matches);
 
 void estimateMotion(
-	SensorData sensorFrom,
-	SensorData sensorTo,
-	Transform guess,
+	const SensorData &sensorFrom,
+	const SensorData &sensorTo,
+	const Transform &guess,
 	Transform &transform,
 	REG_INFO *reg_info,
-	std::multimap<int, int> matchedIndex);
+	const MATCHES &matches,
+	const PNP_CANCEL *cancel = nullptr);
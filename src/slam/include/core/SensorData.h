@@ -4,10 +4,47 @@
 //=============================================================================
 #pragma once
 
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include "core/StereoCameraModel.h"
 #include "core/Logger.h"
 
+//=============================================================================
+// Frame Features
+//-----------------------------------------------------------------------------
+// Keypoints of a frame in SoA layout, each array is indexed by keypoint.
+// Immutable once created, SensorData refers to it by a shared pointer so
+// copies of a frame in odometry, mapper, nodes and the loop-closure thread
+// share one instance.
+//=============================================================================
+class FrameFeatures
+{
+public:
+	FrameFeatures();
+	FrameFeatures(
+		const std::vector<cv::KeyPoint> &keypoints,
+		const std::vector<cv::Point3f> &keypoints3D,
+		const cv::Mat &descriptors,
+		const cv::Mat &disparity,
+		int dispScale);
+
+	int size() const { return (int)_points.size(); }
+	const std::vector<cv::Point2f> &points() const { return _points; }
+	const std::vector<float> &responses() const { return _responses; }
+	const std::vector<cv::Point3f> &points3D() const { return _points3D; }
+	const cv::Mat &descriptors() const { return _descriptors; }
+	const cv::Mat &disparity() const { return _disparity; }
+	int dispScale() const { return _dispScale; }
+
+private:
+	std::vector<cv::Point2f> _points;
+	std::vector<float> _responses;
+	std::vector<cv::Point3f> _points3D;
+	cv::Mat _descriptors;
+	cv::Mat _disparity; // decimated by "dispScale"
+	int _dispScale;
+};
+
 class SensorData
 {
 public:
@@ -23,7 +60,7 @@ public:
 	bool isIntermediate() const { return _intermediate; }
 	const cv::Size imageSize() { return _imageSize; }
 	void setImageSize(cv::Size imageSize) { _imageSize = imageSize; }
-	const int dispScale() const { return _dispScale; }
+	const int dispScale() const { return features().dispScale(); }
 	void setGroundTruth(const Transform &pose) { groundTruth_ = pose; }
 	const Transform &groundTruth() const { return groundTruth_; }
 
@@ -31,6 +68,8 @@ public:
 	cv::Mat &imageRight() { return _imageRight; }
 	cv::Mat &imageDepth() { return _imageDepth; }
 	cv::Mat &imageEigen() { return _imageEigen; }
+	const cv::Mat &imageLeft() const { return _imageLeft; }
+	const cv::Mat &imageRight() const { return _imageRight; }
 	void setImageLeft(cv::Mat &left) { _imageLeft = left; }
 	void setImageRight(cv::Mat &right) { _imageRight = right; }
 	void setImageDepth(cv::Mat &depth) { _imageDepth = depth; }
@@ -48,15 +87,17 @@ public:
 		const cv::Mat &descriptors,
 		const cv::Mat &disparity);
 	void clearFeatures();
-	void clearDescriptors();
-	const std::vector<cv::KeyPoint> &keypoints() const { return _keypoints; }
-	const std::vector<cv::Point3f> &keypoints3D() const { return _keypoints3D; }
-	const cv::Mat &descriptors() const { return _descriptors; }
-	const cv::Mat &disparity() const { return _disparity; }
+	const FrameFeatures &features() const { return _features ? *_features : _noFeatures; }
+	int numKeypoints() const { return features().size(); }
+	const std::vector<cv::Point2f> &points() const { return features().points(); }
+	const std::vector<float> &responses() const { return features().responses(); }
+	const std::vector<cv::Point3f> &keypoints3D() const { return features().points3D(); }
+	const cv::Mat &descriptors() const { return features().descriptors(); }
+	const cv::Mat &disparity() const { return features().disparity(); }
 	void clearRawData();
 
-	void limitKeypoints(
-		std::vector<cv::KeyPoint> keypoints,
+	static void limitKeypoints(
+		const std::vector<float> &responses,
 		std::vector<bool> &inliers,
 		int maxKeypoints);
 
@@ -75,7 +116,6 @@ private:
 	double _stamp;
 	cv::Size _imageSize;
 	bool _intermediate;
-	int _dispScale;
 	Transform groundTruth_;
 
 	StereoCameraModel _stereoCameraModel;
@@ -86,10 +126,8 @@ private:
 	cv::Mat _imageEigen;
 	unsigned short _maxEigen;
 
-	// features
-	std::vector<cv::KeyPoint> _keypoints;
-	std::vector<cv::Point3f> _keypoints3D;
-	cv::Mat _descriptors;
-	cv::Mat _disparity;
+	// features, shared among the copies
+	std::shared_ptr<const FrameFeatures> _features;
+	static const FrameFeatures _noFeatures;
 };
 
@@ -0,0 +1,49 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+struct SOFT_BM_PARAM {
+	int blockSize;			// SAD window size (wsz), odd, up to 31
+	int numDisparities;		// search range [0, numDisparities) (ndisp), multiple of 32, up to 256
+	int uniEnable;			// uniqueness filter (UniFiltCtrl[31])
+	int uniMode;			// 0: rejected pixels are 0x0000, 1: 0xFFFF (UniFiltCtrl[16])
+	int uniThreshold;		// min1 / min2 x1024 above this is rejected (UniFiltCtrl[9:0])
+};
+
+//=============================================================================
+// Software Block Matching
+//-----------------------------------------------------------------------------
+// CPU version of the FPGA BM core (dvp/rtl/xsbl2.v and bm*.v), same
+// arithmetic and the same depth map as Fpga::receiveDepthMap().
+// Rows are streamed through column sums of the SAD window like the HSAD
+// buffer in bm_calc_sad.v. The column sums saturate at 10 bits, so a row
+// depends on every row above it and the image is split into column bands
+// for the threads instead.
+//=============================================================================
+class SoftBM
+{
+public:
+	SoftBM(const SOFT_BM_PARAM &param);
+	~SoftBM();
+
+	void compute(const cv::Mat &left, const cv::Mat &right, cv::Mat &depth);
+	unsigned long getSize() const;
+
+	// x-Sobel of xsbl2.v (6 bits), the first and the last rows are 0.
+	// "reverse" mirrors the rows with 8 columns margin for the right image.
+	void prefilter(const cv::Mat &src, cv::Mat &dst, bool reverse = false) const;
+
+private:
+	void matchBand(int band, int numBands, cv::Mat &depth);
+	short decide(const unsigned short *sad) const;
+
+	SOFT_BM_PARAM _param;
+	cv::Mat _left;	// x-Sobel left image (6 bits)
+	cv::Mat _right;	// x-Sobel right image (6 bits), mirrored with 8 columns margin
+	std::vector<std::vector<unsigned short> > _colSum;	// per band
+};
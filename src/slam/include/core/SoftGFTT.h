@@ -0,0 +1,34 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+//=============================================================================
+// Software GFTT
+//-----------------------------------------------------------------------------
+// CPU version of the FPGA GFTT core (dvp/rtl/gftt_sbl.v, gftt_box.v and
+// gftt_eig.v), same fixed-point arithmetic and the same eigenvalue map and
+// maximum as Fpga::receiveEigen(), so that generateKeypoints2() picks the
+// same keypoints from either of them.
+// The image is split into row bands for the threads, each band recomputes
+// the two Sobel rows it shares with its neighbors.
+//=============================================================================
+class SoftGFTT
+{
+public:
+	SoftGFTT();
+	~SoftGFTT();
+
+	void compute(const cv::Mat &image, cv::Mat &eig, unsigned short *maxEigen);
+	unsigned long getSize() const;
+
+private:
+	void computeBand(const cv::Mat &image, int band, int numBands, cv::Mat &eig);
+
+	std::vector<std::vector<unsigned short> > _buf;	// per band, gradient products and box rows
+	std::vector<unsigned short> _max;				// per band
+};
@@ -0,0 +1,37 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+class StereoCameraModel;
+
+//=============================================================================
+// Software Rectification
+//-----------------------------------------------------------------------------
+// CPU version of the FPGA rectification core (dvp/rtl/rect.v) for raw
+// stereo images. The remap tables come from the raw camera model of the
+// calibration files (stereo_calib), and hold one packed source coordinate
+// per pixel in the rect_intp.v format, {ysrc (u9.5), xsrc (u10.5)}.
+// The bilinear interpolation has the same 5-bit weights and rounding as
+// rect_intp.v. The image is split into tiles for the threads.
+//=============================================================================
+class SoftRect
+{
+public:
+	SoftRect();
+	~SoftRect();
+
+	bool init(const StereoCameraModel &model, const cv::Size &size);
+	void compute(const cv::Mat &rawLeft, const cv::Mat &rawRight, cv::Mat &left, cv::Mat &right);
+	unsigned long getSize() const;
+
+private:
+	void remapTile(int lr, const cv::Mat &src, cv::Mat &dst, int tile) const;
+
+	cv::Size _size;
+	std::vector<unsigned int> _map[2];	// packed source coordinates, left and right
+};
@@ -0,0 +1,48 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+struct SPARSE_BM_PARAM {
+	int blockSize;			// SAD window size, odd, up to 31
+	int numDisparities;		// search range [0, numDisparities), multiple of 16
+	int preFilterCap;		// x-Sobel prefilter clipped to [-cap, cap]
+	int textureThreshold;	// min sum of |prefiltered| in the window
+	int uniquenessRatio;	// margin [%] of the best SAD over the others
+	int gridStep;			// disparity grid for the occupancy map [pixel], multiple of 4, 0:none
+};
+
+//=============================================================================
+// Block Matching at Keypoints
+//-----------------------------------------------------------------------------
+// Same matching cost as OpenCV StereoBM (x-Sobel prefilter, SAD, texture
+// and uniqueness checks) evaluated only on the rows of the keypoints,
+// refined to subpixel by a parabola through the neighboring costs.
+// setImages() has to be called once per frame before the others.
+//=============================================================================
+class SparseBM
+{
+public:
+	SparseBM(const SPARSE_BM_PARAM &param);
+	~SparseBM();
+
+	void setImages(const cv::Mat &left, const cv::Mat &right);
+	void match(
+		const std::vector<cv::Point2f> &leftCorners,
+		std::vector<cv::Point2f> &rightCorners,
+		std::vector<unsigned char> &status) const;
+	void computeGrid(cv::Mat &disp) const;
+	unsigned long getSize() const;
+
+private:
+	void prefilter(const cv::Mat &src, cv::Mat &dst, int pad) const;
+	bool matchPoint(int x, int y, float &disparity) const;
+
+	SPARSE_BM_PARAM _param;
+	cv::Mat _left;	// prefiltered left image
+	cv::Mat _right;	// prefiltered right image, numDisparities columns padded on the left
+};
@@ -0,0 +1,48 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+struct SPATIAL_ENTRY {
+	int id;			// node ID
+	float x, y, z;	// node position
+	float variance;	// accumulated odometry variance when the node was added
+};
+
+//=============================================================================
+// Voxel Hash of Node Positions
+//-----------------------------------------------------------------------------
+// The search radius of each node grows with the odometry variance
+// accumulated since the node was added,
+//   radius = radiusBase + radiusScale * sqrt(variance - node.variance)
+//=============================================================================
+class SpatialIndex
+{
+public:
+	SpatialIndex(float voxelSize = 5.0f);
+	~SpatialIndex();
+
+	void insert(int id, float x, float y, float z, float variance);
+	void clear();
+	void radiusSearch(
+		float x, float y, float z,
+		float variance,
+		float radiusBase,
+		float radiusScale,
+		std::vector<int> &ids) const;
+	int size() const { return _numEntries; }
+	unsigned long getSize() const;
+
+private:
+	long long key(int vx, int vy, int vz) const;
+	int voxel(float val) const;
+
+	float _voxelSize;
+	float _minVariance;
+	int _numEntries;
+	std::unordered_map<long long, std::vector<SPATIAL_ENTRY>> _voxels;
+};
@@ -7,6 +7,7 @@
 #include <opencv2/core/core.hpp>
 #include "core/StereoCameraModel.h"
 #include "core/SensorData.h"
+#include "core/SparseBM.h"
 
 std::vector<cv::Point2f> computeCorrespondences(
 	const cv::Mat &leftImage,
@@ -14,6 +15,12 @@ std::vector<cv::Point2f> computeCorrespondences(
 	const std::vector<cv::Point2f> &leftCorners,
 	std::vector<unsigned char> &status);
 
+std::vector<cv::Point2f> computeCorrespondencesEpipolar(
+	const cv::Mat &leftImage,
+	const cv::Mat &rightImage,
+	const std::vector<cv::Point2f> &leftCorners,
+	std::vector<unsigned char> &status);
+
 std::vector<cv::Point3f> generateKeypoints3DStereo(
 	const std::vector<cv::Point2f> &leftCorners,
 	const std::vector<cv::Point2f> &rightCorners,
@@ -25,12 +32,17 @@ std::vector<cv::Point3f> generateKeypoints3DStereo(
 	int depthMethod);
 
 void generateKeypoints3D(
-	SensorData data,
-	StereoCameraModel StereoCameraModel,
-	std::vector<cv::KeyPoint> kpts,
+	const SensorData &data,
+	const StereoCameraModel &StereoCameraModel,
+	const std::vector<cv::KeyPoint> &kpts,
 	std::vector<cv::Point3f> &kpts3d,
 	cv::Mat disp,
-	int depthMethod);
+	int depthMethod,
+	const SparseBM *sparseBM);
+
+int removeKeypointsWithoutDepth(
+	std::vector<cv::KeyPoint> &kpts,
+	std::vector<cv::Point3f> &kpts3d);
 
 cv::Point3f projectDisparityTo3D(
 	const cv::Point2f &pt2d,
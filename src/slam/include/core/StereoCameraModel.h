@@ -33,13 +33,23 @@ public:
 	double cy_r() const { return _P[1].at<double>(1, 2); }
 	double Tx_r() const { return _P[1].at<double>(0, 3); }
 	cv::Mat K_l() const { return _P[0].colRange(0, 3); } // 3x3 camera matrix
-	cv::Mat D_l() const { return cv::Mat::zeros(1, 5, CV_64FC1); }
+	const cv::Mat &D_l() const { static const cv::Mat D = cv::Mat::zeros(1, 5, CV_64FC1); return D; } // rectified, no distortion
+
+	// raw camera model, only in OpenCV style calibration files (stereo_calib)
+	bool hasRawModel() const { return !_rawK[0].empty() && !_rawK[1].empty(); }
+	const cv::Mat & rawK(int lr) const { return _rawK[lr]; }	// 3x3 camera matrix before rectification
+	const cv::Mat & rawD(int lr) const { return _rawD[lr]; }	// distortion coefficients
+	const cv::Mat & rectR(int lr) const { return _rectR[lr]; }	// 3x3 rectification rotation
+	const cv::Mat & P(int lr) const { return _P[lr]; }			// 3x4 projection matrix after rectification
 
 	unsigned long getSize();
 
 private:
 	cv::Size _imageSize;
 	cv::Mat _P[2];
+	cv::Mat _rawK[2];
+	cv::Mat _rawD[2];
+	cv::Mat _rectR[2];
 	Transform _localTransform;
 };
 
@@ -11,6 +11,13 @@
 #include "Eigen/Geometry"
 #include "opencv2/core/core.hpp"
 
+//=============================================================================
+// Rigid Transform
+//-----------------------------------------------------------------------------
+// 3x4 matrix [R|t] held by value in a row-major float[12], so copies and
+// temporaries never touch the heap. toEigen3x4f() maps the storage without
+// a copy.
+//=============================================================================
 class Transform
 {
 public:
@@ -35,24 +42,25 @@ public:
 
 	~Transform();
 
-	float r11() const { return data_.at<float>(0, 0); }
-	float r12() const { return data_.at<float>(0, 1); }
-	float r13() const { return data_.at<float>(0, 2); }
-	float o14() const { return data_.at<float>(0, 3); }
-	float r21() const { return data_.at<float>(1, 0); }
-	float r22() const { return data_.at<float>(1, 1); }
-	float r23() const { return data_.at<float>(1, 2); }
-	float o24() const { return data_.at<float>(1, 3); }
-	float r31() const { return data_.at<float>(2, 0); }
-	float r32() const { return data_.at<float>(2, 1); }
-	float r33() const { return data_.at<float>(2, 2); }
-	float o34() const { return data_.at<float>(2, 3); }
-	float & x() { return data_.at<float>(0, 3); }
-	float & y() { return data_.at<float>(1, 3); }
-	float & z() { return data_.at<float>(2, 3); }
-	const float & x() const { return data_.at<float>(0, 3); }
-	const float & y() const { return data_.at<float>(1, 3); }
-	const float & z() const { return data_.at<float>(2, 3); }
+	float r11() const { return data_[0]; }
+	float r12() const { return data_[1]; }
+	float r13() const { return data_[2]; }
+	float o14() const { return data_[3]; }
+	float r21() const { return data_[4]; }
+	float r22() const { return data_[5]; }
+	float r23() const { return data_[6]; }
+	float o24() const { return data_[7]; }
+	float r31() const { return data_[8]; }
+	float r32() const { return data_[9]; }
+	float r33() const { return data_[10]; }
+	float o34() const { return data_[11]; }
+	float & x() { return data_[3]; }
+	float & y() { return data_[7]; }
+	float & z() { return data_[11]; }
+	const float & x() const { return data_[3]; }
+	const float & y() const { return data_[7]; }
+	const float & z() const { return data_[11]; }
+	const float * data() const { return data_; }
 
 	bool isNull() const;
 	void setNull();
@@ -64,12 +72,19 @@ public:
 	static Transform fromEigen4f(const Eigen::Matrix4f & matrix);
 	static Transform fromEigen3f(const Eigen::Affine3f & matrix);
 	Eigen::Matrix4f toEigen4f() const;
+	Eigen::Map<const Eigen::Matrix<float, 3, 4, Eigen::RowMajor>> toEigen3x4f() const {
+		return Eigen::Map<const Eigen::Matrix<float, 3, 4, Eigen::RowMajor>>(data_);
+	}
+	Eigen::Isometry3d toIsometry3d() const;
 
 	Transform operator*(const Transform & t) const;
 	Transform & operator*=(const Transform & t);
 
-	unsigned long getSize();
+	// dst[i] = R * src[i] + t, src and dst may be the same
+	void transformPoints(const cv::Point3f *src, cv::Point3f *dst, int n) const;
+
+	unsigned long getSize(); // heap memory, none
 
 private:
-	cv::Mat data_;
+	float data_[12];
 };
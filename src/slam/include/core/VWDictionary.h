@@ -6,6 +6,7 @@
 
 #include "core/VisualWord.h"
 #include "core/FlannIndex.h"
+#include "core/Vocabulary.h"
 
 class VWDictionary
 {
@@ -13,16 +14,31 @@ public:
 	VWDictionary();
 	~VWDictionary();
 	std::list<int> addNewWords(const cv::Mat descriptors, int nodeId);
+	std::vector<int> findWords(const cv::Mat &descriptors);
+	bool loadVocabulary(const std::string &path);
+	bool hasVocabulary() const { return _vocabulary->isLoaded(); }
 	const VisualWord* getWord(int id) const;
 	void clear();
 	void getMemoryUsed();
 
+	// dictionary maintenance
+	int removeSingleRefWords(const std::list<int> &wordIds, int nodeId);
+	int limitWords(int maxWords);
+	void compact();
+	int getNumWords() const { return (int)_visualWords.size(); }
+	int getNumRemoved() const { return _removedCount; }
+
 protected:
 	int getNextId();
+	void removeWord(int id);
+	std::list<int> quantizeWords(const cv::Mat &descriptors, int nodeId);
 	std::map<int, VisualWord*> _visualWords; // <id, VisualWord*>
 
 private:
 	int _lastWordId;
 	FlannIndex *_flannIndex;
+	Vocabulary *_vocabulary; // fixed vocabulary trained offline, optional
 	std::map<int, int> _mapIndexId; // <KDTree index, VW ID> of all VWs in the tree
+	std::map<int, int> _mapIdIndex; // <VW ID, KDTree index>
+	int _removedCount; // number of VWs removed so far
 };
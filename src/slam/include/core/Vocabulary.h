@@ -0,0 +1,65 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#pragma once
+
+#include <string>
+
+
+//=============================================================================
+// Vocabulary File Format
+//-----------------------------------------------------------------------------
+// VOCAB_HEADER followed by "numNodes" of VOCAB_NODE in breadth-first order.
+// Node 0 is the root. Children of a node are stored contiguously. Leaf nodes
+// are the visual words, whose IDs are 1 to "numWords".
+// The file is generated by the vocab_train tool.
+//=============================================================================
+#define VOCAB_MAGIC			0x56363955 // "U96V"
+#define VOCAB_VERSION		1
+#define VOCAB_DESC_BYTES	32 // ORB descriptor
+
+struct VOCAB_HEADER {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int descBytes;
+	unsigned int branching;	// max number of children
+	unsigned int depth;		// max depth of the tree
+	unsigned int numNodes;
+	unsigned int numWords;
+	unsigned int reserved;
+};
+
+struct VOCAB_NODE {
+	unsigned char desc[VOCAB_DESC_BYTES]; // cluster center
+	int firstChild;		// index of the first child, 0 for leaf
+	int numChildren;	// 0 for leaf
+	int wordId;			// word ID for leaf, 0 for internal node
+	int reserved;
+};
+
+
+//=============================================================================
+// Read-only Hierarchical Binary Vocabulary
+//-----------------------------------------------------------------------------
+// The file is memory-mapped, nothing is allocated for the tree itself.
+//=============================================================================
+class Vocabulary
+{
+public:
+	Vocabulary();
+	~Vocabulary();
+
+	bool load(const std::string &path);
+	void release();
+	bool isLoaded() const { return _nodes != 0; }
+	int numWords() const { return _header ? (int)_header->numWords : 0; }
+	int quantize(const unsigned char *desc) const;
+	unsigned long getSize() const { return (unsigned long)_dataSize; }
+
+private:
+	void *_data;
+	size_t _dataSize;
+	const VOCAB_HEADER *_header;
+	const VOCAB_NODE *_nodes;
+};
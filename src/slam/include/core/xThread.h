@@ -4,6 +4,12 @@
 //=============================================================================
 #pragma once
 
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
 #ifdef _WIN32
 #include <thread>
 #else
@@ -28,3 +34,52 @@ private:
 #endif
 	
 };
+
+
+//=============================================================================
+// Worker Thread Pool
+//-----------------------------------------------------------------------------
+// parallelFor() runs func(0..n-1) on the worker threads. The calling thread
+// also takes indices, so it returns as soon as all indices are processed and
+// nested calls from a worker never dead-lock. parallelInvoke() runs
+// independent tasks of a task graph stage the same way.
+// A job lives on the stack of its caller and is queued in an intrusive
+// list, so a call makes no heap allocation.
+//=============================================================================
+class xThreadPool
+{
+public:
+	xThreadPool();
+	~xThreadPool();
+
+	int create(int numThreads);
+	void destroy(void);
+	int getNumThreads(void) const { return (int)_th.size(); }
+	void parallelFor(int n, const std::function<void(int)> &func);
+	void parallelInvoke(const std::vector<std::function<void(void)>> &tasks);
+
+private:
+	struct JOB {
+		const std::function<void(int)> *func;
+		int n;
+		std::atomic<int> next;
+		int active; // number of workers running this job
+		bool queued;
+		JOB *prevJob;
+		JOB *nextJob;
+	};
+
+	static void* worker(void *arg);
+	void workerLoop(void);
+	static void runJob(JOB *job);
+	void pushJob(JOB *job);
+	void removeJob(JOB *job);
+
+	std::vector<xThread*> _th;
+	JOB *_jobHead; // queued jobs, oldest first
+	JOB *_jobTail;
+	std::mutex _mutex;
+	std::condition_variable _cvJob;
+	std::condition_variable _cvDone;
+	bool _stop;
+};
@@ -100,6 +100,11 @@ public:
         nnIndex_->addPoints(points, rebuild_threshold);
     }
 
+    void removePoint(size_t point_id)
+    {
+        nnIndex_->removePoint(point_id);
+    }
+
     size_t size() const
     {
         return nnIndex_->size();
@@ -178,7 +178,12 @@ public:
     {
         int maxChecks = searchParams.checks;
         float epsError = 1+searchParams.eps;
-        getNeighbors<false>(result, vec, maxChecks, epsError);
+        if (removed_) {
+            getNeighbors<true>(result, vec, maxChecks, epsError);
+        }
+        else {
+            getNeighbors<false>(result, vec, maxChecks, epsError);
+        }
     }
 
 protected:
@@ -82,6 +82,30 @@ public:
 		return NULL;
     }
 
+    /**
+     * Marks a point as removed. The point is not searched any more and
+     * is discarded from the dataset at the next rebuild.
+     */
+    virtual void removePoint(size_t id)
+    {
+    	if (!removed_) {
+    		ids_.resize(size_);
+    		for (size_t i=0;i<size_;++i) {
+    			ids_[i] = i;
+    		}
+    		removed_points_.resize(size_);
+    		removed_points_.reset();
+    		last_id_ = size_;
+    		removed_ = true;
+    	}
+
+    	size_t point_index = id_to_index(id);
+    	if (point_index!=size_t(-1) && !removed_points_.test(point_index)) {
+    		removed_points_.set(point_index);
+    		removed_count_++;
+    	}
+    }
+
     /**
      * @return number of features in this index.
      */
@@ -143,6 +167,33 @@ protected:
 
     virtual void buildIndexImpl() = 0;
 
+    size_t id_to_index(size_t id) const
+    {
+    	if (ids_.size()==0) {
+    		return id;
+    	}
+    	if (id < ids_.size() && ids_[id]==id) {
+    		return id;
+    	}
+
+    	// ids are kept in increasing order
+    	size_t start = 0;
+    	size_t end = ids_.size();
+    	while (start<end) {
+    		size_t mid = (start+end)/2;
+    		if (ids_[mid]==id) {
+    			return mid;
+    		}
+    		else if (ids_[mid]<id) {
+    			start = mid + 1;
+    		}
+    		else {
+    			end = mid;
+    		}
+    	}
+    	return size_t(-1);
+    }
+
     void indices_to_ids(const size_t* in, size_t* out, size_t size) const
     {
 		if (removed_) {
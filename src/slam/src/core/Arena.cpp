@@ -0,0 +1,111 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/Arena.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+
+namespace {
+
+char *allocBlock(size_t size)
+{
+	char *p = (char*)malloc(size);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+} // namespace
+
+Arena::Arena(size_t blockSize) :
+	_current(0),
+	_offset(0),
+	_blockSize(blockSize)
+{}
+
+Arena::~Arena()
+{
+	for (size_t i = 0; i < _blocks.size(); i++) {
+		free(_blocks[i].data);
+	}
+}
+
+//=============================================================================
+// Bump allocation, a new block is added when the current one is full
+//=============================================================================
+void *Arena::allocate(size_t size, size_t align)
+{
+	while (_current < _blocks.size())
+	{
+		BLOCK &block = _blocks[_current];
+		uintptr_t base = (uintptr_t)block.data;
+		uintptr_t p = (base + _offset + align - 1) & ~(uintptr_t)(align - 1);
+		if (p + size <= base + block.size) {
+			_offset = (size_t)(p - base) + size;
+			return (void*)p;
+		}
+		_current++;
+		_offset = 0;
+	}
+
+	// grow, the new block is at least as large as all previous ones
+	size_t blockSize = _blockSize;
+	for (size_t i = 0; i < _blocks.size(); i++) {
+		blockSize += _blocks[i].size;
+	}
+	if (blockSize < size + align) {
+		blockSize = size + align;
+	}
+	BLOCK block = { allocBlock(blockSize), blockSize };
+	_blocks.push_back(block);
+	_current = _blocks.size() - 1;
+	_offset = 0;
+
+	return allocate(size, align);
+}
+
+//=============================================================================
+// Release all allocations, several blocks are merged into one
+//=============================================================================
+void Arena::reset(void)
+{
+	if (_blocks.size() > 1)
+	{
+		size_t total = capacity();
+		for (size_t i = 0; i < _blocks.size(); i++) {
+			free(_blocks[i].data);
+		}
+		_blocks.resize(1);
+		_blocks[0].data = allocBlock(total);
+		_blocks[0].size = total;
+	}
+	_current = 0;
+	_offset = 0;
+}
+
+size_t Arena::used(void) const
+{
+	size_t size = _offset;
+	for (size_t i = 0; i < _current && i < _blocks.size(); i++) {
+		size += _blocks[i].size;
+	}
+	return size;
+}
+
+size_t Arena::capacity(void) const
+{
+	size_t size = 0;
+	for (size_t i = 0; i < _blocks.size(); i++) {
+		size += _blocks[i].size;
+	}
+	return size;
+}
+
+Arena &Arena::local(void)
+{
+	static thread_local Arena arena;
+	return arena;
+}
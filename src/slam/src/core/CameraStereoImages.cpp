@@ -5,11 +5,14 @@
 #include "core/CameraStereoImages.h"
 #include "core/Perf.h"
 #include "core/Graph.h"
+#include "core/FramePool.h"
 
 #ifndef _WIN32
 #include <unistd.h>
 #endif
 
+extern FramePool framePool;
+
 CameraStereoImages::CameraStereoImages(
 	const std::string pathLeftImages,
 	const std::string pathRightImages
@@ -125,7 +128,7 @@ void CameraStereoImages::captureFile(const char *path, cv::Mat &image, int doRes
 	}
 
 	if (doResize) {
-		cv::Mat imageResize;
+		cv::Mat imageResize = framePool.acquire(480, 640, CV_8UC1);
 		cv::resize(image, imageResize, cv::Size(640, 480));
 		image = imageResize;
 	}
@@ -139,6 +142,12 @@ void CameraStereoImages::captureFromFpga(Fpga *fpga, SensorData &data, APP_SETTI
 	// capture data
 	fpga->receiveData(data, appSetting);
 
+	// IMU samples are stamped by the FPGA timer,
+	// the frame is put on the same clock
+	if (appSetting.useImu) {
+		_captureTime = fpga->frameStamp();
+	}
+
 	// build sensor data
 	data.setStamp(_captureTime);
 	data.setId(this->getNextSeqID());
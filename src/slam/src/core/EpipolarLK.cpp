@@ -0,0 +1,374 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/EpipolarLK.h"
+#include "core/xThread.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+extern xThreadPool threadPool;
+
+#define EPI_LK_CHUNK	64		// keypoints per parallel task
+#define EPI_LK_MARGIN	4.0f	// search range around the estimate of the coarser level [pixel]
+
+// pyramids are kept across frames, level 0 is not copied
+static std::vector<cv::Mat> epiPyrLeft;
+static std::vector<cv::Mat> epiPyrRight;
+
+// per-task work buffers
+struct EPI_LK_WORK {
+	std::vector<float> tmpl;	// template, H x Wp
+	std::vector<float> grad;	// x-gradient of the template, H x Wp
+	std::vector<float> mask;	// 1 inside the window, 0 for padding, Wp
+	std::vector<float> strip;	// rows of the right image covering the search range
+	std::vector<float> column;	// vertically interpolated rows
+	std::vector<float> row;		// horizontally interpolated row
+};
+
+//=============================================================================
+// x-only Pyramid
+//=============================================================================
+// dst(x) = (src(2x-1) + 2 * src(2x) + src(2x+1)) / 4, border replicated
+static void pyrDownX(const cv::Mat &src, cv::Mat &dst)
+{
+	int sw = src.cols;
+	int dw = (sw + 1) / 2;
+	dst.create(src.rows, dw, CV_8UC1);
+
+	for (int y = 0; y < src.rows; y++) {
+		const unsigned char *s = src.ptr(y);
+		unsigned char *d = dst.ptr(y);
+
+		d[0] = (unsigned char)((3 * s[0] + s[std::min(1, sw - 1)] + 2) >> 2);
+		int x = 1;
+
+#if CV_SIMD128
+		v_uint16x8 v2 = v_setall_u16(2);
+		for (; (x + 16 <= dw) && (2 * x + 31 < sw); x += 16) {
+			v_uint8x16 e, o, m, dummy;
+			v_load_deinterleave(s + 2 * x, e, o);
+			v_load_deinterleave(s + 2 * x - 1, m, dummy);
+
+			v_uint16x8 e0, e1, o0, o1, m0, m1;
+			v_expand(e, e0, e1);
+			v_expand(o, o0, o1);
+			v_expand(m, m0, m1);
+
+			v_uint16x8 r0 = (m0 + e0 + e0 + o0 + v2) >> 2;
+			v_uint16x8 r1 = (m1 + e1 + e1 + o1 + v2) >> 2;
+			v_store(d + x, v_pack(r0, r1));
+		}
+#endif
+
+		for (; x < dw; x++) {
+			int c = std::min(2 * x, sw - 1);
+			int r = std::min(2 * x + 1, sw - 1);
+			d[x] = (unsigned char)((s[2 * x - 1] + 2 * s[c] + s[r] + 2) >> 2);
+		}
+	}
+}
+
+static void buildPyramidX(const cv::Mat &img, int maxLevel, std::vector<cv::Mat> &pyr)
+{
+	pyr.resize(maxLevel + 1);
+	pyr[0] = img;
+	for (int level = 1; level <= maxLevel; level++) {
+		pyrDownX(pyr[level - 1], pyr[level]);
+	}
+}
+
+//=============================================================================
+// Window Sampling
+//=============================================================================
+// rows [iy, iy + H) interpolated by b, columns [x0, x0 + n) clamped to the image
+static void sampleRows(
+	const cv::Mat &img,
+	int iy,
+	float b,
+	int H,
+	int x0,
+	int n,
+	float *dst,
+	int dstStep)
+{
+	int cols = img.cols;
+	for (int r = 0; r < H; r++) {
+		const unsigned char *p0 = img.ptr(iy + r);
+		const unsigned char *p1 = img.ptr(std::min(iy + r + 1, img.rows - 1));
+		float *d = dst + r * dstStep;
+		for (int j = 0; j < n; j++) {
+			int x = std::min(std::max(x0 + j, 0), cols - 1);
+			d[j] = p0[x] + (p1[x] - p0[x]) * b;
+		}
+	}
+}
+
+// template at window start ws, returns the sum of squared gradients
+static float buildTemplate(
+	const cv::Mat &img,
+	int iy,
+	float b,
+	float ws,
+	int W,
+	int H,
+	int Wp,
+	EPI_LK_WORK &w)
+{
+	int ix = cvFloor(ws);
+	float a = ws - ix;
+
+	// columns [ix - 1, ix + W + 1] for the template and its gradient
+	int n = W + 3;
+	w.column.resize(H * n);
+	w.row.resize(W + 2);
+	sampleRows(img, iy, b, H, ix - 1, n, &w.column[0], n);
+
+	float A = 0.0f;
+	for (int r = 0; r < H; r++) {
+		const float *c = &w.column[r * n];
+		float *t = &w.tmpl[r * Wp];
+		float *g = &w.grad[r * Wp];
+
+		// te(k) = I(ws + k - 1), k = 0..W+1
+		float *te = &w.row[0];
+		for (int k = 0; k < W + 2; k++) {
+			te[k] = c[k] + (c[k + 1] - c[k]) * a;
+		}
+		for (int k = 0; k < W; k++) {
+			t[k] = te[k + 1];
+			g[k] = (te[k + 2] - te[k]) * 0.5f;
+			A += g[k] * g[k];
+		}
+		for (int k = W; k < Wp; k++) {
+			t[k] = 0.0f;
+			g[k] = 0.0f;
+		}
+	}
+
+	return A;
+}
+
+// sum of e*g and e*e, e = J(ws + k) - T(k), ws relative to the strip
+static void accumulate(
+	const EPI_LK_WORK &w,
+	int H,
+	int Wp,
+	int stripW,
+	float ws,
+	float &sumEG,
+	float &sumEE)
+{
+	int j0 = cvFloor(ws);
+	float a = ws - j0;
+
+#if CV_SIMD128
+	v_float32x4 va = v_setall_f32(a);
+	v_float32x4 vEG = v_setzero_f32();
+	v_float32x4 vEE = v_setzero_f32();
+	for (int r = 0; r < H; r++) {
+		const float *S = &w.strip[r * stripW + j0];
+		const float *T = &w.tmpl[r * Wp];
+		const float *G = &w.grad[r * Wp];
+		for (int k = 0; k < Wp; k += 4) {
+			v_float32x4 s0 = v_load(S + k);
+			v_float32x4 s1 = v_load(S + k + 1);
+			v_float32x4 e = (v_muladd(s1 - s0, va, s0) - v_load(T + k)) * v_load(&w.mask[k]);
+			vEG = v_muladd(e, v_load(G + k), vEG);
+			vEE = v_muladd(e, e, vEE);
+		}
+	}
+	sumEG = v_reduce_sum(vEG);
+	sumEE = v_reduce_sum(vEE);
+#else
+	sumEG = 0.0f;
+	sumEE = 0.0f;
+	for (int r = 0; r < H; r++) {
+		const float *S = &w.strip[r * stripW + j0];
+		const float *T = &w.tmpl[r * Wp];
+		const float *G = &w.grad[r * Wp];
+		for (int k = 0; k < Wp; k++) {
+			float e = (S[k] + (S[k + 1] - S[k]) * a - T[k]) * w.mask[k];
+			sumEG += e * G[k];
+			sumEE += e * e;
+		}
+	}
+#endif
+}
+
+//=============================================================================
+// Track a Keypoint
+//=============================================================================
+static bool trackPoint(
+	const cv::Point2f &pt,
+	int maxLevel,
+	const EPIPOLAR_LK_PARAM &param,
+	EPI_LK_WORK &w,
+	float &disparity,
+	float &error)
+{
+	int W = param.winWidth;
+	int H = param.winHeight;
+	int Wp = (W + 3) & ~3;
+	float hw = (W - 1) * 0.5f;
+	float hh = (H - 1) * 0.5f;
+
+	// rows of the window, the same at every level
+	float fy = pt.y - hh;
+	int iy = cvFloor(fy);
+	float b = fy - iy;
+	if ((iy < 0) || (iy + H > epiPyrLeft[0].rows)) {
+		return false;
+	}
+
+	float eps2 = param.epsilon * param.epsilon;
+	float d = 0.0f;
+	float sumEG, sumEE;
+	int sx0 = 0;
+	int stripW = 0;
+
+	for (int level = maxLevel; level >= 0; level--) {
+		const cv::Mat &I = epiPyrLeft[level];
+		const cv::Mat &J = epiPyrRight[level];
+		float scale = 1.0f / (1 << level);
+		float xl = pt.x * scale;
+
+		// disparity range at this level
+		float lo = param.minDisparity * scale;
+		float hi = param.maxDisparity * scale;
+		if (level != maxLevel) {
+			d *= 2.0f;
+			lo = std::max(lo, d - EPI_LK_MARGIN);
+			hi = std::min(hi, d + EPI_LK_MARGIN);
+		}
+
+		// the correspondence has to be inside the right image
+		hi = std::min(hi, xl);
+		if (lo > hi) {
+			return false;
+		}
+
+		float A = buildTemplate(I, iy, b, xl - hw, W, H, Wp, w);
+
+		// right image rows covering window starts in [xl - hi - hw, xl - lo - hw]
+		sx0 = cvFloor(xl - hi - hw) - 1;
+		stripW = cvFloor(xl - lo - hw) - sx0 + Wp + 2;
+		w.strip.resize(H * stripW);
+		sampleRows(J, iy, b, H, sx0, stripW, &w.strip[0], stripW);
+
+		// exhaustive search at the coarsest level
+		if (level == maxLevel) {
+			int d0 = (int)ceilf(lo);
+			int d1 = (int)floorf(hi);
+			float best = FLT_MAX;
+			d = lo;
+			for (int di = d0; di <= d1; di++) {
+				accumulate(w, H, Wp, stripW, xl - di - hw - sx0, sumEG, sumEE);
+				if (sumEE < best) {
+					best = sumEE;
+					d = (float)di;
+				}
+			}
+		}
+
+		// not enough texture
+		if (A / (W * H) / 1024.0f < param.minEigThreshold || A < FLT_EPSILON) {
+			if (level == 0) {
+				return false;
+			}
+			continue;
+		}
+
+		float invA = 1.0f / A;
+		float prevDelta = 0.0f;
+		for (int j = 0; j < param.iterations; j++) {
+			accumulate(w, H, Wp, stripW, xl - d - hw - sx0, sumEG, sumEE);
+
+			// xr += -sumEG / A
+			float delta = sumEG * invA;
+			d += delta;
+
+			// bounded search, hitting the bound of the final level is a failure
+			if ((d < lo) || (d > hi)) {
+				if (level == 0) {
+					return false;
+				}
+				d = std::min(std::max(d, lo), hi);
+				break;
+			}
+
+			if (delta * delta <= eps2) {
+				break;
+			}
+
+			if (j > 0 && fabsf(delta + prevDelta) < 0.01f) {
+				d -= delta * 0.5f;
+				break;
+			}
+			prevDelta = delta;
+		}
+	}
+
+	// RMS residual at the final position
+	accumulate(w, H, Wp, stripW, pt.x - d - hw - sx0, sumEG, sumEE);
+	error = sqrtf(sumEE / (W * H));
+
+	disparity = d;
+	return true;
+}
+
+//=============================================================================
+// Epipolar LK
+//=============================================================================
+void calcEpipolarLK(
+	const cv::Mat &leftImage,
+	const cv::Mat &rightImage,
+	const std::vector<cv::Point2f> &leftCorners,
+	std::vector<cv::Point2f> &rightCorners,
+	std::vector<unsigned char> &status,
+	const EPIPOLAR_LK_PARAM &param)
+{
+	int npoints = (int)leftCorners.size();
+	rightCorners.resize(npoints);
+	status.resize(npoints);
+	if (npoints == 0) {
+		return;
+	}
+
+	// coarser levels than the window are useless
+	int maxLevel = param.maxLevel;
+	while ((maxLevel > 0) && ((leftImage.cols >> maxLevel) < param.winWidth)) {
+		maxLevel--;
+	}
+
+	buildPyramidX(leftImage, maxLevel, epiPyrLeft);
+	buildPyramidX(rightImage, maxLevel, epiPyrRight);
+
+	int nchunks = (npoints + EPI_LK_CHUNK - 1) / EPI_LK_CHUNK;
+	threadPool.parallelFor(nchunks, [&](int c) {
+		int Wp = (param.winWidth + 3) & ~3;
+		EPI_LK_WORK w;
+		w.tmpl.resize(param.winHeight * Wp);
+		w.grad.resize(param.winHeight * Wp);
+		w.mask.resize(Wp);
+		for (int k = 0; k < Wp; k++) {
+			w.mask[k] = (k < param.winWidth) ? 1.0f : 0.0f;
+		}
+
+		int end = std::min(npoints, (c + 1) * EPI_LK_CHUNK);
+		for (int i = c * EPI_LK_CHUNK; i < end; i++) {
+			const cv::Point2f &pt = leftCorners[i];
+			float disparity = 0.0f;
+			float error = 0.0f;
+			bool valid = trackPoint(pt, maxLevel, param, w, disparity, error);
+
+			rightCorners[i] = cv::Point2f(pt.x - disparity, pt.y);
+			status[i] = valid &&
+				(disparity > param.minDisparity) &&
+				(disparity <= param.maxDisparity) &&
+				((param.maxError <= 0.0f) || (error <= param.maxError));
+		}
+	});
+}
@@ -4,6 +4,7 @@
 //=============================================================================
 #include "core/FPGA.h"
 #include "core/Perf.h"
+#include "core/FramePool.h"
 
 #ifndef _WIN32
 #include <stdio.h>
@@ -15,9 +16,19 @@
 #endif
 
 extern Perf perf;
+extern FramePool framePool;
+
+// LSM9DS1 full scales set by the remote app (500dps, +/-4g)
+#define IMU_GYRO_SCALE	(0.0175f * 3.14159265f / 180.0f)	// [rad/s/LSB]
+#define IMU_ACCEL_SCALE	(0.000122f * 9.80665f)				// [m/s^2/LSB]
 
 Fpga::Fpga(void)
 {
+	iomap_imu = NULL;
+	_imuReadCount = 0;
+	_frameTimer = 0;
+	_timerLast = 0;
+	_timerSec = 0.0;
 }
 
 Fpga::~Fpga(void)
@@ -134,6 +145,22 @@ int Fpga::memoryOpen (void)
 		LOG_WARN("failed to mmap for GFTT\n");
     	exit(1);
 	}
+
+	//==================================================================
+	// open the physical memory device
+	fd_mem_imu = open("/dev/mem", O_RDWR);
+	if (fd_mem_imu <= 0) {
+		LOG_WARN("failed to open /dev/mem for IMU\n");
+		exit(1);
+	}
+
+	unsigned long from_imu = BUF_IMU;
+	unsigned long num_imu = IMU_MAX_SIZE;
+	iomap_imu = (volatile struct IMU_RING*)mmap(0, num_imu, PROT_READ|PROT_WRITE, MAP_SHARED, fd_mem_imu, from_imu);
+	if (iomap_imu == MAP_FAILED){
+		LOG_WARN("failed to mmap for IMU\n");
+    	exit(1);
+	}
 #endif
 	return 0;
 }
@@ -156,6 +183,11 @@ int Fpga::memoryClose (void)
 	unsigned long num_gftt = GFTT_MAX_SIZE * 2;
 	munmap ((void*)iomap_gftt, num_gftt);
 	close (fd_mem_gftt);
+
+	unsigned long num_imu = IMU_MAX_SIZE;
+	munmap ((void*)iomap_imu, num_imu);
+	close (fd_mem_imu);
+	iomap_imu = NULL;
 #endif
 	return 0;
 }
@@ -256,12 +288,14 @@ void Fpga::receiveRectImages(int bank, cv::Mat &matLeft, cv::Mat &matRight)
 		src_left += RECT_MAX_SIZE;
 	}
 	cv::Mat leftRaw = cv::Mat(IMAGE_HEIGHT, IMAGE_WIDTH, CV_8UC1, src_left);
-	cv::Mat left = leftRaw.clone();
+	cv::Mat left = framePool.acquire(IMAGE_HEIGHT, IMAGE_WIDTH, CV_8UC1);
+	leftRaw.copyTo(left);
 
 	// right
 	unsigned char *src_right = src_left + RECT_FRAME_OFFSET;
 	cv::Mat rightRaw = cv::Mat(IMAGE_HEIGHT, IMAGE_WIDTH, CV_8UC1, src_right);
-	cv::Mat right = rightRaw.clone();
+	cv::Mat right = framePool.acquire(IMAGE_HEIGHT, IMAGE_WIDTH, CV_8UC1);
+	rightRaw.copyTo(right);
 
 	matLeft = left;
 	matRight = right;
@@ -274,7 +308,8 @@ void Fpga::receiveDepthMap(int bank, cv::Mat &matDepth)
 		src_disp += (DISP_MAX_SIZE / sizeof(*src_disp));
 	}
 	cv::Mat depthRaw = cv::Mat(IMAGE_HEIGHT, IMAGE_WIDTH, CV_16SC1, src_disp);
-	cv::Mat depth = depthRaw.clone();
+	cv::Mat depth = framePool.acquire(IMAGE_HEIGHT, IMAGE_WIDTH, CV_16SC1);
+	depthRaw.copyTo(depth);
 	matDepth = depth;
 }
 
@@ -285,7 +320,8 @@ void Fpga::receiveEigen(int bank, cv::Mat &matEigen, unsigned short *maxEigen)
 		src_gftt += (GFTT_MAX_SIZE / sizeof(*src_gftt));
 	}
 	cv::Mat eigRaw = cv::Mat(IMAGE_HEIGHT, IMAGE_WIDTH, CV_16UC1, src_gftt);
-	cv::Mat eig = eigRaw.clone();
+	cv::Mat eig = framePool.acquire(IMAGE_HEIGHT, IMAGE_WIDTH, CV_16UC1);
+	eigRaw.copyTo(eig);
 	matEigen = eig;
 
 	unsigned int max = reg->gftt.Max;
@@ -312,6 +348,7 @@ void Fpga::receiveData(SensorData &data, APP_SETTING appSetting)
 	// wait for data ready
 	waitIpcMessage_Perf(IPC_MSG2_DATA_READY);
 	int activeBank = reg->com.IpcParameter2;
+	_frameTimer = reg->com.IpcParameter3;
 
 	// rectified stereo images
 	if (appSetting.inputType == INPUT_TYPE_SENSOR)
@@ -384,3 +421,58 @@ unsigned int Fpga::readTimer(void) {
 	return 0;
 }
 
+//=============================================================================
+//! FPGA Timer to Seconds
+//-----------------------------------------------------------------------------
+//! @return time in seconds since the first conversion
+//-----------------------------------------------------------------------------
+//! The 32-bit [us] timer wraps every 71 minutes. Timers are converted
+//! relative to the newest one seen, so frame and IMU stamps that arrive
+//! slightly out of order stay on one clock.
+//=============================================================================
+double Fpga::timerToSec(unsigned int timer) {
+	int diff = (int)(timer - _timerLast);
+	double sec = _timerSec + diff * 1e-6;
+	if (diff > 0) {
+		_timerLast = timer;
+		_timerSec = sec;
+	}
+	return sec;
+}
+
+//=============================================================================
+//! FPGA Receive IMU Samples
+//-----------------------------------------------------------------------------
+//! @param imu		New samples are pushed here
+//-----------------------------------------------------------------------------
+//! @return number of samples received, -1 if the remote app found no IMU
+//-----------------------------------------------------------------------------
+//! Samples overwritten in the ring before being read are lost, the gap is
+//! detected by the integration.
+//=============================================================================
+int Fpga::receiveImu(Imu &imu) {
+	if ((iomap_imu == NULL) || (iomap_imu->Magic != IMU_RING_MAGIC)) {
+		return -1;
+	}
+
+	unsigned int writeCount = iomap_imu->WriteCount;
+	if (writeCount - _imuReadCount > IMU_RING_SIZE) {
+		_imuReadCount = writeCount - IMU_RING_SIZE;
+	}
+
+	int num = 0;
+	for (; _imuReadCount != writeCount; _imuReadCount++) {
+		volatile struct IMU_RAW_SAMPLE *raw = &iomap_imu->Sample[_imuReadCount % IMU_RING_SIZE];
+		IMU_SAMPLE sample;
+		sample.stamp = timerToSec(raw->Timer);
+		for (int i = 0; i < 3; i++) {
+			sample.gyro[i] = raw->Gyro[i] * IMU_GYRO_SCALE;
+			sample.accel[i] = raw->Accel[i] * IMU_ACCEL_SCALE;
+		}
+		imu.push(sample);
+		num++;
+	}
+
+	return num;
+}
+
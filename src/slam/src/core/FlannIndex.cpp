@@ -28,6 +28,7 @@ void FlannIndex::release()
 
 	nextIndex_ = 0;
 	addedDescriptors_.clear();
+	removedDescriptors_.clear();
 }
 
 unsigned int FlannIndex::indexedFeatures()
@@ -79,11 +80,54 @@ std::vector<unsigned int> FlannIndex::addPoints(const cv::Mat & features)
 	return indexes;
 }
 
+// The point is excluded from the search immediately. Its descriptor is
+// still referred by the KD-tree until the index is rebuilt by compact().
+void FlannIndex::removePoint(unsigned int index)
+{
+	auto itr = addedDescriptors_.find(index);
+	if (!index_ || (itr == addedDescriptors_.end())) {
+		return;
+	}
+
+	((flann::Index<flann::L1<float>>*)index_)->removePoint(index);
+	removedDescriptors_.insert(*itr);
+	addedDescriptors_.erase(itr);
+}
+
+unsigned int FlannIndex::removedFeatures()
+{
+	if (!index_) {
+		return 0;
+	}
+	return (unsigned int)((const flann::Index<flann::L1<float>>*)index_)->removedCount();
+}
+
+// rebuild the KD-tree without the removed points
+void FlannIndex::compact()
+{
+	if (!index_ || removedDescriptors_.empty()) {
+		return;
+	}
+
+	if (addedDescriptors_.empty()) {
+		// nothing left
+		this->release();
+		return;
+	}
+
+	((flann::Index<flann::L1<float>>*)index_)->buildIndex();
+	removedDescriptors_.clear();
+}
+
 void FlannIndex::knnSearch(const cv::Mat &query, cv::Mat &indices, cv::Mat &dists, int knn, int checks)
 {
 	indices.create(query.rows, knn, sizeof(size_t) == 8 ? CV_64F : CV_32S);
 	dists.create(query.rows, knn, featuresType_ == CV_8UC1 ? CV_32S : CV_32F);
 
+	// less than knn points may be found after points are removed,
+	// unfilled indices are left invalid
+	memset(indices.data, 0xFF, indices.total() * indices.elemSize());
+
 	flann::Matrix<size_t> indicesF((size_t*)indices.data, indices.rows, indices.cols);
 	flann::SearchParams params = flann::SearchParams(checks);
 	flann::Matrix<float> distsF((float*)dists.data, dists.rows, dists.cols);
@@ -106,9 +150,9 @@ unsigned long FlannIndex::getSize()
 
 	unsigned long memUsed = (unsigned long)(
 		sizeof(FlannIndex) +
-		nextIndex_ * featureSize_ +
-		sizeof(std::map<int, cv::Mat>) +
-		addedDescriptors_.size() * (12 + sizeof(int) + sizeofDescriptor));
+		(indexedFeatures() + removedFeatures()) * featureSize_ +
+		sizeof(std::map<int, cv::Mat>) * 2 +
+		(addedDescriptors_.size() + removedDescriptors_.size()) * (12 + sizeof(int) + sizeofDescriptor));
 
 	return memUsed;
 }
@@ -0,0 +1,61 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/FramePool.h"
+
+FramePool::FramePool()
+{}
+
+FramePool::~FramePool()
+{}
+
+// only the pool refers to the slab
+bool FramePool::isFree(const cv::Mat &slab)
+{
+	return slab.u && (CV_XADD(&slab.u->refcount, 0) == 1);
+}
+
+//=============================================================================
+// A slab nobody else refers to, the contents are undefined
+//=============================================================================
+cv::Mat FramePool::acquire(int rows, int cols, int type)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	int num = 0;
+	for (size_t i = 0; i < _slabs.size(); i++)
+	{
+		const cv::Mat &slab = _slabs[i];
+		if ((slab.rows == rows) && (slab.cols == cols) && (slab.type() == type)) {
+			if (isFree(slab)) {
+				return slab;
+			}
+			num++;
+		}
+	}
+
+	cv::Mat slab(rows, cols, type);
+	if (num < FRAME_POOL_MAX_SLABS) {
+		_slabs.push_back(slab);
+	}
+
+	return slab;
+}
+
+// the slabs in use are released by their last user
+void FramePool::clear(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_slabs.clear();
+}
+
+unsigned long FramePool::getSize() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	unsigned long size = sizeof(FramePool) + _slabs.capacity() * sizeof(cv::Mat);
+	for (size_t i = 0; i < _slabs.size(); i++) {
+		size += (unsigned long)(_slabs[i].total() * _slabs[i].elemSize());
+	}
+	return size;
+}
@@ -5,6 +5,8 @@
 #include "core/GFTT.h"
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <cmath>
 
 using namespace cv;
 
@@ -28,15 +30,69 @@ void generateKeypoints(cv::Mat &img, std::vector<cv::KeyPoint> &kpts2d) {
 //=================================================================
 // GFTT detector with FPGA acceleration
 //=================================================================
-struct greaterThanPtr :
-	public std::binary_function<const unsigned short *, const unsigned short *, bool>
+// Corner candidates are packed as (y << 16 | x), i.e. in raster order,
+// so that the tie-break of the original pointer comparison (higher
+// address first) is a plain descending key order.
+#define GFTT_CELL_CAPACITY	4
+
+struct GFTT_CELL {
+	int count;
+	short x[GFTT_CELL_CAPACITY];
+	short y[GFTT_CELL_CAPACITY];
+};
+
+// work buffers are kept across frames to avoid per-frame allocation
+static thread_local std::vector<unsigned int> gfttKeys;
+static thread_local std::vector<unsigned short> gfttVals;
+static thread_local std::vector<unsigned int> gfttOrder;
+static thread_local std::vector<unsigned int> gfttBucket;
+static thread_local std::vector<GFTT_CELL> gfttGrid;
+
+//=================================================================
+// Threshold and compact
+//=================================================================
+static size_t thresholdCompact(
+	cv::Mat &eig,
+	unsigned short thr,
+	unsigned int *keys,
+	unsigned short *vals)
 {
-	bool operator () (const unsigned short * a, const unsigned short * b) const
-		// Ensure a fully deterministic result of the sort
-	{
-		return (*a > *b) ? true : (*a < *b) ? false : (a > b);
+	size_t total = 0;
+	int xend = eig.cols - 1;
+
+#if CV_SIMD128
+	v_uint16x8 vthr = v_setall_u16(thr);
+#endif
+
+	for (int y = 1; y < eig.rows - 1; y++) {
+		const unsigned short* eig_data = (const unsigned short*)eig.ptr(y);
+		unsigned int key = (unsigned int)y << 16;
+		int x = 1;
+
+#if CV_SIMD128
+		for (; x <= xend - 8; x += 8) {
+			int mask = v_signmask(v_load(eig_data + x) >= vthr);
+			for (int i = 0; mask != 0; i++, mask >>= 1) {
+				if (mask & 1) {
+					keys[total] = key | (x + i);
+					vals[total] = eig_data[x + i];
+					total++;
+				}
+			}
+		}
+#endif
+
+		for (; x < xend; x++) {
+			if (eig_data[x] >= thr) {
+				keys[total] = key | x;
+				vals[total] = eig_data[x];
+				total++;
+			}
+		}
 	}
-};
+
+	return total;
+}
 
 void generateKeypoints2(
 	cv::Mat &eig,
@@ -51,120 +107,154 @@ void generateKeypoints2(
 	double minDistance = 7.0;
 	int blockSize = 3;
 
+	kpts2d.clear();
+	if (eig.rows < 3 || eig.cols < 3) {
+		return;
+	}
+
 	//=================================================================
 	// Thresholding
 	//=================================================================
+	// eigen values are integers, so (val >= thr) is (val >= ceil(thr))
 	double thr = max * qualityLevel;
+	unsigned short ithr = (unsigned short)std::ceil(thr);
 
-	std::vector<unsigned short*> tmpCorners;
-	for (int y = 1; y < eig.rows - 1; y++) {
-		unsigned short* eig_data = (unsigned short*)eig.ptr(y);
-		for (int x = 1; x < eig.cols - 1; x++) {
-			float val = eig_data[x];
-			if (val >= thr) {
-				tmpCorners.push_back(eig_data + x);
-			}
-		}
+	size_t capacity = (size_t)(eig.rows - 2) * (eig.cols - 2);
+	if (gfttKeys.size() < capacity) {
+		gfttKeys.resize(capacity);
+		gfttVals.resize(capacity);
+		gfttOrder.resize(capacity);
+		gfttBucket.resize(capacity);
 	}
+	unsigned int *keys = gfttKeys.data();
+	unsigned short *vals = gfttVals.data();
 
-	size_t total = tmpCorners.size();
+	size_t total = thresholdCompact(eig, ithr, keys, vals);
+
+	//=================================================================
+	// Selection
+	//=================================================================
+	// Radix selection in descending order: candidates are bucketed by the
+	// upper byte of the value here, and each bucket is sorted by the lower
+	// byte only when the suppression below reaches it. Both passes are
+	// stable and fed in descending key order, which reproduces the order
+	// of a full sort with greaterThanPtr.
+	unsigned int *order = gfttOrder.data();
+	unsigned int *bucket = gfttBucket.data();
+
+	int start[257];
+	int hist[256] = { 0 };
+	for (size_t i = 0; i < total; i++) {
+		hist[vals[i] >> 8]++;
+	}
+	start[0] = 0;
+	for (int b = 0; b < 256; b++) {
+		start[b + 1] = start[b] + hist[255 - b];
+	}
 
-	// sort in descending order
-	std::sort(tmpCorners.begin(), tmpCorners.end(), greaterThanPtr());
+	int pos[256];
+	for (int b = 0; b < 256; b++) {
+		pos[b] = start[255 - b];
+	}
+	for (size_t i = total; i-- > 0;) {
+		order[pos[vals[i] >> 8]++] = (unsigned int)i;
+	}
 
 	//=================================================================
 	// Trim Neighbor
 	//=================================================================
-	size_t ncorners = 0;
-	std::vector<cv::Point2f> corners;
-	if (minDistance >= 1) {
-		// Partition the image into larger grids
-		int w = eig.cols;
-		int h = eig.rows;
-
-		const int cell_size = cvRound(minDistance);
-		const int grid_width = (w + cell_size - 1) / cell_size;
-		const int grid_height = (h + cell_size - 1) / cell_size;
-
-		std::vector<std::vector<cv::Point2f> > grid(grid_width*grid_height);
-
-		minDistance *= minDistance;
-
-		for (size_t i = 0; i < total; i++) {
-			int ofs = (int)((const uchar*)tmpCorners[i] - eig.ptr());
-			int y = (int)(ofs / eig.step);
-			int x = (int)((ofs - y*eig.step) / sizeof(unsigned short));
-
-			bool good = true;
-
-			int x_cell = x / cell_size;
-			int y_cell = y / cell_size;
-
-			int x1 = x_cell - 1;
-			int y1 = y_cell - 1;
-			int x2 = x_cell + 1;
-			int y2 = y_cell + 1;
-
-			// boundary check
-			x1 = std::max(0, x1);
-			y1 = std::max(0, y1);
-			x2 = std::min(grid_width - 1, x2);
-			y2 = std::min(grid_height - 1, y2);
-
-			for (int yy = y1; yy <= y2; yy++) {
-				for (int xx = x1; xx <= x2; xx++) {
-					std::vector <cv::Point2f> &m = grid[yy*grid_width + xx];
-					if (m.size()) {
-						for (size_t j = 0; j < m.size(); j++) {
-							float dx = x - m[j].x;
-							float dy = y - m[j].y;
-							if (dx*dx + dy*dy < minDistance) {
+	int w = eig.cols;
+	int h = eig.rows;
+
+	// a 7x7 cell holds at most two corners 7 pixels apart
+	const int cell_size = cvRound(minDistance);
+	const int grid_width = (w + cell_size - 1) / cell_size;
+	const int grid_height = (h + cell_size - 1) / cell_size;
+	const double minDist2 = minDistance * minDistance;
+
+	bool trim = (minDistance >= 1);
+	if (trim) {
+		GFTT_CELL empty = { 0 };
+		gfttGrid.assign(grid_width * grid_height, empty);
+	}
+	GFTT_CELL *grid = gfttGrid.data();
+
+	kpts2d.reserve(nfeatures);
+
+	for (int b = 0; b < 256; b++) {
+		int first = start[b];
+		int last = start[b + 1];
+		if (first == last) {
+			continue;
+		}
+
+		// sort the bucket by the lower byte
+		int lhist[256] = { 0 };
+		for (int i = first; i < last; i++) {
+			lhist[vals[order[i]] & 0xFF]++;
+		}
+		int lpos[256];
+		lpos[255] = first;
+		for (int l = 254; l >= 0; l--) {
+			lpos[l] = lpos[l + 1] + lhist[l + 1];
+		}
+		for (int i = first; i < last; i++) {
+			unsigned int idx = order[i];
+			bucket[lpos[vals[idx] & 0xFF]++] = idx;
+		}
+
+		for (int i = first; i < last; i++) {
+			unsigned int key = keys[bucket[i]];
+			int x = key & 0xFFFF;
+			int y = key >> 16;
+
+			if (trim) {
+				int x_cell = x / cell_size;
+				int y_cell = y / cell_size;
+
+				// boundary check
+				int x1 = std::max(0, x_cell - 1);
+				int y1 = std::max(0, y_cell - 1);
+				int x2 = std::min(grid_width - 1, x_cell + 1);
+				int y2 = std::min(grid_height - 1, y_cell + 1);
+
+				bool good = true;
+				for (int yy = y1; yy <= y2 && good; yy++) {
+					for (int xx = x1; xx <= x2; xx++) {
+						const GFTT_CELL &m = grid[yy*grid_width + xx];
+						for (int j = 0; j < m.count; j++) {
+							int dx = x - m.x[j];
+							int dy = y - m.y[j];
+							if (dx*dx + dy*dy < minDist2) {
 								good = false;
-								goto break_out;
+								break;
 							}
 						}
+						if (!good) {
+							break;
+						}
 					}
 				}
-			}
 
-			break_out:
-
-			if (good) {
-				grid[y_cell*grid_width + x_cell].push_back(cv::Point2f((float)x, (float)y));
-
-				corners.push_back(cv::Point2f((float)x, (float)y));
-				++ncorners;
+				if (!good) {
+					continue;
+				}
 
-				if (nfeatures > 0 && (int)ncorners == nfeatures) {
-					break;
+				GFTT_CELL &c = grid[y_cell*grid_width + x_cell];
+				if (c.count < GFTT_CELL_CAPACITY) {
+					c.x[c.count] = (short)x;
+					c.y[c.count] = (short)y;
+					c.count++;
 				}
 			}
-		}
-	}
-	else {
-		// no trimming
-		for (size_t i = 0; i < total; i++) {
-			int ofs = (int)((const uchar*)tmpCorners[i] - eig.ptr());
-			int y = (int)(ofs / eig.step);
-			int x = (int)((ofs - y*eig.step) / sizeof(unsigned short));
-
-			corners.push_back(cv::Point2f((float)x, (float)y));
-			++ncorners;
-			if (nfeatures > 0 && (int)ncorners == nfeatures) {
-				break;
+
+			kpts2d.push_back(cv::KeyPoint(cv::Point2f((float)x, (float)y), (float)blockSize));
+
+			if (nfeatures > 0 && (int)kpts2d.size() == nfeatures) {
+				return;
 			}
 		}
 	}
 
-	//=================================================================
-	// Keypoint Conversion
-	//=================================================================
-	kpts2d.resize(corners.size());
-	std::vector<cv::Point2f>::const_iterator corner_it = corners.begin();
-	std::vector<cv::KeyPoint>::iterator keypoint_it = kpts2d.begin();
-	for (; corner_it != corners.end(); ++corner_it, ++keypoint_it) {
-		*keypoint_it = cv::KeyPoint(*corner_it, (float)blockSize);
-	}
-
 	return;
 }
@@ -97,10 +97,10 @@ void saveLinks(const char* filename, std::multimap<int, Link> links) {
 			tr.r21(), tr.r22(), tr.r23(), tr.o24(),
 			tr.r31(), tr.r32(), tr.r33(), tr.o34());
 
-		const cv::Mat *infMatrix = &itr->second.infMatrix();
-		for (int row = 0; row < infMatrix->rows; row++) {
-			for (int col = 0; col < infMatrix->cols; col++) {
-				fprintf(fp_map_links, "%f,", infMatrix->at<double>(row, col));
+		const cv::Mat infMatrix = itr->second.infMatrix();
+		for (int row = 0; row < infMatrix.rows; row++) {
+			for (int col = 0; col < infMatrix.cols; col++) {
+				fprintf(fp_map_links, "%f,", infMatrix.at<double>(row, col));
 			}
 		}
 
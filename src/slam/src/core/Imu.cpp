@@ -0,0 +1,184 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/Imu.h"
+#include "core/Logger.h"
+#include <stdio.h>
+#include <algorithm>
+
+Imu::Imu()
+{
+	_imuToBase.setIdentity();
+	_bias.setZero();
+}
+
+Imu::~Imu()
+{}
+
+//=============================================================================
+// Recorded log, one sample per line:
+//   stamp, gx, gy, gz, ax, ay, az
+// in [s], [rad/s] and [m/s^2]. Stamps in [ns] (EuRoC) are accepted, they
+// must be on the clock of the image time stamps. Lines that do not start
+// with a number (headers, comments) are skipped.
+//=============================================================================
+bool Imu::load(const std::string &path)
+{
+	FILE *fp = fopen(path.c_str(), "r");
+	if (fp == NULL) {
+		return false;
+	}
+
+	char line[256];
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		double stamp;
+		IMU_SAMPLE sample;
+		int num = sscanf(line, "%lf,%f,%f,%f,%f,%f,%f", &stamp,
+			&sample.gyro[0], &sample.gyro[1], &sample.gyro[2],
+			&sample.accel[0], &sample.accel[1], &sample.accel[2]);
+		if (num != 7) {
+			continue;
+		}
+		sample.stamp = (stamp > 1e12) ? stamp * 1e-9 : stamp;
+		push(sample);
+	}
+	fclose(fp);
+
+	LOG_INFO("%d IMU samples loaded\n", (int)_samples.size());
+	return !_samples.empty();
+}
+
+//=============================================================================
+// 3x3 rotation from the IMU axes to the base frame, row-major
+//=============================================================================
+bool Imu::loadExtrinsic(const std::string &path)
+{
+	FILE *fp = fopen(path.c_str(), "r");
+	if (fp == NULL) {
+		return false;
+	}
+
+	float r[9];
+	int num = 0;
+	while ((num < 9) && (fscanf(fp, " %f%*[ ,\r\n]", &r[num]) == 1)) {
+		num++;
+	}
+	fclose(fp);
+
+	if (num != 9) {
+		return false;
+	}
+	_imuToBase <<
+		r[0], r[1], r[2],
+		r[3], r[4], r[5],
+		r[6], r[7], r[8];
+	return true;
+}
+
+// out-of-order samples are dropped
+void Imu::push(const IMU_SAMPLE &sample)
+{
+	if (_samples.empty() || (sample.stamp > _samples.back().stamp)) {
+		_samples.push_back(sample);
+	}
+}
+
+// keeps the last sample at or before "stamp" for the next integration
+void Imu::discard(double stamp)
+{
+	while ((_samples.size() >= 2) && (_samples[1].stamp <= stamp)) {
+		_samples.pop_front();
+	}
+}
+
+//=============================================================================
+// Rotation of the IMU axes from "from" to "to", the bias-corrected rates
+// of two consecutive samples are averaged over the interval between them.
+// Returns false if the samples do not cover the interval.
+//=============================================================================
+bool Imu::integrateImu(double from, double to, Eigen::Matrix3f &rotation) const
+{
+	rotation.setIdentity();
+	if ((_samples.size() < 2) || (to <= from)) {
+		return false;
+	}
+	if ((_samples.front().stamp > from + IMU_MAX_GAP) || (_samples.back().stamp < to - IMU_MAX_GAP)) {
+		return false;
+	}
+
+	for (size_t i = 0; i + 1 < _samples.size(); i++)
+	{
+		const IMU_SAMPLE &s0 = _samples[i];
+		const IMU_SAMPLE &s1 = _samples[i + 1];
+		if (s1.stamp <= from) {
+			continue;
+		}
+		if (s0.stamp >= to) {
+			break;
+		}
+		if (s1.stamp - s0.stamp > IMU_MAX_GAP) {
+			return false;
+		}
+
+		double dt = std::min(s1.stamp, to) - std::max(s0.stamp, from);
+		Eigen::Vector3f w(
+			0.5f * (s0.gyro[0] + s1.gyro[0]),
+			0.5f * (s0.gyro[1] + s1.gyro[1]),
+			0.5f * (s0.gyro[2] + s1.gyro[2]));
+		w = (w - _bias) * (float)dt;
+
+		float angle = w.norm();
+		if (angle > 0.0f) {
+			rotation = rotation * Eigen::AngleAxisf(angle, w / angle).toRotationMatrix();
+		}
+	}
+
+	return true;
+}
+
+//=============================================================================
+// Rotation of the base frame from "from" to "to", in the same convention
+// as the odometry motion (previous frame to current frame).
+//=============================================================================
+bool Imu::integrate(double from, double to, Transform &rotation) const
+{
+	Eigen::Matrix3f r;
+	if (!integrateImu(from, to, r)) {
+		return false;
+	}
+
+	r = _imuToBase * r * _imuToBase.transpose();
+	rotation = Transform(
+		r(0, 0), r(0, 1), r(0, 2), 0.0f,
+		r(1, 0), r(1, 1), r(1, 2), 0.0f,
+		r(2, 0), r(2, 1), r(2, 2), 0.0f);
+	return true;
+}
+
+//=============================================================================
+// Pulls the gyro bias towards the visual rotation "motion" between "from"
+// and "to". A bias error b tilts the integrated rotation by b * dt, large
+// mismatches are left to the visual outliers and ignored.
+//=============================================================================
+void Imu::updateBias(const Transform &motion, double from, double to)
+{
+	Eigen::Matrix3f gyro;
+	if (!integrateImu(from, to, gyro)) {
+		return;
+	}
+
+	Eigen::Matrix3f visual = _imuToBase.transpose() * motion.toEigen3x4f().leftCols<3>() * _imuToBase;
+	Eigen::AngleAxisf error(gyro.transpose() * visual);
+	if (error.angle() > IMU_BIAS_MAX_ERROR) {
+		return;
+	}
+
+	_bias -= IMU_BIAS_GAIN * error.angle() * error.axis() / (float)(to - from);
+}
+
+unsigned long Imu::getSize()
+{
+	return sizeof(Imu) + (unsigned long)(_samples.size() * sizeof(IMU_SAMPLE));
+}
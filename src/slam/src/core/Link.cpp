@@ -4,13 +4,14 @@
 //=============================================================================
 #include "core/Link.h"
 #include "core/Logger.h"
+#include <algorithm>
 
 Link::Link()
 {
 	from_ = 0;
 	to_ = 0;
 	type_ = Undefined;
-	infMatrix_ = cv::Mat::eye(6, 6, CV_64FC1);
+	setInfMatrix(cv::Mat::eye(6, 6, CV_64FC1));
 }
 
 Link::Link(
@@ -27,6 +28,24 @@ Link::Link(
 	setInfMatrix(infMatrix);
 }
 
+void Link::setInfMatrix(const cv::Mat &infMatrix)
+{
+	cv::Mat dst(6, 6, CV_64FC1, infMatrix_);
+	if (infMatrix.type() == CV_64FC1) {
+		infMatrix.copyTo(dst);
+	}
+	else {
+		infMatrix.convertTo(dst, CV_64F);
+	}
+}
+
+cv::Mat Link::infMatrix() const
+{
+	cv::Mat infMatrix(6, 6, CV_64FC1);
+	std::copy(infMatrix_, infMatrix_ + 36, infMatrix.ptr<double>());
+	return infMatrix;
+}
+
 bool Link::isValid()
 {
 	bool valid = (from_ != 0) && (to_ != 0) && !transform_.isNull() && (type_ != Undefined);
@@ -41,7 +60,7 @@ Link Link::inverse() const
 		from_,
 		type_,
 		transform_.isNull() ? Transform() : transform_.inverse(),
-		transform_.isNull() ? cv::Mat::eye(6, 6, CV_64FC1) : infMatrix_);
+		transform_.isNull() ? cv::Mat::eye(6, 6, CV_64FC1) : infMatrix());
 
 	return link;
 }
@@ -49,8 +68,7 @@ Link Link::inverse() const
 unsigned long Link::getSize() {
 	unsigned long memUsed = (unsigned long)(
 		sizeof(Link) +
-		transform_.getSize() +
-		infMatrix_.total() * infMatrix_.elemSize());
+		transform_.getSize());
 
 	return memUsed;
 }
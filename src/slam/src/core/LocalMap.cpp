@@ -0,0 +1,227 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/LocalMap.h"
+#include "core/Stereo.h"
+#include <opencv2/core/hal/hal.hpp>
+#include <math.h>
+#include <limits.h>
+#include <numeric>
+#include <algorithm>
+
+LocalMap::LocalMap()
+{
+	_keyFrameCount = 0;
+}
+
+LocalMap::~LocalMap()
+{
+}
+
+void LocalMap::clear()
+{
+	_points.clear();
+	_descriptors.release();
+	_observations.clear();
+	_lastSeen.clear();
+	_voxels.clear();
+}
+
+// 21 bits for each axis
+long long LocalMap::key(int vx, int vy, int vz) const
+{
+	return
+		((long long)(vx & 0x1FFFFF) << 42) |
+		((long long)(vy & 0x1FFFFF) << 21) |
+		((long long)(vz & 0x1FFFFF));
+}
+
+int LocalMap::voxel(float val) const
+{
+	return (int)floorf(val / LOCAL_MAP_VOXEL_SIZE);
+}
+
+//--------------------------------------------------------------
+// The most similar landmark within the fusion radius, -1 if none.
+// The radius equals the voxel size, 3x3x3 voxels are visited.
+//--------------------------------------------------------------
+int LocalMap::findLandmark(const cv::Point3f &pt, const unsigned char *descriptor) const
+{
+	float radius2 = LOCAL_MAP_VOXEL_SIZE * LOCAL_MAP_VOXEL_SIZE;
+	int vx = voxel(pt.x);
+	int vy = voxel(pt.y);
+	int vz = voxel(pt.z);
+
+	int best = -1;
+	int bestDist = LOCAL_MAP_FUSE_HAMMING + 1;
+	for (int z = vz - 1; z <= vz + 1; z++) {
+		for (int y = vy - 1; y <= vy + 1; y++) {
+			for (int x = vx - 1; x <= vx + 1; x++) {
+				auto itr = _voxels.find(key(x, y, z));
+				if (itr == _voxels.end()) {
+					continue;
+				}
+				for (int i : itr->second) {
+					cv::Point3f d = _points[i] - pt;
+					if (d.dot(d) > radius2) {
+						continue;
+					}
+					int dist = cv::hal::normHamming(descriptor, _descriptors.ptr<unsigned char>(i), _descriptors.cols);
+					if (dist < bestDist) {
+						bestDist = dist;
+						best = i;
+					}
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+//=============================================================================
+// Fuses the 3D keypoints of a new key frame at "pose". A landmark moves to
+// the mean of its observations and takes the latest descriptor.
+//=============================================================================
+void LocalMap::addKeyFrame(const SensorData &keyFrame, const Transform &pose)
+{
+	_keyFrameCount++;
+
+	const std::vector<cv::Point3f> &kpts3D = keyFrame.keypoints3D();
+	const cv::Mat &descriptors = keyFrame.descriptors();
+	if (descriptors.empty()) {
+		return;
+	}
+	if (_descriptors.empty()) {
+		_descriptors = cv::Mat(0, descriptors.cols, descriptors.type());
+	}
+
+	int numLandmarks = (int)_points.size();
+	for (int i = 0; i < (int)kpts3D.size(); i++)
+	{
+		if (!isFinite(kpts3D[i])) {
+			continue;
+		}
+
+		cv::Point3f pt;
+		pose.transformPoints(&kpts3D[i], &pt, 1);
+		const unsigned char *descriptor = descriptors.ptr<unsigned char>(i);
+
+		// landmarks added by this key frame are not candidates
+		int j = findLandmark(pt, descriptor);
+		if ((j >= 0) && (j < numLandmarks))
+		{
+			float n = (float)std::min(_observations[j], 10);
+			_points[j] = (_points[j] * n + pt) * (1.0f / (n + 1.0f));
+			memcpy(_descriptors.ptr<unsigned char>(j), descriptor, descriptors.cols);
+			_observations[j]++;
+			_lastSeen[j] = _keyFrameCount;
+		}
+		else
+		{
+			_points.push_back(pt);
+			_descriptors.push_back(descriptors.row(i));
+			_observations.push_back(1);
+			_lastSeen.push_back(_keyFrameCount);
+		}
+	}
+
+	prune();
+	buildVoxels();
+}
+
+//=============================================================================
+// Landmarks matched as inliers of a frame registered against getFrame(),
+// pairs of <landmark, keypoint>.
+//=============================================================================
+void LocalMap::observe(const std::vector<std::pair<int, int>> &inlierIndex)
+{
+	for (auto itr = inlierIndex.begin(); itr != inlierIndex.end(); itr++) {
+		int i = itr->first;
+		if ((0 <= i) && (i < (int)_points.size())) {
+			_observations[i]++;
+			_lastSeen[i] = _keyFrameCount;
+		}
+	}
+}
+
+//=============================================================================
+// Landmarks as the keypoints of a frame at "pose", the index of a keypoint
+// is the landmark index until the next addKeyFrame().
+//=============================================================================
+void LocalMap::getFrame(const Transform &pose, SensorData &frame) const
+{
+	int num = (int)_points.size();
+	std::vector<cv::KeyPoint> keypoints(num);
+	std::vector<cv::Point3f> keypoints3D(num);
+	pose.inverse().transformPoints(_points.data(), keypoints3D.data(), num);
+
+	frame = SensorData();
+	frame.setFeatures(keypoints, keypoints3D, _descriptors.clone(), cv::Mat());
+}
+
+//--------------------------------------------------------------
+// Removes the landmarks not observed recently, the least
+// observed ones first beyond LOCAL_MAP_MAX_LANDMARKS.
+//--------------------------------------------------------------
+void LocalMap::prune()
+{
+	int num = (int)_points.size();
+	std::vector<int> order;
+	order.reserve(num);
+	for (int i = 0; i < num; i++) {
+		if (_keyFrameCount - _lastSeen[i] <= LOCAL_MAP_MAX_AGE) {
+			order.push_back(i);
+		}
+	}
+
+	if ((int)order.size() > LOCAL_MAP_MAX_LANDMARKS) {
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+			if (_lastSeen[a] != _lastSeen[b]) {
+				return _lastSeen[a] > _lastSeen[b];
+			}
+			return _observations[a] > _observations[b];
+		});
+		order.resize(LOCAL_MAP_MAX_LANDMARKS);
+		std::sort(order.begin(), order.end());
+	}
+
+	if ((int)order.size() == num) {
+		return;
+	}
+
+	// compact in place, "order" is ascending
+	for (int k = 0; k < (int)order.size(); k++) {
+		int i = order[k];
+		if (i != k) {
+			_points[k] = _points[i];
+			_descriptors.row(i).copyTo(_descriptors.row(k));
+			_observations[k] = _observations[i];
+			_lastSeen[k] = _lastSeen[i];
+		}
+	}
+	int kept = (int)order.size();
+	_points.resize(kept);
+	_descriptors.resize(kept);
+	_observations.resize(kept);
+	_lastSeen.resize(kept);
+}
+
+void LocalMap::buildVoxels()
+{
+	_voxels.clear();
+	for (int i = 0; i < (int)_points.size(); i++) {
+		const cv::Point3f &pt = _points[i];
+		_voxels[key(voxel(pt.x), voxel(pt.y), voxel(pt.z))].push_back(i);
+	}
+}
+
+unsigned long LocalMap::getSize() const
+{
+	return (unsigned long)(
+		sizeof(LocalMap) +
+		_points.size() * (sizeof(cv::Point3f) + sizeof(int) * 3) +
+		_descriptors.total() * _descriptors.elemSize() +
+		_voxels.size() * (16 + sizeof(long long) + sizeof(std::vector<int>)));
+}
@@ -4,23 +4,31 @@
 //=============================================================================
 #include "core/Mapper.h"
 #include "core/Registration.h"
+#include "core/Arena.h"
 #include "core/Graph.h"
 #include "core/Perf.h"
 #include "core/Logger.h"
 
+#include <algorithm>
+
 extern Perf perf;
+extern xThreadPool threadPool;
 
 Mapper::Mapper()
 {
 	_frameProcessed = 0;
 	_intermediateCount = 0;
-	_mapUpdate = 5;
+	_nodeDue = true;
 	_maxStMemSize = 30;
 	_idCount = 0;
 	_idMapCount = 0;
 	_lastNode = 0;
+	_loopClosureCount = 0;
+	_lcCount = 0;
+	_driftVariance = 0.0f;
 	_vwd = new VWDictionary();
 	_th_param.state = 0;
+	_th_param.vwPrune = 0;
 
 	// change thread priority
 	_xth.lowerProirity();
@@ -39,6 +47,7 @@ void Mapper::cleanupThread() {
 		Link link = _th_param.link;
 		if ((link.from() != 0) && (link.to() != 0)) {
 			addLink(link);
+			_loopClosureCount++;
 		}
 		_th_param.state = 0;
 	}
@@ -51,8 +60,17 @@ void Mapper::init()
 	clearNodes();
 
 	_lastNode = 0;
+	_intermediateCount = 0;
+	_nodeDue = true;
+	_featureNodePose.setNull();
 	_idCount = 0;
 	_idMapCount = 0;
+	_loopClosureCount = 0;
+	_nodesLeftStm.clear();
+	_lcCount = 0;
+	_driftVariance = 0.0f;
+	_stMemVariance.clear();
+	_spatialIndex.clear();
 
 	if (_vwd) {
 		_vwd->clear();
@@ -68,14 +86,72 @@ void Mapper::clearNodes()
 	_nodes.clear();
 }
 
+//==================================================================
+// Stationary when the pose hardly moved since the last node
+//==================================================================
+bool Mapper::isStill(const ODOM_INFO &odomInfo) const
+{
+	if (_lastNode == 0) {
+		return false;
+	}
+
+	Transform motion = _lastNode->getPose().inverse() * odomInfo.pose;
+	float d = 0.5f * (motion.r11() + motion.r22() + motion.r33() - 1.0f);
+	float angle = acosf(std::max(std::min(d, 1.0f), -1.0f));
+	return (motion.getNorm() < MAP_STILL_DIST) && (angle < MAP_STILL_ANGLE);
+}
+
+//==================================================================
+// A frame at "pose", "interval" frames after the last node holding
+// features, becomes the next one when it moved far enough, the view
+// changed or the parallax grew, within the min/max intervals.
+//==================================================================
+bool Mapper::isNodeDue(const Transform &pose, const ODOM_INFO &odomInfo, int interval) const
+{
+	if (_featureNodePose.isNull() || (interval >= MAP_NODE_MAX_INTERVAL)) {
+		return true;
+	}
+	if (interval < MAP_NODE_MIN_INTERVAL) {
+		return false;
+	}
+
+	Transform motion = _featureNodePose.inverse() * pose;
+	float d = 0.5f * (motion.r11() + motion.r22() + motion.r33() - 1.0f);
+	float angle = acosf(std::max(std::min(d, 1.0f), -1.0f));
+	return
+		(motion.getNorm() >= MAP_NODE_DIST) ||
+		(angle >= MAP_NODE_ANGLE) ||
+		(odomInfo.inlierRatio < MAP_NODE_INLIER_RATIO) ||
+		(odomInfo.parallax >= MAP_NODE_PARALLAX);
+}
+
+//==================================================================
+// Returns false when no node is created.
+//==================================================================
 bool Mapper::process(SensorData &data, ODOM_INFO odomInfo, APP_SETTING appSetting)
 {
+	// stationary, no node and no loop-closure detection
+	if (!odomInfo.lost && isStill(odomInfo)) {
+		_nodeDue = isNodeDue(odomInfo.pose, odomInfo, _intermediateCount + 1);
+		_frameProcessed++;
+		return false;
+	}
+
+	// tracked frames have no features of their own, a node due on
+	// a tracked frame waits for the next detection
+	int interval = _intermediateCount + 1;
+	bool nodeDue = isNodeDue(odomInfo.pose, odomInfo, interval);
+	if (nodeDue && odomInfo.tracked) {
+		nodeDue = false;
+	}
+
 	if (
-		(_intermediateCount >= (_mapUpdate - 1)) &&
+		nodeDue &&
 		!((appSetting.appType == APP_TYPE_SLAM_REALTIME) && (_th_param.state == 1)))
 	{
 		// not intermediate node
 		_intermediateCount = 0;
+		_featureNodePose = odomInfo.pose;
 	}
 	else {
 		// set as an intermediate node
@@ -84,6 +160,15 @@ bool Mapper::process(SensorData &data, ODOM_INFO odomInfo, APP_SETTING appSettin
 		_intermediateCount++;
 	}
 
+	// predicted by the motion of this frame for the feature
+	// detection of the next one
+	if (odomInfo.transform.isNull()) {
+		_nodeDue = true;
+	}
+	else {
+		_nodeDue = isNodeDue(odomInfo.pose * odomInfo.transform, odomInfo, _intermediateCount + 1);
+	}
+
 
 	//==================================================================
 	// Create a node and detect loop-closure
@@ -102,6 +187,7 @@ bool Mapper::process(SensorData &data, ODOM_INFO odomInfo, APP_SETTING appSettin
 			Link link = _th_param.link;
 			if ((link.from() != 0) && (link.to() != 0)) {
 				addLink(link);
+				_loopClosureCount++;
 			}
 		}
 
@@ -117,6 +203,32 @@ bool Mapper::process(SensorData &data, ODOM_INFO odomInfo, APP_SETTING appSettin
 		_th_param.link.setFrom(0); // mark as an invalid link
 		_th_param.link.setTo(0);
 		_th_param.state = 1; // thread is running
+		_th_param.lcParam.topK = appSetting.lcTopK;
+		_th_param.lcParam.timeBudget = appSetting.lcTimeBudget;
+
+		// search only around the current position, except for
+		// the periodic global search. The index grows with the nodes
+		// leaving STM while the loop-closure thread runs, so it is
+		// searched here and the thread gets only the candidates.
+		if ((appSetting.lcRadius > 0.0f) &&
+			((appSetting.lcGlobalInterval <= 0) || ((_lcCount % appSetting.lcGlobalInterval) != 0)))
+		{
+			const Transform &pose = node->getPose();
+			_spatialIndex.radiusSearch(
+				pose.x(), pose.y(), pose.z(), _driftVariance,
+				appSetting.lcRadius, appSetting.lcRadiusScale, _th_param.lcParam.candidates);
+			std::sort(_th_param.lcParam.candidates.begin(), _th_param.lcParam.candidates.end());
+			_th_param.lcParam.spatial = true;
+		}
+		else {
+			_th_param.lcParam.candidates.clear();
+			_th_param.lcParam.spatial = false;
+		}
+		_lcCount++;
+		_th_param.vwPrune = appSetting.vwPrune;
+		_th_param.vwMaxWords = appSetting.vwMaxWords;
+		_th_param.nodesLeftStm.swap(_nodesLeftStm);
+		_nodesLeftStm.clear();
 		TH_PARAM *pth_param = &_th_param;
 		_xth.create(thread, (void*)pth_param);
 
@@ -128,6 +240,89 @@ bool Mapper::process(SensorData &data, ODOM_INFO odomInfo, APP_SETTING appSettin
 	return true;
 }
 
+//==================================================================
+// Relocalization of a frame the odometry has lost.
+//------------------------------------------------------------------
+// The descriptors of the frame are looked up in the VW dictionary,
+// the nodes in memory are scored by the inverted index as in the
+// loop-closure detection and the top-K candidates are verified by
+// PnP in parallel. The candidate with the most inliers gives the
+// pose of the frame in the map.
+//==================================================================
+bool Mapper::relocalize(const SensorData &data, int topK, Transform &pose, cv::Mat &covariance)
+{
+	if (data.descriptors().empty() || _nodes.empty()) {
+		return false;
+	}
+
+	// the dictionary is updated by the loop-closure thread, it is not
+	// waited for, the next lost frame tries again
+	if (_th_param.state == 1) {
+		return false;
+	}
+	cleanupThread();
+
+	std::vector<int> wordIds = _vwd->findWords(data.descriptors());
+	if (wordIds.empty()) {
+		return false;
+	}
+
+	// nodes holding features, intermediate nodes have none
+	std::list<int> nodesToCompare;
+	for (auto iter = _nodes.begin(); iter != _nodes.end(); iter++) {
+		if (iter->second->getWeight() >= 0) {
+			nodesToCompare.push_back(iter->first);
+		}
+	}
+	std::map<int, float> likelihood = computeLikelihood(wordIds, _nodes, _vwd, nodesToCompare);
+
+	// higher likelihood first, newer node first on a tie
+	std::vector<std::pair<int, float>> candidates;
+	for (auto iter = likelihood.rbegin(); iter != likelihood.rend(); ++iter) {
+		if (iter->second > 0.0f) {
+			candidates.push_back(*iter);
+		}
+	}
+	std::stable_sort(candidates.begin(), candidates.end(),
+		[](const std::pair<int, float> &a, const std::pair<int, float> &b) {
+			return a.second > b.second;
+		});
+	if ((int)candidates.size() > topK) {
+		candidates.resize(topK);
+	}
+
+	// PnP from each candidate node to the frame
+	int numCandidates = (int)candidates.size();
+	std::vector<Transform> transforms(numCandidates);
+	std::vector<REG_INFO> regInfos(numCandidates);
+	threadPool.parallelFor(numCandidates, [&](int k) {
+		Arena::local().reset();
+		regInfos[k].covariance = cv::Mat::eye(6, 6, CV_64FC1);
+		regInfos[k].num_inliers = 0;
+		regInfos[k].num_matches = 0;
+		transforms[k] = computeTransform(_nodes.at(candidates[k].first)->sensorData(), data, Transform(), &regInfos[k]);
+	});
+
+	int best = -1;
+	for (int k = 0; k < numCandidates; k++) {
+		if (!transforms[k].isNull() && ((best < 0) || (regInfos[k].num_inliers > regInfos[best].num_inliers))) {
+			best = k;
+		}
+	}
+
+	if (best < 0) {
+		LOG_INFO(" Relocalization failed[%d] ", numCandidates);
+		return false;
+	}
+
+	const Node *node = _nodes.at(candidates[best].first);
+	pose = node->getPose() * transforms[best];
+	regInfos[best].covariance.copyTo(covariance);
+	LOG_INFO(" Relocalized[%d,%f,%d] ", node->id(), candidates[best].second, regInfos[best].num_inliers);
+
+	return true;
+}
+
 void Mapper::getGraph(
 	std::map<int, Transform> &poses,
 	std::multimap<int, Link> &links)
@@ -304,6 +499,12 @@ void Mapper::addNodeToStm(Node *node, const cv::Mat &covariance)
 		infMatrix.at<double>(4, 4) = 1.0 / covariance.at<double>(4, 4);
 		infMatrix.at<double>(5, 5) = 1.0 / covariance.at<double>(5, 5);
 
+		// translational variance accumulated along the trajectory
+		_driftVariance += (float)(
+			covariance.at<double>(0, 0) +
+			covariance.at<double>(1, 1) +
+			covariance.at<double>(2, 2));
+
 		// add link
 		Link link_forward = Link(*_stMem.rbegin(), node->id(), Link::Neighbor, motionEstimate, infMatrix);
 		_nodes.at(*_stMem.rbegin())->addLink(link_forward);
@@ -314,10 +515,31 @@ void Mapper::addNodeToStm(Node *node, const cv::Mat &covariance)
 
 	_nodes.insert(_nodes.end(), std::pair<int, Node *>(node->id(), node));
 	_stMem.insert(_stMem.end(), node->id());
+	_stMemVariance.insert(_stMemVariance.end(), std::make_pair(node->id(), _driftVariance));
 }
 
 void Mapper::moveNodeToWMFromSTM()
 {
+	// VWs of this node are examined in the next thread
+	const Node *node = getNode(*_stMem.begin());
+	if (node->getWeight() >= 0) {
+		_nodesLeftStm.push_back(node->id());
+	}
+
+	// register the position for the loop-closure candidate search.
+	// the odometry pose is not corrected afterwards: the pose graph is
+	// optimized only after the run, so the indexed positions and the
+	// query are in the same drifting odometry frame, and the radius grows
+	// with the variance accumulated between them.
+	auto itr = _stMemVariance.find(node->id());
+	if (itr != _stMemVariance.end()) {
+		if (node->getWeight() >= 0) {
+			const Transform &pose = node->getPose();
+			_spatialIndex.insert(node->id(), pose.x(), pose.y(), pose.z(), itr->second);
+		}
+		_stMemVariance.erase(itr);
+	}
+
 	_workingMem.insert(_workingMem.end(), std::make_pair(*_stMem.begin(), currentTimeSec()));
 	_stMem.erase(*_stMem.begin());
 }
@@ -412,8 +634,9 @@ Node * Mapper::createNode(SensorData &data, ODOM_INFO odomInfo)
 
 void* addWordIds(Node *node, VWDictionary *vwd)
 {
-	std::vector<cv::KeyPoint> keypoints = node->sensorData().keypoints();
-	cv::Mat descriptors = node->sensorData().descriptors().clone();
+	// the features are shared with the other copies of the frame, read only
+	const std::vector<float> &responses = node->sensorData().responses();
+	const cv::Mat &descriptors = node->sensorData().descriptors();
 
 	//==================================================================
 	// Limit the number of keypoints to be stored in node
@@ -430,7 +653,7 @@ void* addWordIds(Node *node, VWDictionary *vwd)
 
 		// limit the number of keypoints based on "response" field.
 		// corresponding bits in "inliers" will be set.
-		node->sensorData().limitKeypoints(keypoints, inliers, maxFeatures);
+		SensorData::limitKeypoints(responses, inliers, maxFeatures);
 
 		// copy survived descriptors to "descriptorsForVwd".
 		// "indexForVwd" contains indices of that descriptors.
@@ -456,33 +679,56 @@ void* addWordIds(Node *node, VWDictionary *vwd)
 
 	// "wordsIds" is a list of VW IDs associated with input keypoints.
 	// Keypoints whose descriptors are not added to VW dictionary will
-	// have unique negative IDs.
-	std::list<int> wordIds;
+	// have negative IDs.
+	std::vector<int> wordIds;
 	if (kptsLimited) {
-		int negIndex = -1;
+		wordIds.resize(responses.size());
 		auto itr = addedWordIds.begin();
-		for (int i = 0; i < (int)keypoints.size(); i++) {
-			if (inliers[i]) {
-				wordIds.push_back(*itr++);
-			}
-			else {
-				wordIds.push_back(negIndex--);
-			}
+		for (int i = 0; i < (int)responses.size(); i++) {
+			wordIds[i] = (inliers[i]) ? *itr++ : -1;
 		}
 	}
 	else {
-		wordIds = addedWordIds;
+		wordIds.assign(addedWordIds.begin(), addedWordIds.end());
 	}
 
-	std::multimap<int, int> words;
-	for (auto iter = wordIds.begin(); iter != wordIds.end(); iter++) {
-		words.insert(std::make_pair(*iter, words.size())); // <VW.ID, keypoint index>
-	}
-	node->setWords(words);
+	node->setWords(wordIds);
 
 	return 0;
 }
 
+void pruneWords(
+	std::map<int, Node*> &nodes,
+	VWDictionary *vwd,
+	const std::vector<int> &ids,
+	int prune,
+	int maxWords)
+{
+	if (prune) {
+		for (auto itr = ids.begin(); itr != ids.end(); itr++)
+		{
+			auto itr_node = nodes.find(*itr);
+			if (itr_node == nodes.end()) {
+				continue;
+			}
+
+			// unique VW IDs of the node
+			std::list<int> wordIds;
+			const std::vector<unsigned int> &words = itr_node->second->getWordIds();
+			for (int i = 0; i < (int)words.size(); i++) {
+				if ((i == 0) || (words[i] != words[i - 1])) {
+					wordIds.push_back((int)words[i]);
+				}
+			}
+
+			vwd->removeSingleRefWords(wordIds, *itr);
+		}
+	}
+
+	vwd->limitWords(maxWords);
+	vwd->compact();
+}
+
 void Mapper::getMemoryUsed()
 {
 	unsigned long memUsed = (unsigned long)(
@@ -496,6 +742,10 @@ void Mapper::getMemoryUsed()
 		sizeof(std::map<int, Node*>));
 
 	perf.registerMemoryUsed("Mapper", memUsed);
+	perf.registerMemoryUsed("SpatialIndex", _spatialIndex.getSize());
+
+	// number of accepted loop closures, not memory
+	perf.registerMemoryUsed("LoopClosures", (unsigned long)_loopClosureCount);
 
 	for (auto itr = _nodes.begin(); itr != _nodes.end(); itr++) {
 		itr->second->getMemoryUsed();
@@ -508,6 +758,12 @@ void* thread(void *param)
 {
 	TH_PARAM *th_param = (TH_PARAM*)param;
 
+	// VW dictionary maintenance
+	perf.startTime("pruneWords");
+	pruneWords(*th_param->nodes, th_param->vwd, th_param->nodesLeftStm, th_param->vwPrune, th_param->vwMaxWords);
+	th_param->nodesLeftStm.clear();
+	perf.stopTime("pruneWords");
+
 	// VW dictionary update
 	perf.startTime("addWordIds");
 	addWordIds(th_param->node, th_param->vwd);
@@ -515,7 +771,9 @@ void* thread(void *param)
 
 	// detect loop closure
 	perf.startTime("detectLoopClosure");
-	detectLoopClosure(*th_param->nodes, *th_param->workingMem, th_param->vwd, th_param->node->id(), &th_param->link);
+	detectLoopClosure(
+		*th_param->nodes, *th_param->workingMem, th_param->vwd, th_param->node->id(), &th_param->link,
+		th_param->lcParam);
 	perf.stopTime("detectLoopClosure");
 
 	th_param->state = 2; // thread is complete
@@ -538,7 +796,8 @@ void detectLoopClosure(
 	std::map<int, double> &workingMem,
 	VWDictionary *_vwd,
 	int id,
-	Link *link)
+	Link *link,
+	const LC_PARAM &param)
 {
 	Node *node = findNode(nodes, id);
 
@@ -552,12 +811,21 @@ void detectLoopClosure(
 		//   <Node ID, System time when moved from StM to WM>
 		//============================================================
 		std::list<int> nodesToCompare;
-		for (auto iter = workingMem.begin(); iter != workingMem.end(); iter++)
+		if (param.spatial)
 		{
-			const Node *n = findNode(nodes, iter->first);
-			if (n->getWeight() != -1) {
-				// ignore intermediate nodes
-				nodesToCompare.push_back(iter->first);
+			// only the nodes within the drift-scaled radius.
+			// intermediate nodes are not registered.
+			nodesToCompare.assign(param.candidates.begin(), param.candidates.end());
+		}
+		else
+		{
+			for (auto iter = workingMem.begin(); iter != workingMem.end(); iter++)
+			{
+				const Node *n = findNode(nodes, iter->first);
+				if (n->getWeight() != -1) {
+					// ignore intermediate nodes
+					nodesToCompare.push_back(iter->first);
+				}
 			}
 		}
 
@@ -565,41 +833,103 @@ void detectLoopClosure(
 		std::map<int, float> likelihood = computeLikelihood(node, nodes, _vwd, nodesToCompare);
 
 		//============================================================
-		// Select the highest hypothesis
+		// Select the top-K hypotheses above the threshold
 		//============================================================
-		std::pair<int, float> highestHypothesis = std::make_pair(0, 0.0f);
+		float loopThr = 0.2f;
+		std::vector<std::pair<int, float>> hypotheses;
 		for (auto iter = likelihood.begin(); iter != likelihood.end(); ++iter) {
-			if (iter->first > 0 && iter->second > highestHypothesis.second) {
-				highestHypothesis = *iter;
+			if (iter->first > 0 && iter->second >= loopThr) {
+				hypotheses.push_back(*iter);
 			}
 		}
 
+		// higher likelihood first, older node first on a tie
+		std::stable_sort(hypotheses.begin(), hypotheses.end(),
+			[](const std::pair<int, float> &a, const std::pair<int, float> &b) {
+				return a.second > b.second;
+			});
+
+		int topK = std::max(param.topK, 1);
+		if ((int)hypotheses.size() > topK) {
+			hypotheses.resize(topK);
+		}
+
 		//============================================================
 		// compute LC transform
+		//------------------------------------------------------------
+		// Candidates are verified in parallel. Once a candidate is
+		// accepted, lower ranked candidates are cancelled, the ones
+		// running stop at the next RANSAC round. All candidates stop
+		// at the end of the time budget. The best ranked accepted
+		// one wins.
 		//============================================================
-		float loopThr = 0.2f;
-		if (highestHypothesis.second >= loopThr)
+		int numHypotheses = (int)hypotheses.size();
+		int toId = node->id();
+		const SensorData &sensorTo = node->sensorData();
+
+		std::vector<Transform> transforms(numHypotheses);
+		std::vector<REG_INFO> regInfos(numHypotheses);
+		std::vector<float> procTime(numHypotheses, 0.0f);
+		std::vector<int> verified(numHypotheses, 0);
+		std::vector<int> cancelled(numHypotheses, 0);
+		std::atomic<int> bestRank(numHypotheses);
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		if (param.timeBudget > 0.0f) {
+			deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((long long)(param.timeBudget * 1000.0f));
+		}
+
+		threadPool.parallelFor(numHypotheses, [&](int k) {
+			PNP_CANCEL cancel = { &bestRank, k, deadline };
+			if (isCancelled(&cancel)) {
+				return;
+			}
+
+			// each candidate starts a new frame on this thread's arena
+			Arena::local().reset();
+
+			float t0 = currentTimeMs();
+			const SensorData &sensorFrom = findNode(nodes, hypotheses[k].first)->sensorData();
+			regInfos[k].covariance = cv::Mat::eye(6, 6, CV_64FC1);
+			regInfos[k].num_inliers = 0;
+			regInfos[k].num_matches = 0;
+			transforms[k] = computeTransform(sensorFrom, sensorTo, Transform(), &regInfos[k], REG_GUESS_WIN_SIZE, &cancel);
+			procTime[k] = currentTimeMs() - t0;
+			verified[k] = 1;
+			cancelled[k] = transforms[k].isNull() && isCancelled(&cancel);
+
+			if (!transforms[k].isNull()) {
+				int rank = bestRank;
+				while ((k < rank) && !bestRank.compare_exchange_weak(rank, k)) {}
+			}
+		});
+
+		for (int k = 0; k < numHypotheses; k++)
 		{
-			int fromId = highestHypothesis.first;
-			int toId = node->id();
-			SensorData sensorFrom = findNode(nodes, fromId)->sensorData();
-			SensorData sensorTo = findNode(nodes, toId)->sensorData();
-			struct REG_INFO reg_info;
-			reg_info.covariance = cv::Mat::eye(6, 6, CV_64FC1);
-			Transform transform = computeTransform(sensorFrom, sensorTo, Transform(), &reg_info);
-
-			if (transform.isNull()) {
-				LOG_INFO(" LC rejected[%d,%d,%f] ", toId, fromId, highestHypothesis.second);
+			int fromId = hypotheses[k].first;
+			if (!verified[k]) {
+				LOG_INFO(" LC skipped[%d,%d,%f] ", toId, fromId, hypotheses[k].second);
+			}
+			else if (cancelled[k]) {
+				LOG_INFO(" LC cancelled[%d,%d,%f,%.1fms] ", toId, fromId, hypotheses[k].second, procTime[k]);
+			}
+			else if (transforms[k].isNull()) {
+				LOG_INFO(" LC rejected[%d,%d,%f,%d,%.1fms] ",
+					toId, fromId, hypotheses[k].second, regInfos[k].num_inliers, procTime[k]);
 			}
 			else {
-				LOG_INFO(" LC accepted[%d,%d,%f] ", toId, fromId, highestHypothesis.second);
-
-				// adds a link between the nodes
-				transform = transform.inverse();
-				cv::Mat information = reg_info.covariance.inv();
-				*link = Link(node->id(), highestHypothesis.first, Link::LoopClosure, transform, information);
+				LOG_INFO(" LC %s[%d,%d,%f,%d,%.1fms] ", (k == bestRank) ? "accepted" : "unused",
+					toId, fromId, hypotheses[k].second, regInfos[k].num_inliers, procTime[k]);
 			}
 		}
+
+		if (bestRank < numHypotheses)
+		{
+			// adds a link between the nodes
+			int k = bestRank;
+			Transform transform = transforms[k].inverse();
+			cv::Mat information = regInfos[k].covariance.inv();
+			*link = Link(toId, hypotheses[k].first, Link::LoopClosure, transform, information);
+		}
 	}
 }
 
@@ -608,27 +938,35 @@ std::map<int, float> computeLikelihood(
 	std::map<int, Node*> &nodes,
 	VWDictionary *vwd,
 	const std::list<int> & ids)
+{
+	// unique VW IDs, sorted
+	const std::vector<unsigned int> &words = node->getWordIds();
+	std::vector<int> wordIds;
+	wordIds.reserve(node->getNumUniqueWords());
+	for (int i = 0; i < (int)words.size(); i++)
+	{
+		if ((i == 0) || (words[i] != words[i - 1]))
+		{
+			wordIds.push_back((int)words[i]);
+		}
+	}
+
+	return computeLikelihood(wordIds, nodes, vwd, ids);
+}
+
+std::map<int, float> computeLikelihood(
+	const std::vector<int> &wordIds,
+	std::map<int, Node*> &nodes,
+	VWDictionary *vwd,
+	const std::list<int> & ids)
 {
 	std::map<int, float> likelihood;
-	std::map<int, float> calculatedWordsRatio;
 
 	for (auto iter = ids.begin(); iter != ids.end(); ++iter)
 	{
 		likelihood.insert(likelihood.end(), std::pair<int, float>(*iter, 0.0f));
 	}
 
-	std::multimap<int, int> words = node->getWords();
-	std::list<int> wordIds;
-	std::list<int>::reverse_iterator lastValue;
-	for (auto iter = words.begin(); iter != words.end(); ++iter)
-	{
-		if (iter == words.begin() || (iter != words.begin() && *lastValue != iter->first))
-		{
-			wordIds.push_back(iter->first);
-			lastValue = wordIds.rbegin();
-		}
-	}
-
 	// tf-idf = (nwi / ni) log (N / nw)
 	// where nwi: the number of occurences of word w in image i
 	//       ni : the total number of words in image i
@@ -643,9 +981,10 @@ std::map<int, float> computeLikelihood(
 	{
 		for (auto i = wordIds.begin(); i != wordIds.end(); ++i)
 		{
-			if (*i > 0)
+			// removed VWs are ignored
+			const VisualWord *vw = (*i > 0) ? vwd->getWord(*i) : 0;
+			if (vw)
 			{
-				const VisualWord *vw = vwd->getWord(*i);
 				const std::map<int, int> & refs = vw->getReferences();
 				float nw = (float)refs.size();
 
@@ -663,7 +1002,7 @@ std::map<int, float> computeLikelihood(
 							Node *node = findNode(nodes, j->first);
 							if (node)
 							{
-								ni = (int)((Node*)node)->getWords().size();
+								ni = node->getNumWords();
 								iter->second += (nwi  * logNnw) / ni;
 							}
 						}
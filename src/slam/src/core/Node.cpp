@@ -5,6 +5,7 @@
 #include "core/Node.h"
 #include "core/Perf.h"
 #include <core/Logger.h>
+#include <algorithm>
 
 extern Perf perf;
 
@@ -14,6 +15,8 @@ Node::Node()
 	_mapId = -1;
 	_stamp = 0.0;
 	_weight = 0;
+	_numUniqueWords = 0;
+	_numWords = 0;
 }
 
 Node::Node(
@@ -27,6 +30,8 @@ Node::Node(
 	_mapId = mapId;
 	_stamp = sensorData.stamp();
 	_weight = weight;
+	_numUniqueWords = 0;
+	_numWords = 0;
 	_pose = pose;
 	_sensorData = sensorData;
 
@@ -65,12 +70,57 @@ bool Node::hasLink(int idTo, Link::Type type) const
 	return false;
 }
 
+//==================================================================
+// "kptWordIds" is the VW ID of each keypoint, negative for the
+// keypoints without VW. They are counted in the total number of
+// words but not stored.
+//==================================================================
+void Node::setWords(const std::vector<int> &kptWordIds)
+{
+	std::vector<std::pair<unsigned int, int>> words; // <VW ID, keypoint index>
+	words.reserve(kptWordIds.size());
+	for (int i = 0; i < (int)kptWordIds.size(); i++) {
+		if (kptWordIds[i] >= 0) {
+			words.push_back(std::make_pair((unsigned int)kptWordIds[i], i));
+		}
+	}
+	std::sort(words.begin(), words.end());
+
+	_wordIds.resize(words.size());
+	_wordKptIndices.resize(words.size());
+	_numUniqueWords = 0;
+	for (int i = 0; i < (int)words.size(); i++) {
+		_wordIds[i] = words[i].first;
+		_wordKptIndices[i] = words[i].second;
+		if ((i == 0) || (words[i].first != words[i - 1].first)) {
+			_numUniqueWords++;
+		}
+	}
+	_numWords = (int)kptWordIds.size();
+}
+
+// [first, last) of the given VW ID in getWordIds()
+void Node::getWordRange(unsigned int wordId, int &first, int &last) const
+{
+	auto range = std::equal_range(_wordIds.begin(), _wordIds.end(), wordId);
+	first = (int)(range.first - _wordIds.begin());
+	last = (int)(range.second - _wordIds.begin());
+}
+
+int Node::getWordCount(unsigned int wordId) const
+{
+	int first, last;
+	getWordRange(wordId, first, last);
+	return last - first;
+}
+
 void Node::getMemoryUsed()
 {
 	unsigned long memUsed = (unsigned long)(
 		sizeof(Node) +
 		_pose.getSize() * 3 +
-		_words.size() * (12 + sizeof(int) + sizeof(int)));
+		_wordIds.capacity() * sizeof(unsigned int) +
+		_wordKptIndices.capacity() * sizeof(int));
 
 	if (_links.size() > 0) {
 		memUsed += (unsigned long)(_links.size() * (12 + sizeof(int) + _links.begin()->second.getSize()));
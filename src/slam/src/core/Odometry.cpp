@@ -7,6 +7,9 @@
 #include "core/Logger.h"
 #include "core/Registration.h"
 #include "core/Perf.h"
+#include "core/Arena.h"
+
+#include <algorithm>
 
 extern Perf perf;
 
@@ -23,13 +26,27 @@ Odometry::Odometry()
 	_keyFrameAdded = false;
 	_distanceTravelled = 0.0f;
 	_state = Odometry::Initialized;
+	_inlierRatio = 0.0f;
+	_parallax = 0.0f;
+	_tracking = false;
+	_trackedFrame = false;
+	_keyFramePending = false;
+	_minTracked = 150;
+	_imu = nullptr;
+	_guessWinSize = REG_GUESS_WIN_SIZE;
+	_localMapMode = false;
+	_localMapUsed = false;
+	_relocalization = false;
 }
 
 Odometry::~Odometry()
 {}
 
-void Odometry::process(SensorData data, ODOM_INFO *odomInfo)
+void Odometry::process(const SensorData &data, ODOM_INFO *odomInfo)
 {
+	// scratch buffers of the previous frame are released
+	Arena::local().reset();
+
 	// delta t
 	double dt;
 	if (framesProcessed() == 0) {
@@ -55,10 +72,41 @@ void Odometry::process(SensorData data, ODOM_INFO *odomInfo)
 			vroll*(float)dt, vpitch*(float)dt, vyaw*(float)dt);
 	}
 
+	// the gyro rotation replaces the rotation of the guess, the
+	// projected points land closer and a smaller window is searched
+	Transform gyro;
+	bool imuPrior = (_imu != nullptr) && (dt > 0.0) &&
+		_imu->integrate(previousStamp_, data.stamp(), gyro);
+	if (imuPrior) {
+		float tx = 0.0f, ty = 0.0f, tz = 0.0f;
+		if (!guess.isNull()) {
+			tx = guess.x();
+			ty = guess.y();
+			tz = guess.z();
+		}
+		guess = Transform(
+			gyro.r11(), gyro.r12(), gyro.r13(), tx,
+			gyro.r21(), gyro.r22(), gyro.r23(), ty,
+			gyro.r31(), gyro.r32(), gyro.r33(), tz);
+		_guessWinSize = REG_GUESS_WIN_SIZE_IMU;
+	}
+	else {
+		_guessWinSize = REG_GUESS_WIN_SIZE;
+	}
+
 	// Estimate camera transform
+	// the flag of track() is cleared by updateMotion()
+	bool tracked = _trackedFrame;
 	Transform t = this->updateMotion(data, guess);
+
+	if (_imu != nullptr) {
+		if (imuPrior && !t.isNull()) {
+			_imu->updateBias(t, previousStamp_, data.stamp());
+		}
+		_imu->discard(data.stamp());
+	}
 	
-	if (dt)
+	if (dt && !t.isNull())
 	{
 		// rotation matrix to roll/pitch/yaw
 		float vx, vy, vz, vroll, vpitch, vyaw;
@@ -87,8 +135,28 @@ void Odometry::process(SensorData data, ODOM_INFO *odomInfo)
 	previousStamp_ = data.stamp();
 	++framesProcessed_;
 
-	// Update current position
-	_pose *= t;
+	// Update current position, kept while lost
+	if (!t.isNull()) {
+		_pose *= t;
+	}
+
+	// inliers confirm the landmarks, a new key frame is fused
+	// at its pose and the map is restarted when lost
+	if (_localMapMode) {
+		if (t.isNull()) {
+			_localMap.clear();
+			_localMapFrame = SensorData();
+		}
+		else {
+			if (_localMapUsed) {
+				_localMap.observe(_regInfo.inlierIndex);
+			}
+			if (_keyFrameAdded) {
+				_localMap.addKeyFrame(refFrame_, _pose);
+				_localMap.getFrame(_pose, _localMapFrame);
+			}
+		}
+	}
 
 	// Output info
 	odomInfo->pose = _pose;
@@ -98,12 +166,48 @@ void Odometry::process(SensorData data, ODOM_INFO *odomInfo)
 	odomInfo->transform = t;
 	odomInfo->distanceTravelled = _distanceTravelled;
 	odomInfo->velocity = velocityGuess_;
-	odomInfo->covariance = _regInfo.covariance;
+	_regInfo.covariance.copyTo(odomInfo->covariance);
+	odomInfo->inlierRatio = _inlierRatio;
+	odomInfo->parallax = _parallax;
+	odomInfo->tracked = tracked;
+}
+
+//--------------------------------------------------------------
+// Median angle between the rays from the key frame and from the
+// current frame to the inliers, "t" is the motion from the key
+// frame. Small while rotating in place.
+//--------------------------------------------------------------
+static float medianParallax(const SensorData &from, const Transform &t, const REG_INFO &regInfo)
+{
+	int num = (int)regInfo.inlierIndex.size();
+	if (num == 0) {
+		return 0.0f;
+	}
+
+	const std::vector<cv::Point3f> &kpts3D = from.keypoints3D();
+	cv::Point3f center(t.x(), t.y(), t.z());
+	float *angles = Arena::local().alloc<float>(num);
+	int n = 0;
+	for (auto iter = regInfo.inlierIndex.begin(); iter != regInfo.inlierIndex.end(); ++iter) {
+		const cv::Point3f &p = kpts3D[iter->first];
+		cv::Point3f q = p - center;
+		float norm = sqrtf(p.dot(p) * q.dot(q));
+		if (norm > 0.0f) {
+			float d = p.dot(q) / norm;
+			angles[n++] = acosf(std::max(std::min(d, 1.0f), -1.0f));
+		}
+	}
+	if (n == 0) {
+		return 0.0f;
+	}
+
+	std::nth_element(angles, angles + n / 2, angles + n);
+	return angles[n / 2] * (float)(180.0 / CV_PI);
 }
 
 Transform Odometry::updateMotion(
-	SensorData data,
-	const Transform guess)
+	const SensorData &data,
+	const Transform &guess)
 {
 	// Register key frame
 	// becomes null if the key frame has been updated
@@ -117,13 +221,43 @@ Transform Odometry::updateMotion(
 	//==================================================================
 	// Calculate camera pose between frames
 	//==================================================================
+	// the member is updated in place to keep the buffers
 	Transform t;
-	struct REG_INFO regInfo;
+	REG_INFO &regInfo = _regInfo;
+	_localMapUsed = false;
 	if (framesProcessed_ == 0)
 	{
 		t = Transform::getIdentity();
 		regInfo.covariance = cv::Mat::eye(6, 6, CV_64FC1) * 9999.0;
 	}
+	else if ((_state == Odometry::Lost) && _relocalization)
+	{
+		// stays lost until relocalize() finds the pose in the map
+		regInfo.num_inliers = 0;
+		regInfo.num_matches = 0;
+		regInfo.inlierIndex.clear();
+	}
+	else if (_trackedFrame)
+	{
+		// keypoints were tracked from the key frame,
+		// the matching pairs are already known
+		Transform guessUpdate;
+		if (!guess.isNull()) {
+			guessUpdate = motionSinceLastKeyFrame * guess;
+		}
+
+		MATCHES matches;
+		matches.num = (int)_trackIndex.size();
+		matches.from = _trackIndex.data();
+		matches.to = Arena::local().alloc<int>(matches.num);
+		matches.ratio = nullptr;
+		for (int i = 0; i < matches.num; i++) {
+			matches.to[i] = i;
+		}
+		estimateMotion(refFrame_, data, guessUpdate, t, &regInfo, matches);
+
+		this->setNumObjects(regInfo.num_matches);
+	}
 	else
 	{
 		Transform guessUpdate;
@@ -134,10 +268,16 @@ Transform Odometry::updateMotion(
 			guessUpdate = motionSinceLastKeyFrame * guess;
 		}
 
-		t = computeTransform(refFrame_, data, guessUpdate, &regInfo);
+		// the local map is in the coords of the key frame, only the
+		// guided matching is done against it
+		_localMapUsed = _localMapMode && !guessUpdate.isNull() && (_localMapFrame.numKeypoints() > 0);
+		const SensorData &from = _localMapUsed ? _localMapFrame : refFrame_;
+
+		t = computeTransform(from, data, guessUpdate, &regInfo, _guessWinSize);
 
 		if (!guessUpdate.isNull() && (regInfo.num_matches < this->getNumObjects() * _guessRatio)) {
 			LOG_INFO(" Wrong Guess ");
+			_localMapUsed = false;
 			t = computeTransform(refFrame_, data, Transform(), &regInfo);
 		}
 
@@ -150,9 +290,14 @@ Transform Odometry::updateMotion(
 			LOG_INFO(" Odometry Lost ");
 		}
 		_state = Odometry::Lost;
+		_inlierRatio = 0.0f;
+		_parallax = 0.0f;
 	}
 	else {
 		_state = Odometry::Running;
+		_inlierRatio = (data.numKeypoints() > 0) ?
+			(float)regInfo.num_inliers / (float)data.numKeypoints() : 0.0f;
+		_parallax = medianParallax(_localMapUsed ? _localMapFrame : refFrame_, t, regInfo);
 	}
 
 	Transform output = motionSinceLastKeyFrame.inverse() * t;
@@ -161,36 +306,215 @@ Transform Odometry::updateMotion(
 	// Key frame update
 	//==================================================================
 	// the key frame will be updated when the number of inliers is 
-	// below the threshold.
+	// below the threshold. A lost frame has no pose to be a key frame,
+	// the key frame is kept while the relocalization is pending.
 	float keyFrameThr = 0.3f;
 	int visKeyFrameThr = 150;
 	bool addKeyFrame = false;
-	if (
+	bool keepKeyFrame = t.isNull() && _relocalization && (framesProcessed_ != 0);
+	if (!keepKeyFrame && (
 		(framesProcessed_ == 0) ||
-		float(regInfo.num_inliers) <= keyFrameThr * float(refFrame_.keypoints().size()) ||
-		regInfo.num_inliers <= visKeyFrameThr)
+		float(regInfo.num_inliers) <= keyFrameThr * float(refFrame_.numKeypoints()) ||
+		regInfo.num_inliers <= visKeyFrameThr ||
+		_keyFramePending))
+	{
+		if (_trackedFrame) {
+			// tracked frame has no new keypoints,
+			// the key frame is created at the next detection
+			_keyFramePending = true;
+		}
+		else {
+			refFrame_ = data;
+			lastKeyFramePose_.setNull();
+			addKeyFrame = true;
+			_keyFramePending = false;
+		}
+	}
+
+	//==================================================================
+	// Tracks for the next frame
+	//==================================================================
+	// all keypoints with 3D coords on a new key frame, otherwise
+	// only the inliers survive.
+	if (_tracking)
 	{
-		refFrame_ = data;
-		lastKeyFramePose_.setNull();
-		addKeyFrame = true;
+		_trackPts.clear();
+		_trackIndex.clear();
+		if (addKeyFrame) {
+			trackKeyFrame(data);
+		}
+		else if (!t.isNull()) {
+			for (auto iter = regInfo.inlierIndex.begin(); iter != regInfo.inlierIndex.end(); ++iter) {
+				_trackPts.push_back(data.points()[iter->second]);
+				_trackIndex.push_back(iter->first);
+			}
+		}
+
+		// the pyramid is kept if it was built in track()
+		if (_prevImage.data != data.imageLeft().data) {
+			_prevImage = data.imageLeft();
+			_prevPyramid.clear();
+		}
+		_trackedFrame = false;
 	}
 
-	_numFeatures = (int)data.keypoints().size();
+	_numFeatures = data.numKeypoints();
 	_keyFrameAdded = addKeyFrame;
-	_regInfo = regInfo;
 
 	return output;
 }
 
+//==================================================================
+// Track keypoints of the key frame by pyramidal LK.
+//------------------------------------------------------------------
+// Tracked keypoints inherit the descriptors of the key frame, so
+// the detection and the description can be skipped. Returns false
+// when the frame needs them: no tracks, too few tracks survived,
+// or a key frame is pending.
+//==================================================================
+bool Odometry::track(
+	SensorData &data,
+	std::vector<cv::KeyPoint> &kpts2d,
+	cv::Mat &desc)
+{
+	_trackedFrame = false;
+	if (!_tracking || _keyFramePending || _prevImage.empty() ||
+		(int)_trackPts.size() < _minTracked)
+	{
+		return false;
+	}
+
+	// pyramid of the previous frame is reused if it was tracked
+	cv::Size winSize(21, 21);
+	int maxLevel = 3;
+	if (_prevPyramid.empty()) {
+		cv::buildOpticalFlowPyramid(_prevImage, _prevPyramid, winSize, maxLevel);
+	}
+	std::vector<cv::Mat> pyramid;
+	cv::buildOpticalFlowPyramid(data.imageLeft(), pyramid, winSize, maxLevel);
+
+	std::vector<cv::Point2f> nextPts;
+	std::vector<unsigned char> status;
+	std::vector<float> err;
+	cv::calcOpticalFlowPyrLK(_prevPyramid, pyramid, _trackPts, nextPts, status, err, winSize, maxLevel);
+
+	_prevImage = data.imageLeft();
+	_prevPyramid.swap(pyramid);
+
+	// remove lost tracks and the ones outside of the image
+	float width = (float)(data.imageLeft().cols - 1);
+	float height = (float)(data.imageLeft().rows - 1);
+	int num = 0;
+	for (int i = 0; i < (int)nextPts.size(); i++)
+	{
+		if (status[i] &&
+			(0.0f <= nextPts[i].x) && (nextPts[i].x < width) &&
+			(0.0f <= nextPts[i].y) && (nextPts[i].y < height))
+		{
+			_trackPts[num] = nextPts[i];
+			_trackIndex[num] = _trackIndex[i];
+			num++;
+		}
+	}
+	_trackPts.resize(num);
+	_trackIndex.resize(num);
+
+	if (num < _minTracked) {
+		return false;
+	}
+
+	// keypoints and descriptors inherited from the key frame
+	const std::vector<float> &responsesRef = refFrame_.responses();
+	const cv::Mat &descRef = refFrame_.descriptors();
+	kpts2d.resize(num);
+	desc = cv::Mat();
+	if (!descRef.empty()) {
+		desc = cv::Mat(num, descRef.cols, descRef.type());
+	}
+	for (int i = 0; i < num; i++) {
+		kpts2d[i] = cv::KeyPoint();
+		kpts2d[i].pt = _trackPts[i];
+		kpts2d[i].response = responsesRef[_trackIndex[i]];
+		if (!desc.empty()) {
+			descRef.row(_trackIndex[i]).copyTo(desc.row(i));
+		}
+	}
+
+	_trackedFrame = true;
+	return true;
+}
+
+//==================================================================
+// Restart from a pose found by the relocalization, the lost frame
+// becomes the key frame.
+//==================================================================
+void Odometry::relocalize(
+	const SensorData &data,
+	const Transform &pose,
+	const cv::Mat &covariance,
+	ODOM_INFO *odomInfo)
+{
+	_pose = pose;
+	refFrame_ = data;
+	lastKeyFramePose_.setNull();
+	velocityGuess_.setNull();
+	_state = Odometry::Running;
+	_keyFramePending = false;
+	_keyFrameAdded = true;
+	_inlierRatio = 1.0f;
+	_parallax = 0.0f;
+
+	if (_localMapMode) {
+		_localMap.clear();
+		_localMap.addKeyFrame(data, _pose);
+		_localMap.getFrame(_pose, _localMapFrame);
+	}
+
+	if (_tracking) {
+		trackKeyFrame(data);
+	}
+
+	odomInfo->pose = _pose;
+	odomInfo->lost = false;
+	odomInfo->velocity = velocityGuess_;
+	covariance.copyTo(odomInfo->covariance);
+	odomInfo->inlierRatio = _inlierRatio;
+	odomInfo->parallax = _parallax;
+	odomInfo->tracked = false;
+}
+
+// all keypoints of the key frame with 3D coords are tracked
+void Odometry::trackKeyFrame(const SensorData &data)
+{
+	_trackPts.clear();
+	_trackIndex.clear();
+	for (int i = 0; i < data.numKeypoints(); i++) {
+		if (isFinite(data.keypoints3D()[i])) {
+			_trackPts.push_back(data.points()[i]);
+			_trackIndex.push_back(i);
+		}
+	}
+}
+
 void Odometry::getMemoryUsed()
 {
 	unsigned long memUsed =
 		sizeof(Odometry) +
 		_pose.getSize() +
 		velocityGuess_.getSize() +
-		lastKeyFramePose_.getSize();
+		lastKeyFramePose_.getSize() +
+		(unsigned long)(_trackPts.size() * sizeof(cv::Point2f)) +
+		(unsigned long)(_trackIndex.size() * sizeof(int));
 
 	perf.registerMemoryUsed("Odometry", memUsed);
 
+	if (_imu != nullptr) {
+		perf.registerMemoryUsed("Imu", _imu->getSize());
+	}
+
+	if (_localMapMode) {
+		perf.registerMemoryUsed("LocalMap", _localMap.getSize());
+	}
+
 	refFrame_.getMemoryUsed();
 }
@@ -15,20 +15,7 @@ void addVertices(
 	for (auto itr = poses.begin(); itr != poses.end(); itr++)
 	{
 		int id = itr->first;
-
-		Eigen::Isometry3d pose;
-		pose(0, 0) = itr->second.r11();
-		pose(0, 1) = itr->second.r12();
-		pose(0, 2) = itr->second.r13();
-		pose(0, 3) = itr->second.o14();
-		pose(1, 0) = itr->second.r21();
-		pose(1, 1) = itr->second.r22();
-		pose(1, 2) = itr->second.r23();
-		pose(1, 3) = itr->second.o24();
-		pose(2, 0) = itr->second.r31();
-		pose(2, 1) = itr->second.r32();
-		pose(2, 2) = itr->second.r33();
-		pose(2, 3) = itr->second.o34();
+		Eigen::Isometry3d pose = itr->second.toIsometry3d();
 
 		Vertex *v = new Vertex();
 		v->setEstimate(pose);
@@ -54,28 +41,8 @@ void addEdges(
 		int id1 = itr->second.from();
 		int id2 = itr->second.to();
 
-		Transform tr = itr->second.transform();
-		Eigen::Isometry3d pose;
-		pose(0, 0) = tr.r11();
-		pose(0, 1) = tr.r12();
-		pose(0, 2) = tr.r13();
-		pose(0, 3) = tr.o14();
-		pose(1, 0) = tr.r21();
-		pose(1, 1) = tr.r22();
-		pose(1, 2) = tr.r23();
-		pose(1, 3) = tr.o24();
-		pose(2, 0) = tr.r31();
-		pose(2, 1) = tr.r32();
-		pose(2, 2) = tr.r33();
-		pose(2, 3) = tr.o34();
-
-		const cv::Mat *infMatrix = &itr->second.infMatrix();
-		Eigen::Matrix<double, 6, 6> inf;
-		for (int row = 0; row < infMatrix->rows; row++) {
-			for (int col = 0; col < infMatrix->cols; col++) {
-				inf(row, col) = infMatrix->at<double>(row, col);
-			}
-		}
+		Eigen::Isometry3d pose = itr->second.transform().toIsometry3d();
+		Eigen::Matrix<double, 6, 6> inf = itr->second.information();
 
 		Edge *e = new Edge();
 		Vertex *v1 = graph.vertex(id1);
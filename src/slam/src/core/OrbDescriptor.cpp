@@ -0,0 +1,262 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/OrbDescriptor.h"
+#include "core/Parameters.h"
+#include "core/xThread.h"
+#include "opencv/CvORB.h"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <math.h>
+
+extern xThreadPool threadPool;
+
+#define ORB_NUM_ANGLES	721 // [-360, 360] deg
+#define ORB_CHUNK		64  // keypoints per parallel task
+
+OrbDescriptor::OrbDescriptor(int method)
+{
+	_method = method;
+	_step = 0;
+	_tables.resize(ORB_NUM_ANGLES, nullptr);
+
+	// circular patch for the intensity centroid, same as OpenCV ORB
+	int hp = ORB_HALF_PATCH_SIZE;
+	int v, v0;
+	int vmax = cvFloor(hp * sqrt(2.f) / 2 + 1);
+	int vmin = cvCeil(hp * sqrt(2.f) / 2);
+	for (v = 0; v <= vmax; ++v) {
+		_umax[v] = cvRound(sqrt((double)hp * hp - v * v));
+	}
+	for (v = hp, v0 = 0; v >= vmin; --v) {
+		while (_umax[v0] == _umax[v0 + 1]) {
+			++v0;
+		}
+		_umax[v] = v0;
+		++v0;
+	}
+
+	// lane k corresponds to u = k - 15
+	for (v = 0; v <= hp; v++) {
+		for (int k = 0; k < 32; k++) {
+			int u = k - hp;
+			bool inside = (abs(u) <= _umax[v]);
+			_maskU[v][k] = inside ? (short)u : 0;
+			_maskOne[v][k] = inside ? 1 : 0;
+		}
+	}
+}
+
+OrbDescriptor::~OrbDescriptor()
+{
+	for (size_t i = 0; i < _tables.size(); i++) {
+		delete[] _tables[i];
+	}
+}
+
+//=============================================================================
+// Rotated Sampling Pattern
+//=============================================================================
+// pixel offsets from the keypoint, same arithmetic as computeOrbDescriptors()
+void OrbDescriptor::buildTable(float angle, int *table) const
+{
+	angle *= (float)(CV_PI / 180.f);
+	float a = (float)cos(angle), b = (float)sin(angle);
+
+	const cv::Point* pattern = (const cv::Point*)bit_pattern_31_2;
+	for (int i = 0; i < ORB_NUM_POINTS; i++) {
+		float x = pattern[i].x*a - pattern[i].y*b;
+		float y = pattern[i].x*b + pattern[i].y*a;
+		table[i] = cvRound(y)*_step + cvRound(x);
+	}
+}
+
+// angle in [-360, 360] deg
+const int* OrbDescriptor::table(int angle)
+{
+	int *&t = _tables[angle + 360];
+	if (t == nullptr) {
+		t = new int[ORB_NUM_POINTS];
+		buildTable((float)angle, t);
+	}
+	return t;
+}
+
+//=============================================================================
+// Intensity Centroid
+//=============================================================================
+float OrbDescriptor::icAngle(const unsigned char *center, int step) const
+{
+	int m_01 = 0, m_10 = 0;
+	int hp = ORB_HALF_PATCH_SIZE;
+
+#if CV_SIMD128
+	// 32 lanes per row, masked to the circular patch
+	v_int32x4 v10 = v_setzero_s32();
+	for (int v = 0; v <= hp; v++) {
+		const unsigned char *plus = center + v*step - hp;
+		const unsigned char *minus = center - v*step - hp;
+		v_int32x4 vsum = v_setzero_s32();
+
+		for (int k = 0; k < 32; k += 16) {
+			v_uint16x8 p0, p1, m0, m1;
+			v_expand(v_load(plus + k), p0, p1);
+			if (v == 0) {
+				m0 = m1 = v_setzero_u16();
+			}
+			else {
+				v_expand(v_load(minus + k), m0, m1);
+			}
+
+			v10 += v_dotprod(v_reinterpret_as_s16(p0 + m0), v_load(&_maskU[v][k]));
+			v10 += v_dotprod(v_reinterpret_as_s16(p1 + m1), v_load(&_maskU[v][k + 8]));
+			vsum += v_dotprod(v_reinterpret_as_s16(p0) - v_reinterpret_as_s16(m0), v_load(&_maskOne[v][k]));
+			vsum += v_dotprod(v_reinterpret_as_s16(p1) - v_reinterpret_as_s16(m1), v_load(&_maskOne[v][k + 8]));
+		}
+		m_01 += v * v_reduce_sum(vsum);
+	}
+	m_10 = v_reduce_sum(v10);
+#else
+	for (int u = -hp; u <= hp; ++u) {
+		m_10 += u * center[u];
+	}
+
+	for (int v = 1; v <= hp; ++v) {
+		int v_sum = 0;
+		int d = _umax[v];
+		for (int u = -d; u <= d; ++u) {
+			int val_plus = center[u + v*step], val_minus = center[u - v*step];
+			v_sum += (val_plus - val_minus);
+			m_10 += u * (val_plus + val_minus);
+		}
+		m_01 += v * v_sum;
+	}
+#endif
+
+	return cv::fastAtan2((float)m_01, (float)m_10);
+}
+
+//=============================================================================
+// rBRIEF
+//=============================================================================
+void OrbDescriptor::describe(
+	const unsigned char *center,
+	const int *table,
+	unsigned char *desc) const
+{
+#if CV_SIMD128
+	// gather both sides of the 256 pairs, then compare 16 pairs at a time
+	unsigned char t0[ORB_NUM_POINTS / 2];
+	unsigned char t1[ORB_NUM_POINTS / 2];
+	for (int i = 0; i < ORB_NUM_POINTS / 2; i++) {
+		t0[i] = center[table[2 * i]];
+		t1[i] = center[table[2 * i + 1]];
+	}
+
+	for (int i = 0; i < ORB_DESC_BYTES / 2; i++) {
+		int mask = v_signmask(v_load(t0 + 16 * i) < v_load(t1 + 16 * i));
+		desc[2 * i] = (unsigned char)mask;
+		desc[2 * i + 1] = (unsigned char)(mask >> 8);
+	}
+#else
+	for (int i = 0; i < ORB_DESC_BYTES; i++, table += 16) {
+		int val = 0;
+		for (int j = 0; j < 8; j++) {
+			val |= (center[table[2 * j]] < center[table[2 * j + 1]]) << j;
+		}
+		desc[i] = (unsigned char)val;
+	}
+#endif
+}
+
+//=============================================================================
+// Compute Descriptors
+//=============================================================================
+void OrbDescriptor::compute(
+	const cv::Mat &image,
+	std::vector<cv::KeyPoint> &keypoints,
+	cv::Mat &desc)
+{
+	runByImageBorder(keypoints, image.size(), ORB_EDGE_THRESHOLD);
+
+	// the blurred image is reused across frames, the border is never read
+	// since keypoints are kept away from it
+	cv::GaussianBlur(image, _blurred, cv::Size(7, 7), 2, 2, cv::BORDER_REFLECT_101);
+
+	int step = (int)_blurred.step;
+	if (step != _step) {
+		for (size_t i = 0; i < _tables.size(); i++) {
+			delete[] _tables[i];
+			_tables[i] = nullptr;
+		}
+		_step = step;
+	}
+
+	int nkeypoints = (int)keypoints.size();
+	desc.create(nkeypoints, ORB_DESC_BYTES, CV_8U);
+	if (nkeypoints == 0) {
+		return;
+	}
+
+	int nchunks = (nkeypoints + ORB_CHUNK - 1) / ORB_CHUNK;
+
+	// orientation
+	if (_method == DESC_METHOD_ORB_ORIENTED) {
+		threadPool.parallelFor(nchunks, [&](int c) {
+			int end = std::min(nkeypoints, (c + 1) * ORB_CHUNK);
+			for (int j = c * ORB_CHUNK; j < end; j++) {
+				cv::KeyPoint &kpt = keypoints[j];
+				const unsigned char *center = image.ptr(cvRound(kpt.pt.y)) + cvRound(kpt.pt.x);
+				kpt.angle = icAngle(center, (int)image.step);
+			}
+		});
+	}
+
+	// offset tables are built here so that the workers only read them,
+	// null for an angle which is not an integer
+	std::vector<const int*> tables(nkeypoints);
+	for (int j = 0; j < nkeypoints; j++) {
+		float angle = keypoints[j].angle;
+		if (_method == DESC_METHOD_ORB_UPRIGHT) {
+			tables[j] = table(0);
+		}
+		else if (_method == DESC_METHOD_ORB_ORIENTED) {
+			tables[j] = table(cvRound(angle) % 360);
+		}
+		else if ((angle == (float)(int)angle) && (fabs(angle) <= 360.0f)) {
+			tables[j] = table((int)angle);
+		}
+		else {
+			tables[j] = nullptr;
+		}
+	}
+
+	threadPool.parallelFor(nchunks, [&](int c) {
+		int tmp[ORB_NUM_POINTS];
+		int end = std::min(nkeypoints, (c + 1) * ORB_CHUNK);
+		for (int j = c * ORB_CHUNK; j < end; j++) {
+			const cv::KeyPoint &kpt = keypoints[j];
+			const unsigned char *center = _blurred.ptr(cvRound(kpt.pt.y)) + cvRound(kpt.pt.x);
+			const int *t = tables[j];
+			if (t == nullptr) {
+				buildTable(kpt.angle, tmp);
+				t = tmp;
+			}
+			describe(center, t, desc.ptr(j));
+		}
+	});
+}
+
+unsigned long OrbDescriptor::getSize() const
+{
+	unsigned long size = sizeof(OrbDescriptor);
+	size += (unsigned long)(_tables.size() * sizeof(int*));
+	for (size_t i = 0; i < _tables.size(); i++) {
+		if (_tables[i] != nullptr) {
+			size += ORB_NUM_POINTS * sizeof(int);
+		}
+	}
+	size += (unsigned long)(_blurred.total() * _blurred.elemSize());
+	return size;
+}
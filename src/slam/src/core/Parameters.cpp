@@ -30,6 +30,19 @@ void parseArguments(
 	args->numImages = -1;
 	args->quiet = 0;
 	args->memory = 0;
+	args->numThreads = -1;
+	args->lcTopK = -1;
+	args->lcTimeBudget = -1.0f;
+	args->lcRadius = -1.0f;
+	args->vwPrune = -1;
+	args->vwMaxWords = -1;
+	args->saveDescriptor = 0;
+	args->rawInput = 0;
+	args->odomTracking = 0;
+	args->lazyFeatures = 0;
+	args->useImu = 0;
+	args->relocTopK = -1;
+	args->odomLocalMap = 0;
 
 	// parse parameters
 	for (int i = 1; i < argc; i++) {
@@ -71,12 +84,83 @@ void parseArguments(
 			args->pathRightCalib = args->baseDirectory + argv[i + 1];
 			i++;
 		}
+		else if (strcmp(argv[i], "-vocab") == 0) {
+			args->pathVocabulary = args->baseDirectory + argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-depth") == 0) {
+			args->depthMethod = argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-kpts") == 0) {
+			args->kptsMethod = argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-desc") == 0) {
+			args->descMethod = argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-savedesc") == 0) {
+			args->saveDescriptor = true;
+		}
+		else if (strcmp(argv[i], "-raw") == 0) {
+			args->rawInput = true;
+		}
+		else if (strcmp(argv[i], "-track") == 0) {
+			args->odomTracking = true;
+		}
+		else if (strcmp(argv[i], "-localmap") == 0) {
+			args->odomLocalMap = true;
+		}
+		else if (strcmp(argv[i], "-lazy") == 0) {
+			args->lazyFeatures = true;
+		}
+		else if (strcmp(argv[i], "-imu") == 0) {
+			args->useImu = true;
+		}
+		else if (strcmp(argv[i], "-imulog") == 0) {
+			args->pathImu = args->baseDirectory + argv[i + 1];
+			args->useImu = true;
+			i++;
+		}
+		else if (strcmp(argv[i], "-imucalib") == 0) {
+			args->pathImuCalib = args->baseDirectory + argv[i + 1];
+			i++;
+		}
 		else if (strcmp(argv[i], "-quiet") == 0) {
 			args->quiet = true;
 		}
 		else if (strcmp(argv[i], "-memory") == 0) {
 			args->memory = true;
 		}
+		else if (strcmp(argv[i], "-threads") == 0) {
+			args->numThreads = atoi(argv[i + 1]);
+			i++;
+		}
+		else if (strcmp(argv[i], "-lctopk") == 0) {
+			args->lcTopK = atoi(argv[i + 1]);
+			i++;
+		}
+		else if (strcmp(argv[i], "-lcbudget") == 0) {
+			args->lcTimeBudget = (float)atof(argv[i + 1]);
+			i++;
+		}
+		else if (strcmp(argv[i], "-lcradius") == 0) {
+			args->lcRadius = (float)atof(argv[i + 1]);
+			i++;
+		}
+		else if (strcmp(argv[i], "-vwprune") == 0) {
+			args->vwPrune = atoi(argv[i + 1]);
+			i++;
+		}
+		else if (strcmp(argv[i], "-vwmax") == 0) {
+			args->vwMaxWords = atoi(argv[i + 1]);
+			i++;
+		}
+		else if (strcmp(argv[i], "-reloc") == 0) {
+			args->relocTopK = atoi(argv[i + 1]);
+			i++;
+		}
 	}
 
 	LOG_INFO("\n");
@@ -90,6 +174,8 @@ void parseArguments(
 	LOG_INFO("numImages      : %d\n", args->numImages);
 	LOG_INFO("pathLeftCalib  : %s\n", args->pathLeftCalib.c_str());
 	LOG_INFO("pathRightCalib : %s\n", args->pathRightCalib.c_str());
+	LOG_INFO("pathVocabulary : %s\n", args->pathVocabulary.c_str());
+	LOG_INFO("pathImu        : %s\n", args->pathImu.c_str());
 	LOG_INFO("\n");
 
 
@@ -125,6 +211,108 @@ void parseArguments(
 
 	setParameter(appSetting, remoteSetting);
 
+	// overwrite the default values
+	if (args->numThreads >= 0) {
+		appSetting->numThreads = args->numThreads;
+	}
+
+	if (args->lcTopK > 0) {
+		appSetting->lcTopK = args->lcTopK;
+	}
+
+	if (args->lcTimeBudget >= 0.0f) {
+		appSetting->lcTimeBudget = args->lcTimeBudget;
+	}
+
+	if (args->lcRadius >= 0.0f) {
+		appSetting->lcRadius = args->lcRadius;
+	}
+
+	if (args->vwPrune >= 0) {
+		appSetting->vwPrune = args->vwPrune;
+	}
+
+	if (args->vwMaxWords >= 0) {
+		appSetting->vwMaxWords = args->vwMaxWords;
+	}
+
+	if (args->relocTopK >= 0) {
+		appSetting->relocTopK = args->relocTopK;
+	}
+
+	appSetting->saveDescriptor = args->saveDescriptor;
+	appSetting->rawInput = args->rawInput;
+	appSetting->odomTracking = args->odomTracking;
+	appSetting->lazyFeatures = args->lazyFeatures;
+	appSetting->useImu = args->useImu;
+	appSetting->odomLocalMap = args->odomLocalMap;
+
+	// landmark indices of the local map can't be tracked by LK
+	if (appSetting->odomLocalMap && appSetting->odomTracking) {
+		LOG_WARN("-track is ignored with -localmap\n");
+		appSetting->odomTracking = 0;
+	}
+
+	if (!args->depthMethod.empty()) {
+		if (args->depthMethod == "CV_LK") {
+			appSetting->depthMethod = DEPTH_METHOD_CV_LK;
+		}
+		else if (args->depthMethod == "CV_BM") {
+			appSetting->depthMethod = DEPTH_METHOD_CV_BM;
+		}
+		else if (args->depthMethod == "CV_SGBM") {
+			appSetting->depthMethod = DEPTH_METHOD_CV_SGBM;
+		}
+		else if (args->depthMethod == "FPGA_BM") {
+			appSetting->depthMethod = DEPTH_METHOD_FPGA_BM;
+		}
+		else if (args->depthMethod == "EPI_LK") {
+			appSetting->depthMethod = DEPTH_METHOD_EPI_LK;
+		}
+		else if (args->depthMethod == "SPARSE_BM") {
+			appSetting->depthMethod = DEPTH_METHOD_SPARSE_BM;
+		}
+		else if (args->depthMethod == "SOFT_BM") {
+			appSetting->depthMethod = DEPTH_METHOD_SOFT_BM;
+		}
+		else {
+			LOG_WARN("Undifned depth method [%s]", args->depthMethod.c_str());
+		}
+	}
+
+	if (!args->kptsMethod.empty()) {
+		if (args->kptsMethod == "CV_GFTT") {
+			appSetting->kptsMethod = KPTS_METHOD_CV_GFTT;
+		}
+		else if (args->kptsMethod == "FPGA_GFTT") {
+			appSetting->kptsMethod = KPTS_METHOD_FPGA_GFTT;
+		}
+		else if (args->kptsMethod == "SOFT_GFTT") {
+			appSetting->kptsMethod = KPTS_METHOD_SOFT_GFTT;
+		}
+		else {
+			LOG_WARN("Undifned keypoint method [%s]", args->kptsMethod.c_str());
+		}
+	}
+
+	if (!args->descMethod.empty()) {
+		if (args->descMethod == "CV_ORB") {
+			appSetting->descMethod = DESC_METHOD_CV_ORB;
+		}
+		else if (args->descMethod == "ORB") {
+			appSetting->descMethod = DESC_METHOD_ORB;
+		}
+		else if (args->descMethod == "ORB_UPRIGHT") {
+			appSetting->descMethod = DESC_METHOD_ORB_UPRIGHT;
+		}
+		else if (args->descMethod == "ORB_ORIENTED") {
+			appSetting->descMethod = DESC_METHOD_ORB_ORIENTED;
+		}
+		else {
+			LOG_WARN("Undifned descriptor method [%s]", args->descMethod.c_str());
+		}
+	}
+
 
 	//==================================================================
 	// Validity check
@@ -153,6 +341,16 @@ void parseArguments(
 			fclose(fp_calib_test);
 		}
 	}
+
+	if (!args->pathVocabulary.empty()) {
+		fp_calib_test = fopen(args->pathVocabulary.c_str(), "rb");
+		if (fp_calib_test == 0) {
+			LOG_ERROR("failed to open vocabulary file %s\n", args->pathVocabulary.c_str());
+		}
+		else {
+			fclose(fp_calib_test);
+		}
+	}
 }
 
 void setParameter (
@@ -165,7 +363,7 @@ void setParameter (
 		// linux application
 		appSetting->inputType = INPUT_TYPE_FILE;
 		appSetting->depthMethod = DEPTH_METHOD_CV_BM;
-		appSetting->kptsMethod = KPTS_METHOD_CV_GFTT;
+		appSetting->kptsMethod = KPTS_METHOD_SOFT_GFTT;
 
 		// remote application
 		remoteSetting->patternSelect = PATTERN_SELECT_NORMAL;
@@ -222,6 +420,31 @@ void setParameter (
 	}
 
 	appSetting->doResize = 0;
+
+	// ORB_UPRIGHT and ORB_ORIENTED need a vocabulary trained with the same method
+	appSetting->descMethod = (appSetting->kptsMethod == KPTS_METHOD_NONE) ? DESC_METHOD_NONE : DESC_METHOD_ORB;
+
+	// worker threads besides the main thread and the loop-closure thread
+	appSetting->numThreads = 3;
+
+	// loop-closure verification, top-K hypotheses verified in parallel.
+	// in real-time mode, verification has to finish before the next
+	// key frame, otherwise the next node is forced to be intermediate.
+	appSetting->lcTopK = 3;
+	appSetting->lcTimeBudget = (appSetting->appType == APP_TYPE_SLAM_REALTIME) ? 150.0f : 0.0f;
+
+	// loop-closure candidates around the current position
+	appSetting->lcRadius = 0.0f; // disabled
+	appSetting->lcRadiusScale = 3.0f;
+	appSetting->lcGlobalInterval = 10;
+
+	// relocalization against the map when the odometry is lost
+	appSetting->relocTopK = 3;
+
+	// VW dictionary maintenance, the dictionary keeps growing without it
+	// in a long real-time session.
+	appSetting->vwPrune = (appSetting->appType == APP_TYPE_SLAM_REALTIME);
+	appSetting->vwMaxWords = (appSetting->appType == APP_TYPE_SLAM_REALTIME) ? 100000 : 0;
 	appSetting->useFpga = (
 		(remoteSetting->returnData != RETURN_DATA_NONE) ||
 		(remoteSetting->usbOutput != USB_OUTPUT_NONE)
@@ -0,0 +1,979 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/PnPRansac.h"
+#include "opencv/CvSolvePnP.h"
+#include "core/xThread.h"
+#include <functional>
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#define PNP_SAMPLE_SIZE			3		// P3P
+#define PNP_PROSAC_SAMPLES		20000	// PROSAC draws uniformly after this number of samples
+#define PNP_SPRT_MODEL_COST		200.0	// time to solve a sample in point verifications
+#define PNP_SPRT_MODELS			2.0		// average number of P3P solutions per sample
+#define PNP_SPRT_UPDATE			16		// rejected hypotheses to update delta
+#define PNP_STREAM_BATCH		16		// samples of a stream in a round
+#define PNP_STREAM_STRIDE		0x9E3779B97F4A7C15ULL	// seed distance of the streams
+
+extern xThreadPool threadPool;
+
+namespace {
+
+inline double dot3(const double *a, const double *b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline void cross3(const double *a, const double *b, double *c)
+{
+	c[0] = a[1] * b[2] - a[2] * b[1];
+	c[1] = a[2] * b[0] - a[0] * b[2];
+	c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+//=============================================================================
+// Lambda Twist P3P
+//-----------------------------------------------------------------------------
+// M. Persson and K. Nordberg, "Lambda Twist: An Accurate Fast Robust
+// Perspective Three Point (P3P) Solver", ECCV 2018.
+//=============================================================================
+// real roots of x^2 + b*x + c = 0
+bool root2real(double b, double c, double &r1, double &r2)
+{
+	double v = b * b - 4.0 * c;
+	if (v < 0.0) {
+		r1 = r2 = 0.5 * b;
+		return false;
+	}
+
+	double y = sqrt(v);
+	if (b < 0.0) {
+		r1 = 0.5 * (-b + y);
+		r2 = 0.5 * (-b - y);
+	}
+	else {
+		r1 = 2.0 * c / (-b + y);
+		r2 = 2.0 * c / (-b - y);
+	}
+	return true;
+}
+
+// one real root of x^3 + b*x^2 + c*x + d = 0
+double cubick(double b, double c, double d)
+{
+	// initial solution
+	double r0;
+	if (b * b >= 3.0 * c) {
+		// h has two stationary points
+		double v = sqrt(b * b - 3.0 * c);
+		double t1 = (-b - v) / 3.0;
+		double k = ((t1 + b) * t1 + c) * t1 + d;
+		if (k > 0.0) {
+			// leftmost root of the 2nd order approximation around t1
+			r0 = t1 - sqrt(-k / (3.0 * t1 + b));
+		}
+		else {
+			// rightmost root of the 2nd order approximation around t2
+			double t2 = (-b + v) / 3.0;
+			k = ((t2 + b) * t2 + c) * t2 + d;
+			r0 = t2 + sqrt(-k / (3.0 * t2 + b));
+		}
+	}
+	else {
+		r0 = -b / 3.0;
+		if (fabs((3.0 * r0 + 2.0 * b) * r0 + c) < 1e-4) {
+			r0 += 1.0;
+		}
+	}
+
+	// Newton-Raphson
+	for (int i = 0; i < 50; i++) {
+		double fx = ((r0 + b) * r0 + c) * r0 + d;
+		if ((i >= 7) && (fabs(fx) <= 1e-13)) {
+			break;
+		}
+		double fpx = (3.0 * r0 + 2.0 * b) * r0 + c;
+		r0 -= fx / fpx;
+	}
+
+	return r0;
+}
+
+// eigen decomposition of a symmetric 3x3 matrix with a known 0 eigenvalue,
+// eigenvectors in the columns of E, |L[0]| >= |L[1]|, L[2] = 0
+void eigwithknown0(const double *x, double *E, double *L)
+{
+	double v3[3] = {
+		x[3] * x[7] - x[6] * x[4],
+		x[6] * x[1] - x[7] * x[0],
+		x[4] * x[0] - x[3] * x[1] };
+	double n3 = sqrt(dot3(v3, v3));
+	v3[0] /= n3;
+	v3[1] /= n3;
+	v3[2] /= n3;
+
+	double x01_squared = x[1] * x[1];
+	double b = -x[0] - x[4] - x[8];
+	double c = -x01_squared - x[2] * x[2] - x[5] * x[5] + x[0] * (x[4] + x[8]) + x[4] * x[8];
+	double e1, e2;
+	root2real(b, c, e1, e2);
+	if (fabs(e1) < fabs(e2)) {
+		std::swap(e1, e2);
+	}
+	L[0] = e1;
+	L[1] = e2;
+	L[2] = 0.0;
+
+	double mx0011 = -x[0] * x[4];
+	double prec_0 = x[1] * x[5] - x[2] * x[4];
+	double prec_1 = x[1] * x[2] - x[0] * x[5];
+
+	double tmp = 1.0 / (e1 * (x[0] + x[4]) + mx0011 - e1 * e1 + x01_squared);
+	double a1 = -(e1 * x[2] + prec_0) * tmp;
+	double a2 = -(e1 * x[5] + prec_1) * tmp;
+	double rnorm = 1.0 / sqrt(a1 * a1 + a2 * a2 + 1.0);
+
+	double tmp2 = 1.0 / (e2 * (x[0] + x[4]) + mx0011 - e2 * e2 + x01_squared);
+	double a21 = -(e2 * x[2] + prec_0) * tmp2;
+	double a22 = -(e2 * x[5] + prec_1) * tmp2;
+	double rnorm2 = 1.0 / sqrt(a21 * a21 + a22 * a22 + 1.0);
+
+	E[0] = a1 * rnorm;	E[1] = a21 * rnorm2;	E[2] = v3[0];
+	E[3] = a2 * rnorm;	E[4] = a22 * rnorm2;	E[5] = v3[1];
+	E[6] = rnorm;		E[7] = rnorm2;			E[8] = v3[2];
+}
+
+// refine the depths with the three distance constraints
+void refineLambda(double *L, double a12, double a13, double a23, double b12, double b13, double b23)
+{
+	for (int i = 0; i < 5; i++)
+	{
+		double l1 = L[0], l2 = L[1], l3 = L[2];
+		double r1 = l1 * l1 + l2 * l2 + b12 * l1 * l2 - a12;
+		double r2 = l1 * l1 + l3 * l3 + b13 * l1 * l3 - a13;
+		double r3 = l2 * l2 + l3 * l3 + b23 * l2 * l3 - a23;
+		double err = fabs(r1) + fabs(r2) + fabs(r3);
+		if (err < 1e-10) {
+			break;
+		}
+
+		double v0 = 2.0 * l1 + b12 * l2;	// dr1/dl1
+		double v1 = 2.0 * l2 + b12 * l1;	// dr1/dl2
+		double v3 = 2.0 * l1 + b13 * l3;	// dr2/dl1
+		double v5 = 2.0 * l3 + b13 * l1;	// dr2/dl3
+		double v7 = 2.0 * l2 + b23 * l3;	// dr3/dl2
+		double v8 = 2.0 * l3 + b23 * l2;	// dr3/dl3
+		double det = 1.0 / (-v0 * v5 * v7 - v1 * v3 * v8);
+
+		double n1 = l1 - det * (-v5 * v7 * r1 - v1 * v8 * r2 + v1 * v5 * r3);
+		double n2 = l2 - det * (-v3 * v8 * r1 + v0 * v8 * r2 - v0 * v5 * r3);
+		double n3 = l3 - det * (v3 * v7 * r1 - v0 * v7 * r2 - v1 * v3 * r3);
+
+		double s1 = n1 * n1 + n2 * n2 + b12 * n1 * n2 - a12;
+		double s2 = n1 * n1 + n3 * n3 + b13 * n1 * n3 - a13;
+		double s3 = n2 * n2 + n3 * n3 + b23 * n2 * n3 - a23;
+		if (fabs(s1) + fabs(s2) + fabs(s3) > err) {
+			break;
+		}
+		L[0] = n1;
+		L[1] = n2;
+		L[2] = n3;
+	}
+}
+
+// depths of the 1st point for +/-v, up to 2 solutions each
+int solveLambda(
+	double s, const double *V,
+	double a12, double a13, double a23, double b12, double b13, double b23,
+	double Ls[][3])
+{
+	double w2 = 1.0 / (s * V[1] - V[0]);
+	double w0 = (V[3] - s * V[4]) * w2;
+	double w1 = (V[6] - s * V[7]) * w2;
+
+	double a = 1.0 / ((a13 - a12) * w1 * w1 - a12 * b13 * w1 - a12);
+	double b = (a13 * b12 * w1 - a12 * b13 * w0 - 2.0 * w0 * w1 * (a12 - a13)) * a;
+	double c = ((a13 - a12) * w0 * w0 + a13 * b12 * w0 + a13) * a;
+
+	double tau[2];
+	if (!(b * b - 4.0 * c >= 0.0) || !root2real(b, c, tau[0], tau[1])) {
+		return 0;
+	}
+
+	int num = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		if (tau[i] > 0.0) {
+			double d = a23 / (tau[i] * (b23 + tau[i]) + 1.0);
+			if (d > 0.0) {
+				double l2 = sqrt(d);
+				double l3 = tau[i] * l2;
+				double l1 = w0 * l2 + w1 * l3;
+				if (l1 >= 0.0) {
+					Ls[num][0] = l1;
+					Ls[num][1] = l2;
+					Ls[num][2] = l3;
+					num++;
+				}
+			}
+		}
+	}
+
+	return num;
+}
+
+//=============================================================================
+// Small Matrix Utilities
+//=============================================================================
+// rotation matrix of an axis-angle vector
+void expRotation(const double *w, double *R)
+{
+	double theta2 = dot3(w, w);
+	double a, b;
+	if (theta2 < 1e-24) {
+		a = 1.0;
+		b = 0.5;
+	}
+	else {
+		double theta = sqrt(theta2);
+		a = sin(theta) / theta;
+		b = (1.0 - cos(theta)) / theta2;
+	}
+
+	R[0] = 1.0 - b * (w[1] * w[1] + w[2] * w[2]);
+	R[1] = -a * w[2] + b * w[0] * w[1];
+	R[2] = a * w[1] + b * w[0] * w[2];
+	R[3] = a * w[2] + b * w[0] * w[1];
+	R[4] = 1.0 - b * (w[0] * w[0] + w[2] * w[2]);
+	R[5] = -a * w[0] + b * w[1] * w[2];
+	R[6] = -a * w[1] + b * w[0] * w[2];
+	R[7] = a * w[0] + b * w[1] * w[2];
+	R[8] = 1.0 - b * (w[0] * w[0] + w[1] * w[1]);
+}
+
+bool isRotation(const double *R)
+{
+	double det =
+		R[0] * (R[4] * R[8] - R[5] * R[7]) -
+		R[1] * (R[3] * R[8] - R[5] * R[6]) +
+		R[2] * (R[3] * R[7] - R[4] * R[6]);
+	return fabs(det - 1.0) < 1e-3;
+}
+
+// solves H * d = -g, H is symmetric positive definite, lower half is used
+bool solveCholesky6(const double H[6][6], const double *g, double *d)
+{
+	double L[6][6];
+	for (int i = 0; i < 6; i++) {
+		for (int j = 0; j <= i; j++) {
+			double s = H[i][j];
+			for (int k = 0; k < j; k++) {
+				s -= L[i][k] * L[j][k];
+			}
+			if (i == j) {
+				if (s <= 0.0) {
+					return false;
+				}
+				L[i][i] = sqrt(s);
+			}
+			else {
+				L[i][j] = s / L[j][j];
+			}
+		}
+	}
+
+	double y[6];
+	for (int i = 0; i < 6; i++) {
+		double s = -g[i];
+		for (int k = 0; k < i; k++) {
+			s -= L[i][k] * y[k];
+		}
+		y[i] = s / L[i][i];
+	}
+	for (int i = 5; i >= 0; i--) {
+		double s = y[i];
+		for (int k = i + 1; k < 6; k++) {
+			s -= L[k][i] * d[k];
+		}
+		d[i] = s / L[i][i];
+	}
+
+	return true;
+}
+
+} // namespace
+
+//=============================================================================
+// P3P
+//-----------------------------------------------------------------------------
+// X: model points, y: bearing vectors of their images, both one per row.
+// Returns the number of solutions (up to 4).
+//=============================================================================
+int solveP3P(const double X[3][3], const double y[3][3], double R[4][9], double t[4][3])
+{
+	double y1[3], y2[3], y3[3];
+	double n1 = sqrt(dot3(y[0], y[0]));
+	double n2 = sqrt(dot3(y[1], y[1]));
+	double n3 = sqrt(dot3(y[2], y[2]));
+	for (int i = 0; i < 3; i++) {
+		y1[i] = y[0][i] / n1;
+		y2[i] = y[1][i] / n2;
+		y3[i] = y[2][i] / n3;
+	}
+
+	double b12 = -2.0 * dot3(y1, y2);
+	double b13 = -2.0 * dot3(y1, y3);
+	double b23 = -2.0 * dot3(y2, y3);
+
+	double d12[3], d13[3], d23[3], d12xd13[3];
+	for (int i = 0; i < 3; i++) {
+		d12[i] = X[0][i] - X[1][i];
+		d13[i] = X[0][i] - X[2][i];
+		d23[i] = X[1][i] - X[2][i];
+	}
+	cross3(d12, d13, d12xd13);
+
+	double a12 = dot3(d12, d12);
+	double a13 = dot3(d13, d13);
+	double a23 = dot3(d23, d23);
+
+	// cubic of the degenerate conic
+	double c31 = -0.5 * b13;
+	double c23 = -0.5 * b23;
+	double c12 = -0.5 * b12;
+	double blob = c12 * c23 * c31 - 1.0;
+	double s31_squared = 1.0 - c31 * c31;
+	double s23_squared = 1.0 - c23 * c23;
+	double s12_squared = 1.0 - c12 * c12;
+
+	double p3 = a13 * (a23 * s31_squared - a13 * s23_squared);
+	double p2 = 2.0 * blob * a23 * a13 + a13 * (2.0 * a12 + a13) * s23_squared + a23 * (a23 - a12) * s31_squared;
+	double p1 = a23 * (a13 - a23) * s12_squared - a12 * a12 * s23_squared - 2.0 * a12 * (blob * a23 + a13 * s23_squared);
+	double p0 = a12 * (a12 * s23_squared - a23 * s12_squared);
+	if (p3 == 0.0) {
+		return 0;
+	}
+	double g = cubick(p2 / p3, p1 / p3, p0 / p3);
+
+	double A[9];
+	A[0] = a23 * (1.0 - g);
+	A[1] = A[3] = (a23 * b12) * 0.5;
+	A[2] = A[6] = (a23 * b13 * g) * (-0.5);
+	A[4] = a23 - a12 + a13 * g;
+	A[5] = A[7] = b23 * (a13 * g - a12) * 0.5;
+	A[8] = g * (a13 - a23) - a12;
+
+	double V[9], L[3];
+	eigwithknown0(A, V, L);
+	double v = sqrt(std::max(0.0, -L[1] / L[0]));
+
+	double Ls[4][3];
+	int valid = solveLambda(v, V, a12, a13, a23, b12, b13, b23, Ls);
+	valid += solveLambda(-v, V, a12, a13, a23, b12, b13, b23, Ls + valid);
+
+	// rotation from the difference vectors, X is inverted once
+	double Mx[9] = {
+		d12[0], d13[0], d12xd13[0],
+		d12[1], d13[1], d12xd13[1],
+		d12[2], d13[2], d12xd13[2] };
+	double det =
+		Mx[0] * (Mx[4] * Mx[8] - Mx[5] * Mx[7]) -
+		Mx[1] * (Mx[3] * Mx[8] - Mx[5] * Mx[6]) +
+		Mx[2] * (Mx[3] * Mx[7] - Mx[4] * Mx[6]);
+	if (fabs(det) < 1e-12) {
+		return 0;
+	}
+	double id = 1.0 / det;
+	double Xi[9] = {
+		(Mx[4] * Mx[8] - Mx[5] * Mx[7]) * id, (Mx[2] * Mx[7] - Mx[1] * Mx[8]) * id, (Mx[1] * Mx[5] - Mx[2] * Mx[4]) * id,
+		(Mx[5] * Mx[6] - Mx[3] * Mx[8]) * id, (Mx[0] * Mx[8] - Mx[2] * Mx[6]) * id, (Mx[2] * Mx[3] - Mx[0] * Mx[5]) * id,
+		(Mx[3] * Mx[7] - Mx[4] * Mx[6]) * id, (Mx[1] * Mx[6] - Mx[0] * Mx[7]) * id, (Mx[0] * Mx[4] - Mx[1] * Mx[3]) * id };
+
+	int num = 0;
+	for (int k = 0; k < valid; k++)
+	{
+		refineLambda(Ls[k], a12, a13, a23, b12, b13, b23);
+
+		double ry1[3], ry2[3], ry3[3], yd1[3], yd2[3], yd1xd2[3];
+		for (int i = 0; i < 3; i++) {
+			ry1[i] = y1[i] * Ls[k][0];
+			ry2[i] = y2[i] * Ls[k][1];
+			ry3[i] = y3[i] * Ls[k][2];
+			yd1[i] = ry1[i] - ry2[i];
+			yd2[i] = ry1[i] - ry3[i];
+		}
+		cross3(yd1, yd2, yd1xd2);
+
+		double *Rk = R[num];
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				Rk[i * 3 + j] = yd1[i] * Xi[j] + yd2[i] * Xi[3 + j] + yd1xd2[i] * Xi[6 + j];
+			}
+		}
+		for (int i = 0; i < 3; i++) {
+			t[num][i] = ry1[i] - dot3(Rk + i * 3, X[0]);
+		}
+
+		if (std::isfinite(Rk[0] + Rk[4] + Rk[8] + t[num][0] + t[num][1] + t[num][2])) {
+			num++;
+		}
+	}
+
+	return num;
+}
+
+
+//=============================================================================
+// PnP RANSAC
+//=============================================================================
+PnPRansac::PnPRansac(const PNP_RANSAC_PARAM &param)
+{
+	_param = param;
+	_fx = _fy = 1.0;
+	_cx = _cy = 0.0;
+	_num = 0;
+}
+
+PnPRansac::~PnPRansac()
+{}
+
+void PnPRansac::setCamera(double fx, double fy, double cx, double cy)
+{
+	_fx = fx;
+	_fy = fy;
+	_cx = cx;
+	_cy = cy;
+}
+
+void PnPRansac::setPoints(
+	const cv::Point3f *objectPoints,
+	const cv::Point2f *imagePoints,
+	int num,
+	const float *quality)
+{
+	// the padding is never an inlier
+	_num = num;
+	int padded = (_num + 3) & ~3;
+	_X.assign(padded, 0.0f);
+	_Y.assign(padded, 0.0f);
+	_Z.assign(padded, 0.0f);
+	_u.assign(padded, FLT_MAX);
+	_v.assign(padded, FLT_MAX);
+	for (int i = 0; i < _num; i++) {
+		_X[i] = objectPoints[i].x;
+		_Y[i] = objectPoints[i].y;
+		_Z[i] = objectPoints[i].z;
+		_u[i] = imagePoints[i].x;
+		_v[i] = imagePoints[i].y;
+	}
+
+	_order.clear();
+	if (quality) {
+		_order.resize(_num);
+		for (int i = 0; i < _num; i++) {
+			_order[i] = i;
+		}
+		// stable order without the temporary buffer of std::stable_sort
+		std::sort(_order.begin(), _order.end(), [quality](int a, int b) {
+			return (quality[a] < quality[b]) || ((quality[a] == quality[b]) && (a < b));
+		});
+	}
+}
+
+//=============================================================================
+// SPRT Threshold
+//-----------------------------------------------------------------------------
+// J. Matas and O. Chum, "Randomized RANSAC with Sequential Probability Ratio
+// Test", ICCV 2005. The test is off while epsilon is not above delta.
+//=============================================================================
+void PnPRansac::updateSprt(SPRT &sprt) const
+{
+	double eps = std::min(sprt.epsilon, 0.99);
+	double delta = sprt.delta;
+	if (eps <= delta) {
+		sprt.logA = DBL_MAX;
+		sprt.logPass = 0.0f;
+		sprt.logFail = 0.0f;
+		return;
+	}
+
+	double C = (1.0 - delta) * log((1.0 - delta) / (1.0 - eps)) + delta * log(delta / eps);
+	double K = PNP_SPRT_MODEL_COST * C / PNP_SPRT_MODELS;
+	double A = K + 1.0;
+	for (int i = 0; i < 10; i++) {
+		A = K + 1.0 + log(A);
+	}
+
+	sprt.logA = log(A);
+	sprt.logPass = (float)log(delta / eps);
+	sprt.logFail = (float)log((1.0 - delta) / (1.0 - eps));
+}
+
+//=============================================================================
+// Verify a Pose
+//-----------------------------------------------------------------------------
+// Counts the points whose reprojection error is within the threshold, 4
+// points at a time. With "sprt", the verification stops as soon as the
+// likelihood ratio exceeds the threshold, "tested" is below the padded
+// size then.
+//=============================================================================
+int PnPRansac::verify(
+	const double R[9],
+	const double t[3],
+	float thr2,
+	const SPRT *sprt,
+	int *tested,
+	unsigned char *mask) const
+{
+	int n = (int)_X.size();
+	const float *X = _X.data();
+	const float *Y = _Y.data();
+	const float *Z = _Z.data();
+	const float *U = _u.data();
+	const float *V = _v.data();
+
+	float logA = sprt ? (float)std::min(sprt->logA, (double)FLT_MAX) : FLT_MAX;
+	float logPass = sprt ? sprt->logPass : 0.0f;
+	float logFail = sprt ? sprt->logFail : 0.0f;
+	float logL = 0.0f;
+	int count = 0;
+	int i = 0;
+
+#if CV_SIMD128
+	v_float32x4 r0 = v_setall_f32((float)R[0]), r1 = v_setall_f32((float)R[1]), r2 = v_setall_f32((float)R[2]);
+	v_float32x4 r3 = v_setall_f32((float)R[3]), r4 = v_setall_f32((float)R[4]), r5 = v_setall_f32((float)R[5]);
+	v_float32x4 r6 = v_setall_f32((float)R[6]), r7 = v_setall_f32((float)R[7]), r8 = v_setall_f32((float)R[8]);
+	v_float32x4 t0 = v_setall_f32((float)t[0]), t1 = v_setall_f32((float)t[1]), t2 = v_setall_f32((float)t[2]);
+	v_float32x4 fx = v_setall_f32((float)_fx), fy = v_setall_f32((float)_fy);
+	v_float32x4 cx = v_setall_f32((float)_cx), cy = v_setall_f32((float)_cy);
+	v_float32x4 thr = v_setall_f32(thr2), zero = v_setzero_f32(), one = v_setall_f32(1.0f);
+
+	while (i < n)
+	{
+		v_float32x4 x = v_load(X + i), y = v_load(Y + i), z = v_load(Z + i);
+		v_float32x4 xc = v_muladd(r0, x, v_muladd(r1, y, v_muladd(r2, z, t0)));
+		v_float32x4 yc = v_muladd(r3, x, v_muladd(r4, y, v_muladd(r5, z, t1)));
+		v_float32x4 zc = v_muladd(r6, x, v_muladd(r7, y, v_muladd(r8, z, t2)));
+		v_float32x4 iz = one / zc;
+		v_float32x4 du = v_muladd(fx * xc, iz, cx) - v_load(U + i);
+		v_float32x4 dv = v_muladd(fy * yc, iz, cy) - v_load(V + i);
+		v_float32x4 e = v_muladd(du, du, dv * dv);
+		int bits = v_signmask((e <= thr) & (zc > zero));
+		int k = (bits & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1);
+		if (mask) {
+			mask[i] = (unsigned char)(bits & 1);
+			mask[i + 1] = (unsigned char)((bits >> 1) & 1);
+			mask[i + 2] = (unsigned char)((bits >> 2) & 1);
+			mask[i + 3] = (unsigned char)((bits >> 3) & 1);
+		}
+		count += k;
+		i += 4;
+
+		logL += (float)k * logPass + (float)(4 - k) * logFail;
+		if (logL > logA) {
+			break;
+		}
+	}
+#else
+	float r[9], tt[3];
+	for (int j = 0; j < 9; j++) {
+		r[j] = (float)R[j];
+	}
+	for (int j = 0; j < 3; j++) {
+		tt[j] = (float)t[j];
+	}
+	float fx = (float)_fx, fy = (float)_fy, cx = (float)_cx, cy = (float)_cy;
+
+	while (i < n)
+	{
+		int k = 0;
+		for (int j = i; j < i + 4; j++) {
+			float xc = r[0] * X[j] + r[1] * Y[j] + r[2] * Z[j] + tt[0];
+			float yc = r[3] * X[j] + r[4] * Y[j] + r[5] * Z[j] + tt[1];
+			float zc = r[6] * X[j] + r[7] * Y[j] + r[8] * Z[j] + tt[2];
+			float iz = 1.0f / zc;
+			float du = fx * xc * iz + cx - U[j];
+			float dv = fy * yc * iz + cy - V[j];
+			int ok = (du * du + dv * dv <= thr2) && (zc > 0.0f);
+			if (mask) {
+				mask[j] = (unsigned char)ok;
+			}
+			k += ok;
+		}
+		count += k;
+		i += 4;
+
+		logL += (float)k * logPass + (float)(4 - k) * logFail;
+		if (logL > logA) {
+			break;
+		}
+	}
+#endif
+
+	if (tested) {
+		*tested = i;
+	}
+	return count;
+}
+
+//=============================================================================
+// Hypotheses from a Sample
+//=============================================================================
+int PnPRansac::hypotheses(const int *sample, double R[4][9], double t[4][3]) const
+{
+	double X[3][3], y[3][3];
+	for (int i = 0; i < 3; i++) {
+		int k = sample[i];
+		X[i][0] = _X[k];
+		X[i][1] = _Y[k];
+		X[i][2] = _Z[k];
+		y[i][0] = (_u[k] - _cx) / _fx;
+		y[i][1] = (_v[k] - _cy) / _fy;
+		y[i][2] = 1.0;
+	}
+
+	return solveP3P(X, y, R, t);
+}
+
+//=============================================================================
+// PROSAC Sampling
+//-----------------------------------------------------------------------------
+// O. Chum and J. Matas, "Matching with PROSAC - Progressive Sample
+// Consensus", CVPR 2005. The growth function only depends on the sample
+// number, so each stream follows it for its own samples.
+//=============================================================================
+void PnPRansac::initProsac(PROSAC &prosac) const
+{
+	prosac.subset = PNP_SAMPLE_SIZE;
+	prosac.Tn = PNP_PROSAC_SAMPLES;
+	for (int i = 0; i < PNP_SAMPLE_SIZE; i++) {
+		prosac.Tn *= (double)(prosac.subset - i) / (double)(_num - i);
+	}
+	prosac.TnPrime = 1;
+}
+
+void PnPRansac::drawSample(int iter, STREAM &stream, int *sample) const
+{
+	int first = 0;
+	int range = _num;
+	bool prosac = !_order.empty();
+	if (prosac) {
+		PROSAC &p = stream.prosac;
+		while ((iter > p.TnPrime) && (p.subset < _num)) {
+			double Tn1 = p.Tn * (double)(p.subset + 1) / (double)(p.subset + 1 - PNP_SAMPLE_SIZE);
+			p.TnPrime += (int)ceil(Tn1 - p.Tn);
+			p.Tn = Tn1;
+			p.subset++;
+		}
+		range = p.subset;
+		if (iter <= p.TnPrime) {
+			sample[0] = p.subset - 1;
+			first = 1;
+			range = p.subset - 1;
+		}
+	}
+
+	for (int i = first; i < PNP_SAMPLE_SIZE; i++) {
+		int j;
+		do {
+			sample[i] = stream.rng.uniform(0, range);
+			for (j = 0; j < i; j++) {
+				if (sample[j] == sample[i]) {
+					break;
+				}
+			}
+		} while (j < i);
+	}
+
+	if (prosac) {
+		for (int i = 0; i < PNP_SAMPLE_SIZE; i++) {
+			sample[i] = _order[sample[i]];
+		}
+	}
+}
+
+//=============================================================================
+// Verify the Hypotheses of a Sample
+//=============================================================================
+void PnPRansac::search(int iter, STREAM &stream, const SPRT &sprt, float thr2) const
+{
+	int sample[PNP_SAMPLE_SIZE];
+	drawSample(iter, stream, sample);
+
+	int padded = (int)_X.size();
+	double Rs[4][9], ts[4][3];
+	int num = hypotheses(sample, Rs, ts);
+	for (int k = 0; k < num; k++)
+	{
+		int tested;
+		int count = verify(Rs[k], ts[k], thr2, &sprt, &tested, nullptr);
+		if (tested < padded) {
+			// rejected, the ratio among the tested points estimates delta
+			stream.deltaSum += (double)count / tested;
+			stream.numRejected++;
+		}
+		else if (count > stream.count) {
+			stream.count = count;
+			std::copy(Rs[k], Rs[k] + 9, stream.R);
+			std::copy(ts[k], ts[k] + 3, stream.t);
+		}
+	}
+}
+
+bool isCancelled(const PNP_CANCEL *cancel)
+{
+	if (cancel == nullptr) {
+		return false;
+	}
+	if ((cancel->bestRank != nullptr) && (*cancel->bestRank < cancel->rank)) {
+		return true;
+	}
+	return std::chrono::steady_clock::now() > cancel->deadline;
+}
+
+//=============================================================================
+// RANSAC
+//-----------------------------------------------------------------------------
+// "R" and "t" are the initial pose if "useGuess", it is scored before the
+// samples. The best pose is refined on its inliers.
+//=============================================================================
+bool PnPRansac::compute(double R[9], double t[3], bool useGuess, ArenaVector<int> &inliers) const
+{
+	inliers.clear();
+	if (_num <= PNP_SAMPLE_SIZE) {
+		return false;
+	}
+
+	float thr2 = _param.reprojError * _param.reprojError;
+	double bestR[9], bestT[3];
+	int bestCount = 0;
+	int niters = _param.maxIterations;
+
+	if (useGuess && isRotation(R)) {
+		bestCount = verify(R, t, thr2, nullptr, nullptr, nullptr);
+		std::copy(R, R + 9, bestR);
+		std::copy(t, t + 3, bestT);
+		niters = cv3::RANSACUpdateNumIters(_param.confidence, (double)(_num - bestCount) / _num, PNP_SAMPLE_SIZE, niters);
+	}
+
+	SPRT sprt;
+	sprt.epsilon = std::max(0.1, (double)bestCount / _num);
+	sprt.delta = 0.05;
+	updateSprt(sprt);
+	double deltaSum = 0.0;
+	int numRejected = 0;
+	int lastUpdate = 0;
+
+	int numStreams = std::max(1, _param.numStreams);
+	ArenaVector<STREAM> streams(numStreams);
+	for (int s = 0; s < numStreams; s++) {
+		streams[s].rng = cv::RNG(_param.seed + (uint64)s * PNP_STREAM_STRIDE);
+		initProsac(streams[s].prosac);
+	}
+
+	// state shared by the streams of a round, the task captures two
+	// pointers only, so it is not copied to the heap
+	struct ROUND {
+		STREAM *streams;
+		int bestCount;
+		int first;
+		int last;
+		SPRT sprt;
+		float thr2;
+	} round;
+	round.streams = streams.data();
+	round.thr2 = thr2;
+	std::function<void(int)> task = [this, &round](int s) {
+		STREAM &stream = round.streams[s];
+		stream.count = round.bestCount;
+		stream.deltaSum = 0.0;
+		stream.numRejected = 0;
+		int begin = round.first + s * PNP_STREAM_BATCH;
+		int end = std::min(begin + PNP_STREAM_BATCH - 1, round.last);
+		for (int iter = begin; iter <= end; iter++) {
+			search(iter, stream, round.sprt, round.thr2);
+		}
+	};
+
+	// sample "iter" of a round belongs to stream (iter - first) / batch
+	for (int first = 1; first <= niters; first += numStreams * PNP_STREAM_BATCH)
+	{
+		if (isCancelled(_param.cancel)) {
+			return false;
+		}
+
+		round.bestCount = bestCount;
+		round.first = first;
+		round.last = niters;
+		round.sprt = sprt;
+		threadPool.parallelFor(numStreams, task);
+
+		// merge in stream order, the best model shortens all streams
+		for (int s = 0; s < numStreams; s++)
+		{
+			const STREAM &stream = streams[s];
+			deltaSum += stream.deltaSum;
+			numRejected += stream.numRejected;
+			if (stream.count > bestCount) {
+				bestCount = stream.count;
+				std::copy(stream.R, stream.R + 9, bestR);
+				std::copy(stream.t, stream.t + 3, bestT);
+			}
+		}
+
+		double eps = (double)bestCount / _num;
+		bool update = false;
+		if (eps > sprt.epsilon) {
+			sprt.epsilon = eps;
+			update = true;
+			niters = cv3::RANSACUpdateNumIters(_param.confidence, 1.0 - eps, PNP_SAMPLE_SIZE, niters);
+		}
+		if (numRejected - lastUpdate >= PNP_SPRT_UPDATE) {
+			sprt.delta = std::min(std::max(deltaSum / numRejected, 0.001), 0.5);
+			lastUpdate = numRejected;
+			update = true;
+		}
+		if (update) {
+			updateSprt(sprt);
+		}
+	}
+
+	if (bestCount <= PNP_SAMPLE_SIZE) {
+		return false;
+	}
+
+	// refine on the inliers, kept only if the support does not decrease
+	ArenaVector<int> bestInliers;
+	score(bestR, bestT, _param.reprojError, &bestInliers, nullptr);
+	std::copy(bestR, bestR + 9, R);
+	std::copy(bestT, bestT + 3, t);
+	refine(R, t, bestInliers, _param.refineIterations);
+	if (score(R, t, _param.reprojError, &inliers, nullptr) < (int)bestInliers.size()) {
+		std::copy(bestR, bestR + 9, R);
+		std::copy(bestT, bestT + 3, t);
+		inliers.swap(bestInliers);
+	}
+
+	return true;
+}
+
+//=============================================================================
+// Inliers and their reprojection errors [px]
+//=============================================================================
+int PnPRansac::score(
+	const double R[9],
+	const double t[3],
+	float threshold,
+	ArenaVector<int> *inliers,
+	ArenaVector<float> *err) const
+{
+	ArenaVector<unsigned char> mask(_X.size());
+	int count = verify(R, t, threshold * threshold, nullptr, nullptr, mask.data());
+
+	if (inliers) {
+		inliers->clear();
+		inliers->reserve(count);
+	}
+	if (err) {
+		err->clear();
+		err->reserve(count);
+	}
+	for (int i = 0; i < _num; i++)
+	{
+		if (!mask[i]) {
+			continue;
+		}
+		if (inliers) {
+			inliers->push_back(i);
+		}
+		if (err) {
+			double xc = R[0] * _X[i] + R[1] * _Y[i] + R[2] * _Z[i] + t[0];
+			double yc = R[3] * _X[i] + R[4] * _Y[i] + R[5] * _Z[i] + t[1];
+			double zc = R[6] * _X[i] + R[7] * _Y[i] + R[8] * _Z[i] + t[2];
+			double du = _fx * xc / zc + _cx - _u[i];
+			double dv = _fy * yc / zc + _cy - _v[i];
+			err->push_back((float)sqrt(du * du + dv * dv));
+		}
+	}
+
+	return count;
+}
+
+//=============================================================================
+// Gauss-Newton Refinement
+//-----------------------------------------------------------------------------
+// Minimizes the reprojection error of the given points. The update is
+// applied on the left, R <- exp(w) * R, t <- exp(w) * t + v. Stops when
+// the error increases, the step is negligible or after "iterations".
+//=============================================================================
+void PnPRansac::refine(double R[9], double t[3], const ArenaVector<int> &inliers, int iterations) const
+{
+	double prevR[9], prevT[3];
+	double prevCost = DBL_MAX;
+
+	for (int iter = 0; iter <= iterations; iter++)
+	{
+		double H[6][6] = { { 0.0 } };
+		double g[6] = { 0.0 };
+		double cost = 0.0;
+		for (int n = 0; n < (int)inliers.size(); n++)
+		{
+			int i = inliers[n];
+			double xc = R[0] * _X[i] + R[1] * _Y[i] + R[2] * _Z[i] + t[0];
+			double yc = R[3] * _X[i] + R[4] * _Y[i] + R[5] * _Z[i] + t[1];
+			double zc = R[6] * _X[i] + R[7] * _Y[i] + R[8] * _Z[i] + t[2];
+			if (zc <= 0.0) {
+				continue;
+			}
+
+			double iz = 1.0 / zc;
+			double px = xc * iz;
+			double py = yc * iz;
+			double ru = _fx * px + _cx - _u[i];
+			double rv = _fy * py + _cy - _v[i];
+			double ju[6] = { -_fx * px * py, _fx * (1.0 + px * px), -_fx * py, _fx * iz, 0.0, -_fx * px * iz };
+			double jv[6] = { -_fy * (1.0 + py * py), _fy * px * py, _fy * px, 0.0, _fy * iz, -_fy * py * iz };
+			for (int a = 0; a < 6; a++) {
+				g[a] += ju[a] * ru + jv[a] * rv;
+				for (int b = 0; b <= a; b++) {
+					H[a][b] += ju[a] * ju[b] + jv[a] * jv[b];
+				}
+			}
+			cost += ru * ru + rv * rv;
+		}
+
+		if (cost > prevCost) {
+			std::copy(prevR, prevR + 9, R);
+			std::copy(prevT, prevT + 3, t);
+			break;
+		}
+		if (iter == iterations) {
+			break;
+		}
+		std::copy(R, R + 9, prevR);
+		std::copy(t, t + 3, prevT);
+		prevCost = cost;
+
+		double d[6];
+		if (!solveCholesky6(H, g, d)) {
+			break;
+		}
+
+		double dR[9];
+		expRotation(d, dR);
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				R[i * 3 + j] = dR[i * 3] * prevR[j] + dR[i * 3 + 1] * prevR[3 + j] + dR[i * 3 + 2] * prevR[6 + j];
+			}
+			t[i] = dR[i * 3] * prevT[0] + dR[i * 3 + 1] * prevT[1] + dR[i * 3 + 2] * prevT[2] + d[3 + i];
+		}
+
+		if (dot3(d, d) + dot3(d + 3, d + 3) < 1e-20) {
+			break;
+		}
+	}
+}
@@ -3,28 +3,55 @@
 // SPDX-License-Identifier: MIT
 //=============================================================================
 #include <core/Registration.h>
+#include <opencv2/core/hal/hal.hpp>
+#include <limits.h>
+#include <float.h>
+#include <string.h>
+
+#define REG_NNDR			0.8f	// nearest neighbor distance ratio
+
+//==================================================================
+// Match buffers on the frame arena for up to "capacity" pairs.
+//==================================================================
+static void allocMatches(MATCHES &matches, int capacity)
+{
+	Arena &arena = Arena::local();
+	matches.num = 0;
+	matches.from = arena.alloc<int>(capacity);
+	matches.to = arena.alloc<int>(capacity);
+	matches.ratio = arena.alloc<float>(capacity);
+}
 
 //==================================================================
 // Compute transformation between "from" and "to" images.
 //==================================================================
 Transform computeTransform(
-	SensorData sensorFrom,
-	SensorData sensorTo,
+	const SensorData &sensorFrom,
+	const SensorData &sensorTo,
 	Transform guess,
-	struct REG_INFO *info)
+	struct REG_INFO *info,
+	float guessWinSize,
+	const PNP_CANCEL *cancel)
 {
-	// search matched index pair <from:to>
-	std::multimap<int, int> matchedIndex;
+	// search matched index pairs <from:to>
+	// and their NNDR ratios to order the PnP samples
+	MATCHES matches;
 	if (guess.isNull()) {
 		// no guessing information at 1st odometry and LC detection
-		matchingNoGuess(sensorFrom, sensorTo, matchedIndex);
+		matchingNoGuess(sensorFrom, sensorTo, matches);
 	}
 	else {
-		matchingGuess(sensorFrom, sensorTo, guess, matchedIndex);
+		matchingGuess(sensorFrom, sensorTo, guess, matches, guessWinSize);
 	}
 
 	Transform t;
-	estimateMotion(sensorFrom, sensorTo, guess, t, info, matchedIndex);
+	if (isCancelled(cancel)) {
+		info->num_inliers = 0;
+		info->num_matches = matches.num;
+		info->inlierIndex.clear();
+		return t;
+	}
+	estimateMotion(sensorFrom, sensorTo, guess, t, info, matches, cancel);
 
 	return t;
 }
@@ -32,212 +59,157 @@ Transform computeTransform(
 //==================================================================
 // Projects 3D coordinates of the keypoints in "from" image 
 // onto "to" image plane using guessing information.
+// Returns the number of points inside the image.
 //==================================================================
-void matchingGuess_Projection(
-	std::vector<cv::Point3f> kptsFrom3D,
-	std::vector<cv::Point2f> &projectedPoint,
-	std::vector<int> &projectedIndex,
-	StereoCameraModel cameraModel,
-	Transform guess)
+int matchingGuess_Projection(
+	const std::vector<cv::Point3f> &kptsFrom3D,
+	cv::Point2f *projectedPoint,
+	int *projectedIndex,
+	const StereoCameraModel &cameraModel,
+	const Transform &guess)
 {
 	Transform guessCameraRef = (guess * cameraModel.localTransform()).inverse();
-
-	// rotation matrix R, translation vector tvec, distortion coeffs K
-	cv::Mat R = (cv::Mat_<double>(3, 3) <<
-		(double)guessCameraRef.r11(), (double)guessCameraRef.r12(), (double)guessCameraRef.r13(),
-		(double)guessCameraRef.r21(), (double)guessCameraRef.r22(), (double)guessCameraRef.r23(),
-		(double)guessCameraRef.r31(), (double)guessCameraRef.r32(), (double)guessCameraRef.r33());
-	cv::Mat rvec(1, 3, CV_64FC1);
-	cv::Rodrigues(R, rvec);
-	cv::Mat tvec = (cv::Mat_<double>(1, 3) << (double)guessCameraRef.x(), (double)guessCameraRef.y(), (double)guessCameraRef.z());
-	cv::Mat K = cameraModel.K_l();
-
-	// projects 3D coords of the key points in "from" image 
-	// onto "to" image plane
-	std::vector<cv::Point2f> projected;
-	cv::projectPoints(kptsFrom3D, rvec, tvec, K, cv::Mat(), projected);
-
-	// remove the points outside of the valid image area
-	for (int i = 0; i < (int)projected.size(); i++)
+	double fx = cameraModel.fx_l();
+	double fy = cameraModel.fy_l();
+	double cx = cameraModel.cx_l();
+	double cy = cameraModel.cy_l();
+	float width = (float)(cameraModel.imageSize().width - 1);
+	float height = (float)(cameraModel.imageSize().height - 1);
+
+	// pinhole projection, the points outside of the valid image
+	// area or behind the camera are removed
+	int num = 0;
+	for (int i = 0; i < (int)kptsFrom3D.size(); i++)
 	{
-		if (
-			(0.0f < projected[i].x) && (projected[i].x < cameraModel.imageSize().width - 1) &&
-			(0.0f < projected[i].y) && (projected[i].y < cameraModel.imageSize().height - 1) &&
-			(transformPoint(kptsFrom3D[i], guessCameraRef).z > 0.0))
+		cv::Point3f pt = transformPoint(kptsFrom3D[i], guessCameraRef);
+		if (pt.z > 0.0f)
 		{
-			projectedIndex.push_back(i);
-			projectedPoint.push_back(projected[i]);
+			float u = (float)(fx * pt.x / pt.z + cx);
+			float v = (float)(fy * pt.y / pt.z + cy);
+			if ((0.0f < u) && (u < width) && (0.0f < v) && (v < height))
+			{
+				projectedIndex[num] = i;
+				projectedPoint[num] = cv::Point2f(u, v);
+				num++;
+			}
 		}
 	}
 
-	return;
+	return num;
 }
 
 //--------------------------------------------------------------
-// Apply radius search between keypoints in the image pair.
-// The distance here is in unit of pixels.
+// Bucket the keypoints of "to" image in cells of "cellSize"
+// pixels, a radius search of up to "cellSize" visits 3x3 cells.
 //--------------------------------------------------------------
-void matchingGuess_radiusSearch(
-	std::vector<cv::KeyPoint> kptsTo,
-	std::vector<cv::Point2f> projectedPoint,
-	std::vector<std::vector<int>> &indices)
+void matchingGuess_Grid(
+	const std::vector<cv::Point2f> &kptsTo,
+	const cv::Size &imageSize,
+	float cellSize,
+	KPTS_GRID &grid)
 {
-	// convert to cv::Mat format
-	cv::Mat matKptsTo = cv::Mat((int)kptsTo.size(), 2, CV_32FC1);
-	for (int i = 0; i < (int)kptsTo.size(); i++) {
-		matKptsTo.at<float>(i, 0) = (float)kptsTo[i].pt.x;
-		matKptsTo.at<float>(i, 1) = (float)kptsTo[i].pt.y;
+	Arena &arena = Arena::local();
+	int num = (int)kptsTo.size();
+	grid.cellSize = cellSize;
+	grid.cols = (int)(imageSize.width / cellSize) + 1;
+	grid.rows = (int)(imageSize.height / cellSize) + 1;
+	int numCells = grid.cols * grid.rows;
+	grid.start = arena.alloc<int>(numCells + 1);
+	grid.items = arena.alloc<int>(num);
+	int *cell = arena.alloc<int>(num);
+
+	// counting sort by cell, keeps the keypoint order in a cell
+	memset(grid.start, 0, (numCells + 1) * sizeof(int));
+	for (int i = 0; i < num; i++) {
+		int x = std::min(std::max((int)(kptsTo[i].x / cellSize), 0), grid.cols - 1);
+		int y = std::min(std::max((int)(kptsTo[i].y / cellSize), 0), grid.rows - 1);
+		cell[i] = y * grid.cols + x;
+		grid.start[cell[i] + 1]++;
 	}
-
-	cv::Mat matProjectedPoint = cv::Mat((int)projectedPoint.size(), 2, CV_32FC1);
-	for (int i = 0; i < (int)projectedPoint.size(); i++) {
-		matProjectedPoint.at<float>(i, 0) = (float)projectedPoint[i].x;
-		matProjectedPoint.at<float>(i, 1) = (float)projectedPoint[i].y;
+	for (int c = 0; c < numCells; c++) {
+		grid.start[c + 1] += grid.start[c];
 	}
-
-	//---------------------------------------------------------
-	// radius match
-	//---------------------------------------------------------
-	// std::vector<std::vector<cv::DMatch>> matchesRadius
-	//   N x M, where N is the number of elements, M is points
-	//   whose distance is shorter than guessWinSize.
-	// cv::Dmatch
-	//   float distance
-	//   int imgIdx   // train image index
-	//   int queryIdx // query descriptor index
-	//   int trainIdx // train descriptor index
-	//---------------------------------------------------------
-	cv::BFMatcher cv_matcher(cv::NORM_L2);
-	std::vector<std::vector<cv::DMatch>> matchesRadius;
-	float guessWinSize = 40.0f;
-	cv_matcher.radiusMatch(matProjectedPoint, matKptsTo, matchesRadius, guessWinSize);
-
-	//---------------------------------------------------------
-	// rearrange matching result in std::vector
-	//---------------------------------------------------------
-	// std::vector<std::vector<int>> indices
-	//   N x M, index of matched descriptor
-	//---------------------------------------------------------
-	for (int i = 0; i < (int)matchesRadius.size(); i++) {
-		std::vector<int> vec_trainIdx;
-		for (int j = 0; j < (int)matchesRadius[i].size(); j++) {
-			vec_trainIdx.push_back(matchesRadius[i][j].trainIdx);
-		}
-		indices.push_back(vec_trainIdx);
+	int *fill = arena.alloc<int>(numCells);
+	memcpy(fill, grid.start, numCells * sizeof(int));
+	for (int i = 0; i < num; i++) {
+		grid.items[fill[cell[i]]++] = i;
 	}
-
-	return;
 }
 
-void matchingGuess_Nndr(
-	cv::Mat descriptorsFrom,
-	cv::Mat descriptorsTo,
-	std::vector<int> projectedIndex,
-	std::vector<cv::Point2f> projectedPoint,
-	std::vector<std::vector<int>> indices,
-	std::multimap<int, int> &matchedIndex)
+//--------------------------------------------------------------
+// Find the most similar "to" descriptor among the keypoints
+// within the search radius around the projected point.
+// Equal descriptor distances are decided by the pixel distance.
+// "ratio" receives the NNDR ratio of the match, a single
+// candidate is rated at the NNDR threshold.
+//---------------------------------------------------------------
+int matchingGuess_search(
+	const unsigned char *descriptorFrom,
+	const cv::Mat &descriptorsTo,
+	const std::vector<cv::Point2f> &kptsTo,
+	const KPTS_GRID &grid,
+	const cv::Point2f &projectedPoint,
+	float *ratio)
 {
-	//--------------------------------------------------------------
-	// Apply NNDR
-	//--------------------------------------------------------------
-	std::set<int> addedIndex;
-	cv::Mat descriptors(10, descriptorsTo.cols, descriptorsTo.type());
-	for (int i = 0; i < (int)projectedPoint.size(); i++)
+	float radius2 = grid.cellSize * grid.cellSize;
+	int cx = (int)(projectedPoint.x / grid.cellSize);
+	int cy = (int)(projectedPoint.y / grid.cellSize);
+
+	int numCandidates = 0;
+	int best = -1;
+	int bestDist = INT_MAX;
+	int secondDist = INT_MAX;
+	float bestPixel = FLT_MAX;
+	for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, grid.rows - 1); y++)
 	{
-		// index of matched keypoints in "from" image
-		int matchedIndexFrom = projectedIndex[i];
-
-		//--------------------------------------------------------------
-		// Find the most matched descriptor in "to" image.
-		//--------------------------------------------------------------
-		int matchedIndexTo = -1;
-		if (indices[i].size() >= 2)
+		for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, grid.cols - 1); x++)
 		{
-			// copy matched "to" descriptor
-			std::vector<int> descriptorsIndices(indices[i].size());
-			int num = 0;
-			if ((int)indices[i].size() > descriptors.rows) {
-				descriptors.resize(indices[i].size());
-			}
-
-			for (int j = 0; j < (int)indices[i].size(); j++)
+			int c = y * grid.cols + x;
+			for (int n = grid.start[c]; n < grid.start[c + 1]; n++)
 			{
-				descriptorsTo.row(indices[i].at(j)).copyTo(descriptors.row(num));
-				descriptorsIndices[num] = indices[i].at(j);
-				num++;
-			}
-
-			// bruteforce knn
-			cv::BFMatcher matcher(cv::NORM_HAMMING, 0);
-			std::vector<std::vector<cv::DMatch>> matchesKnn;
-			matcher.knnMatch(descriptorsFrom.row(matchedIndexFrom), cv::Mat(descriptors, cv::Range(0, num)), matchesKnn, 2);
-			float nndr = 0.8f;
-			if (matchesKnn[0].at(0).distance < nndr * matchesKnn[0].at(1).distance) {
-				matchedIndexTo = descriptorsIndices.at(matchesKnn[0].at(0).trainIdx);
+				int j = grid.items[n];
+				float dx = kptsTo[j].x - projectedPoint.x;
+				float dy = kptsTo[j].y - projectedPoint.y;
+				float pixel = dx * dx + dy * dy;
+				if (pixel >= radius2) {
+					continue;
+				}
+
+				// 2 nearest neighbors in Hamming distance
+				int dist = cv::hal::normHamming(descriptorFrom, descriptorsTo.ptr<unsigned char>(j), descriptorsTo.cols);
+				if ((dist < bestDist) || ((dist == bestDist) && (pixel < bestPixel))) {
+					secondDist = bestDist;
+					bestDist = dist;
+					bestPixel = pixel;
+					best = j;
+				}
+				else if (dist < secondDist) {
+					secondDist = dist;
+				}
+				numCandidates++;
 			}
 		}
-		else if (indices[i].size() == 1)
-		{
-			matchedIndexTo = indices[i].at(0);
-		}
-
-		//--------------------------------------------------------------
-		// index of matching pair
-		//--------------------------------------------------------------
-		if (matchedIndexTo >= 0 &&
-			addedIndex.find(matchedIndexTo) == addedIndex.end())
-		{
-			addedIndex.insert(matchedIndexTo);
-			matchedIndex.insert(matchedIndex.end(), std::make_pair(matchedIndexFrom, matchedIndexTo));
-		}
 	}
 
-	return;
-}
-
-//--------------------------------------------------------------
-// Find the most similar "to" descriptor in "from" image.
-//---------------------------------------------------------------
-int matchingGuess_search (
-	cv::Mat descriptorFrom,
-	cv::Mat descriptorsTo,
-	std::vector<int> indices)
-{
-	int matchedIndexTo;
-	if (indices.size() == 1)
+	int matchedIndexTo = -1;
+	if (numCandidates == 1)
 	{
-		matchedIndexTo = indices.at(0);
+		matchedIndexTo = best;
+		if (ratio) {
+			*ratio = REG_NNDR;
+		}
 	}
-	else if (indices.size() >= 2)
+	else if (numCandidates >= 2)
 	{
-		// copy descriptors that were hit during radius search
-		cv::Mat train((int)indices.size(), descriptorsTo.cols, descriptorsTo.type());
-		std::vector<int> descriptorsIndex(indices.size());
-		for (int i = 0; i < (int)indices.size(); i++)
-		{
-			descriptorsTo.row(indices[i]).copyTo(train.row(i));
-			descriptorsIndex[i] = indices[i];
-		}
-
-		// bruteforce KNN where K = 2
-		cv::BFMatcher matcher(cv::NORM_HAMMING, 0);
-		std::vector<std::vector<cv::DMatch>> matchesKnn;
-		matcher.knnMatch(descriptorFrom, train, matchesKnn, 2);
-
 		// apply NNDR
-		float nndr = 0.8f;
-		if (matchesKnn[0][0].distance < nndr * matchesKnn[0][1].distance)
+		if (bestDist < REG_NNDR * secondDist)
 		{
-			// index of the most similar "to" descriptor
-			matchedIndexTo = descriptorsIndex[matchesKnn[0][0].trainIdx];
-		}
-		else {
-			matchedIndexTo = -1;
+			matchedIndexTo = best;
+			if (ratio) {
+				*ratio = (float)bestDist / (float)secondDist;
+			}
 		}
 	}
-	else {
-		matchedIndexTo = -1;
-	}
 
 	return matchedIndexTo;
 }
@@ -248,48 +220,59 @@ int matchingGuess_search (
 //! @brief Matching with guessing information
 //=============================================================================
 void matchingGuess(
-	SensorData sensorFrom,
-	SensorData sensorTo,
-	Transform guess,
-	std::multimap<int, int> &matchedIndex)
+	const SensorData &sensorFrom,
+	const SensorData &sensorTo,
+	const Transform &guess,
+	MATCHES &matches,
+	float guessWinSize)
 {
-	const std::vector<cv::KeyPoint> &kptsTo = sensorTo.keypoints();
+	Arena &arena = Arena::local();
+	const std::vector<cv::Point2f> &kptsTo = sensorTo.points();
 	const std::vector<cv::Point3f> &kptsFrom3D = sensorFrom.keypoints3D();
-	cv::Mat descriptorsFrom = sensorFrom.descriptors();
-	cv::Mat descriptorsTo = sensorTo.descriptors();
+	const cv::Mat &descriptorsFrom = sensorFrom.descriptors();
+	const cv::Mat &descriptorsTo = sensorTo.descriptors();
 
 	// project 3D coordinates of the keypoints in "from" image 
 	// onto "to" image plane using guessing information
-	std::vector<int> projectedIndex;
-	std::vector<cv::Point2f> projectedPoint;
-	matchingGuess_Projection(kptsFrom3D, projectedPoint, projectedIndex, sensorTo.stereoCameraModel(), guess);
+	int *projectedIndex = arena.alloc<int>(kptsFrom3D.size());
+	cv::Point2f *projectedPoint = arena.alloc<cv::Point2f>(kptsFrom3D.size());
+	int numProjected = matchingGuess_Projection(kptsFrom3D, projectedPoint, projectedIndex, sensorTo.stereoCameraModel(), guess);
+
+	allocMatches(matches, numProjected);
 
 	// match keypoints between pair of images
-	if (projectedPoint.size())
+	if (numProjected)
 	{
-		// apply radius search to reduce the number of candidates
-		std::vector<std::vector<int>> indices;
-		matchingGuess_radiusSearch(kptsTo, projectedPoint, indices);
+		// bucket the keypoints to reduce the number of candidates
+		KPTS_GRID grid;
+		matchingGuess_Grid(kptsTo, sensorTo.stereoCameraModel().imageSize(), guessWinSize, grid);
 
 		// find matched keypoints
-		std::set<int> addedIndex;
-		for (int i = 0; i < (int)projectedPoint.size(); i++)
+		unsigned char *added = arena.alloc<unsigned char>(kptsTo.size());
+		memset(added, 0, kptsTo.size());
+		for (int i = 0; i < numProjected; i++)
 		{
 			// index of matched keypoints in "from" image
 			int matchedIndexFrom = projectedIndex[i];
 
 			// paired index in "to" image
+			float ratio;
 			int matchedIndexTo = matchingGuess_search(
-				descriptorsFrom.row(matchedIndexFrom),
+				descriptorsFrom.ptr<unsigned char>(matchedIndexFrom),
 				descriptorsTo,
-				indices[i]);
+				kptsTo,
+				grid,
+				projectedPoint[i],
+				&ratio);
 
 			// store the pair of matched indices
-			if (matchedIndexTo >= 0 &&
-				addedIndex.find(matchedIndexTo) == addedIndex.end())
+			if (matchedIndexTo >= 0 && !added[matchedIndexTo])
 			{
-				addedIndex.insert(matchedIndexTo);
-				matchedIndex.insert(matchedIndex.end(), std::make_pair(matchedIndexFrom, matchedIndexTo));
+				added[matchedIndexTo] = 1;
+				matches.from[matches.num] = matchedIndexFrom;
+				matches.to[matches.num] = matchedIndexTo;
+				matches.ratio[matches.num] = ratio;
+				matches.num++;
 			}
 			else {
 				// no match or multiple matches found
@@ -308,60 +291,103 @@ void matchingGuess(
 //-----------------------------------------------------------------------------
 //! @brief Matching without guessing information
 //=============================================================================
-void matchingNoGuess(SensorData sensorFrom, SensorData sensorTo, std::multimap<int, int> &matchedIndex)
+void matchingNoGuess(
+	const SensorData &sensorFrom,
+	const SensorData &sensorTo,
+	MATCHES &matches)
 {
-	cv::Mat descriptorsFrom = sensorFrom.descriptors();
-	cv::Mat descriptorsTo = sensorTo.descriptors();
-
-	// search the most similar "to" descriptors in "from" image by brute force
-	// KNN where K = 2
-	cv::BFMatcher matcher(cv::NORM_HAMMING, 0);
-	std::vector<std::vector<cv::DMatch>> matches;
-	matcher.knnMatch(descriptorsFrom, descriptorsTo, matches, 2);
+	const cv::Mat &descriptorsFrom = sensorFrom.descriptors();
+	const cv::Mat &descriptorsTo = sensorTo.descriptors();
+	int numFrom = descriptorsFrom.rows;
+	int numTo = descriptorsTo.rows;
+
+	allocMatches(matches, numFrom);
+	if (numTo < 2) {
+		return;
+	}
 
-	std::set<int> alreadyAdded;
-	for (int i = 0; i < (int)matches.size(); ++i)
+	unsigned char *added = Arena::local().alloc<unsigned char>(numTo);
+	memset(added, 0, numTo);
+	for (int i = 0; i < numFrom; ++i)
 	{
-		// apply NNDR, remove multiples
-		float nndrRatio = 0.8f;
-		if (matches[i][0].distance < nndrRatio * matches[i][1].distance)
+		// search the most similar "to" descriptors by brute force
+		// KNN where K = 2
+		const unsigned char *desc = descriptorsFrom.ptr<unsigned char>(i);
+		int best = -1;
+		int bestDist = INT_MAX;
+		int secondDist = INT_MAX;
+		for (int j = 0; j < numTo; j++)
 		{
-			if (alreadyAdded.find(matches[i][0].trainIdx) == alreadyAdded.end()) {
-				alreadyAdded.insert(matches[i][0].trainIdx);
-				matchedIndex.insert(matchedIndex.end(), std::make_pair(i, matches[i][0].trainIdx));
+			int dist = cv::hal::normHamming(desc, descriptorsTo.ptr<unsigned char>(j), descriptorsTo.cols);
+			if (dist < bestDist) {
+				secondDist = bestDist;
+				bestDist = dist;
+				best = j;
+			}
+			else if (dist < secondDist) {
+				secondDist = dist;
 			}
 		}
+
+		// apply NNDR, remove multiples
+		if (bestDist < REG_NNDR * secondDist && !added[best])
+		{
+			added[best] = 1;
+			matches.from[matches.num] = i;
+			matches.to[matches.num] = best;
+			matches.ratio[matches.num] = (float)bestDist / (float)secondDist;
+			matches.num++;
+		}
 	}
 }
 
 void estimateMotion(
-	SensorData sensorFrom,
-	SensorData sensorTo,
-	Transform guess,
+	const SensorData &sensorFrom,
+	const SensorData &sensorTo,
+	const Transform &guess,
 	Transform &transform,
 	REG_INFO *reg_info,
-	std::multimap<int, int> matchedIndex)
+	const MATCHES &matches,
+	const PNP_CANCEL *cancel)
 {
 	//==================================================================
-	// Set 2D and 3D coords for VWs that are mathced in image pairs.
+	// Gather the coords of the matched keypoints with valid 3D coords
+	// in "from" image, index aligned.
 	//------------------------------------------------------------------
-	// std::map<int, cv::Point3f> words3A
-	//   VW IDs and 3D coords of keypoints in "from" image.
-	// std::map<int, cv::KeyPoint> wordsB
-	//   VW IDs and 2D coords of keypoints in "to" image.
-	// std::map<int, cv::Point3f> words3B
-	//   VW IDs and 3D coords of keypoints in "to" image.
+	// objectPoints
+	//   3D coords of the keypoints in "from" image.
+	// imagePoints
+	//   2D coords of the keypoints in "to" image.
+	// objectPointsB
+	//   3D coords of the keypoints in "to" image.
+	// matchIndex
+	//   index in "matches" of each correspondence.
 	//==================================================================
-	std::map<int, cv::Point3f> words3A;
-	std::map<int, cv::Point3f> words3B;
-	std::map<int, cv::KeyPoint> wordsB;
-	for (std::map<int, int>::iterator iter = matchedIndex.begin(); iter != matchedIndex.end(); ++iter)
+	Arena &arena = Arena::local();
+	const std::vector<cv::Point3f> &kptsFrom3D = sensorFrom.keypoints3D();
+	const std::vector<cv::Point3f> &kptsTo3D = sensorTo.keypoints3D();
+	const std::vector<cv::Point2f> &kptsTo = sensorTo.points();
+	cv::Point3f *objectPoints = arena.alloc<cv::Point3f>(matches.num);
+	cv::Point2f *imagePoints = arena.alloc<cv::Point2f>(matches.num);
+	cv::Point3f *objectPointsB = arena.alloc<cv::Point3f>(matches.num);
+	float *quality = matches.ratio ? arena.alloc<float>(matches.num) : nullptr;
+	int *matchIndex = arena.alloc<int>(matches.num);
+	int num = 0;
+	for (int k = 0; k < matches.num; k++)
 	{
-		if (iter->first < (int)sensorFrom.keypoints3D().size()) {
-			words3A.insert(std::make_pair(iter->first, sensorFrom.keypoints3D()[iter->first]));
+		int from = matches.from[k];
+		int to = matches.to[k];
+		if (from < (int)kptsFrom3D.size() && isFinite(kptsFrom3D[from]))
+		{
+			objectPoints[num] = kptsFrom3D[from];
+			imagePoints[num] = kptsTo[to];
+			objectPointsB[num] = kptsTo3D[to];
+			if (quality) {
+				quality[num] = matches.ratio[k];
+			}
+			matchIndex[num] = k;
+			num++;
 		}
-		words3B.insert(std::make_pair(iter->first, sensorTo.keypoints3D()[iter->second]));
-		wordsB.insert(std::make_pair(iter->first, sensorTo.keypoints()[iter->second]));
 	}
 
 	//==================================================================
@@ -371,27 +397,35 @@ void estimateMotion(
 	int minInliers = 20; // minimum inliers threshold
 	int refineIterations = 1; // # of runs to refine
 
-	std::vector<int> matches;
-	std::vector<int> inliers;
+	ArenaVector<int> inliers;
 	transform = estimateMotion3DTo2D(
-		words3A,
-		wordsB,
+		objectPoints,
+		imagePoints,
+		objectPointsB,
+		quality,
+		num,
 		sensorTo.stereoCameraModel(),
 		minInliers,
 		refineIterations,
 		guess,
-		words3B,
 		&reg_info->covariance,
-		&matches,
-		&inliers);
+		inliers,
+		cancel);
 
 	if (transform.isNull())
 	{
-		LOG_DEBUG("Not enough inliers %d/%d (matches=%d)", (int)inliers.size(), minInliers, (int)matches.size());
+		LOG_DEBUG("Not enough inliers %d/%d (matches=%d)", (int)inliers.size(), minInliers, num);
 	}
 
-	LOG_INFO(" inliers: %d/%d/%d ", (int)sensorTo.keypoints().size(), (int)matches.size(), (int)inliers.size());
+	LOG_INFO(" inliers: %d/%d/%d ", sensorTo.numKeypoints(), num, (int)inliers.size());
 
 	reg_info->num_inliers = (int)inliers.size();
-	reg_info->num_matches = (int)matches.size();
+	reg_info->num_matches = num;
+
+	// the capacity of "inlierIndex" is reused
+	reg_info->inlierIndex.clear();
+	for (int i = 0; i < (int)inliers.size(); i++) {
+		int k = matchIndex[inliers[i]];
+		reg_info->inlierIndex.push_back(std::make_pair(matches.from[k], matches.to[k]));
+	}
 }
@@ -7,6 +7,40 @@
 
 extern Perf perf;
 
+//=============================================================================
+// Frame Features
+//=============================================================================
+FrameFeatures::FrameFeatures()
+{
+	_dispScale = 1;
+}
+
+FrameFeatures::FrameFeatures(
+	const std::vector<cv::KeyPoint> &keypoints,
+	const std::vector<cv::Point3f> &keypoints3D,
+	const cv::Mat &descriptors,
+	const cv::Mat &disparity,
+	int dispScale)
+{
+	int num = (int)keypoints.size();
+	_points.resize(num);
+	_responses.resize(num);
+	for (int i = 0; i < num; i++) {
+		_points[i] = keypoints[i].pt;
+		_responses[i] = keypoints[i].response;
+	}
+	_points3D = keypoints3D;
+	_descriptors = descriptors;
+	_disparity = disparity;
+	_dispScale = dispScale;
+}
+
+
+//=============================================================================
+// Sensor Data
+//=============================================================================
+const FrameFeatures SensorData::_noFeatures;
+
 // empty constructor
 SensorData::SensorData() {
 	_id = 0;
@@ -43,32 +77,21 @@ void SensorData::setFeatures(
 	const cv::Mat &descriptors,
 	const cv::Mat &disparity)
 {
-	_keypoints = keypoints;
-	_keypoints3D = keypoints3D;
-	_descriptors = descriptors;
-
 	// decimate depth map to save memory
-	_dispScale = 4;
-	cv::Mat tmp = cv::Mat(disparity.rows / _dispScale, disparity.cols / _dispScale, CV_16SC1);
+	int dispScale = 4;
+	cv::Mat tmp = cv::Mat(disparity.rows / dispScale, disparity.cols / dispScale, CV_16SC1);
 	for (int row = 0; row < tmp.rows; row++) {
 		for (int col = 0; col < tmp.cols; col++) {
-			tmp.at<short>(row, col) = disparity.at<short>(row * _dispScale, col * _dispScale);
+			tmp.at<short>(row, col) = disparity.at<short>(row * dispScale, col * dispScale);
 		}
 	}
-	_disparity = tmp;
-}
 
-void SensorData::clearFeatures()
-{
-	_keypoints = std::vector<cv::KeyPoint>();
-	_keypoints3D = std::vector<cv::Point3f>();
-	_descriptors = cv::Mat();
-	_disparity = cv::Mat();
+	_features = std::make_shared<FrameFeatures>(keypoints, keypoints3D, descriptors, tmp, dispScale);
 }
 
-void SensorData::clearDescriptors()
+void SensorData::clearFeatures()
 {
-	_descriptors = cv::Mat();
+	_features.reset();
 }
 
 void SensorData::clearRawData()
@@ -95,47 +118,48 @@ void SensorData::getMemoryUsed()
 	if (_imageEigen.total() > 0) {
 		perf.registerMemoryUsed("_imageEigen", (unsigned long)(sizeof(cv::Mat) + _imageEigen.total() * _imageEigen.elemSize()));
 	}
-	if (_descriptors.total() > 0) {
-		perf.registerMemoryUsed("_descriptors", (unsigned long)(sizeof(cv::Mat) + _descriptors.total() * _descriptors.elemSize()));
+	const FrameFeatures &f = features();
+	if (f.descriptors().total() > 0) {
+		perf.registerMemoryUsed("_descriptors", (unsigned long)(sizeof(cv::Mat) + f.descriptors().total() * f.descriptors().elemSize()));
 	}
-	if (_disparity.total() > 0) {
-		perf.registerMemoryUsed("_disparity", (unsigned long)(sizeof(cv::Mat) + _disparity.total() * _disparity.elemSize()));
+	if (f.disparity().total() > 0) {
+		perf.registerMemoryUsed("_disparity", (unsigned long)(sizeof(cv::Mat) + f.disparity().total() * f.disparity().elemSize()));
 	}
 
-	perf.registerMemoryUsed("_keypoints", (unsigned long)(sizeof(std::vector<cv::KeyPoint>) + _keypoints.size() * sizeof(cv::KeyPoint)));
-	perf.registerMemoryUsed("_keypoints3D", (unsigned long)(sizeof(std::vector<cv::Point3f>) + _keypoints3D.size() * sizeof(cv::Point3f)));
+	perf.registerMemoryUsed("_keypoints", (unsigned long)(sizeof(std::vector<cv::Point2f>) * 2 + f.size() * (sizeof(cv::Point2f) + sizeof(float))));
+	perf.registerMemoryUsed("_keypoints3D", (unsigned long)(sizeof(std::vector<cv::Point3f>) + f.points3D().size() * sizeof(cv::Point3f)));
 }
 
 void SensorData::limitKeypoints(
-	std::vector<cv::KeyPoint> keypoints,
+	const std::vector<float> &responses,
 	std::vector<bool> &inliers,
 	int maxKeypoints)
 {
 	// Remove words under the new hessian threshold
-	if (maxKeypoints > 0 && (int)keypoints.size() > maxKeypoints) {
+	if (maxKeypoints > 0 && (int)responses.size() > maxKeypoints) {
 		// Sort words by hessian
 		std::multimap<float, int> hessianMap; // <hessian,id>
-		for (unsigned int i = 0; i <keypoints.size(); ++i) {
+		for (unsigned int i = 0; i <responses.size(); ++i) {
 			//Keep track of the data, to be easier to manage the data in the next step
-			hessianMap.insert(std::pair<float, int>(fabs(keypoints[i].response), i));
+			hessianMap.insert(std::pair<float, int>(fabs(responses[i]), i));
 		}
 
 		// Keep keypoints with highest response
 		auto iter = hessianMap.rbegin();
-		inliers.resize(keypoints.size(), false);
+		inliers.resize(responses.size(), false);
 		for (int k = 0; k < maxKeypoints && iter != hessianMap.rend(); ++k, ++iter) {
 			inliers[iter->second] = true;
 		}
 	}
 	else {
-		inliers.resize(keypoints.size(), true);
+		inliers.resize(responses.size(), true);
 	}
 }
 
 void SensorData::saveRectImageKpts()
 {
 	// keypoints
-	std::vector<cv::KeyPoint> kpts = this->keypoints();
+	const std::vector<cv::Point2f> &kpts = this->points();
 
 	// rectified left image
 	cv::Mat imgDebug = this->imageLeft().clone();
@@ -143,7 +167,7 @@ void SensorData::saveRectImageKpts()
 
 	// draw circles at keypoint locations
 	for (int i = 0; i < (int)kpts.size(); i++) {
-		cv::circle(imgDebug, kpts[i].pt, 3, cv::Scalar(0, 255, 0));
+		cv::circle(imgDebug, kpts[i], 3, cv::Scalar(0, 255, 0));
 	}
 
 	// print the number of keypoints at the left bottom corner of the image.
@@ -205,12 +229,12 @@ void SensorData::saveKpts2d()
 {
 	char filename[100];
 
-	std::vector<cv::KeyPoint> kpts2d = this->keypoints();
+	const std::vector<cv::Point2f> &kpts2d = this->points();
 
 	sprintf(filename, "kpts_%04d.csv", this->id());
 	FILE *fp_kpts = fopen(filename, "w");
 	for (int i = 0; i < (int)kpts2d.size(); i++) {
-		fprintf(fp_kpts, "%f,%f,\n", kpts2d[i].pt.x, kpts2d[i].pt.y);
+		fprintf(fp_kpts, "%f,%f,\n", kpts2d[i].x, kpts2d[i].y);
 	}
 	fclose(fp_kpts);
 }
@@ -219,7 +243,7 @@ void SensorData::saveKpts3d()
 {
 	char filename[100];
 
-	std::vector<cv::Point3f> kpts3d = this->keypoints3D();
+	const std::vector<cv::Point3f> &kpts3d = this->keypoints3D();
 
 	sprintf(filename, "kpts3d_%04d.csv", this->id());
 	FILE *fp_kpts3d = fopen(filename, "w");
@@ -249,7 +273,7 @@ void SensorData::saveDescriptor()
 {
 	char filename[100];
 
-	cv::Mat desc = this->descriptors();
+	const cv::Mat &desc = this->descriptors();
 
 	sprintf(filename, "desc_%04d.txt", this->id());
 	FILE *fp_desc = fopen(filename, "w");
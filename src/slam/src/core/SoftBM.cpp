@@ -0,0 +1,420 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/SoftBM.h"
+#include "core/xThread.h"
+#include "core/FramePool.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <string.h>
+
+extern xThreadPool threadPool;
+extern FramePool framePool;
+
+#define SOFT_BM_MAX_DISPARITIES	256
+#define SOFT_BM_PARALLEL		32		// disparities per phase (PARALLEL in bm_calc_sad.v)
+#define SOFT_BM_LANE_OFS		8		// lane of disparity 0, lanes 7 and ndisp+8 are the neighbors
+#define SOFT_BM_HSAD_MAX		1023	// column sum is 10 bits
+#define SOFT_BM_ROW_CHUNK		32		// prefilter rows per parallel task
+#define SOFT_BM_MIN_BAND		64		// output columns per band
+
+namespace {
+
+struct CANDIDATE {
+	int sad;
+	int idx;
+};
+
+//=============================================================================
+// Divider (diven.v)
+//-----------------------------------------------------------------------------
+// Non-restoring division, bit by bit as the pipeline does it, so that the
+// rounding of the quotient is the same.
+//=============================================================================
+int divide(int dividend, int divisor, int dw, int vw, int qw, int msbInv)
+{
+	int rw = dw + vw - msbInv; // remainder width, divisor is not extended
+	unsigned int rmask = (1u << rw) - 1;
+	unsigned int dmask = (1u << (vw + 1)) - 1;
+	unsigned int qmask = (1u << qw) - 1;
+
+	unsigned int div = (unsigned int)divisor & ((1u << vw) - 1);
+	unsigned int rem = (unsigned int)dividend & rmask;
+	unsigned int divSign = div >> (vw - 1);
+	unsigned int quot = 0;
+
+	for (int i = 0; i <= qw; i++) {
+		unsigned int op = divSign ^ (rem >> (rw - 1)); // 1: add, 0: sub
+		rem = ((((rem << 1) | (op ^ 1)) & rmask) + ((op ? 0 : dmask) ^ (div << 1))) & rmask;
+		if (i > 0) {
+			quot = ((quot << 1) | (op ^ 1)) & qmask;
+		}
+	}
+
+	return (int)((quot + divSign) & qmask);
+}
+
+// disparity fraction (bm_calc_frac.v), s-1.8
+int calcFrac(int l, int c, int r)
+{
+	int difLR = l - r;
+	int difLC = l - c;
+	int difRC = r - c;
+	bool cmp = (l < r);
+
+	int dividend = ((difLC < 0) || (difRC < 0)) ? 0 : difLR;
+	int divisor = 2 * (cmp ? difRC : difLC);
+	if (divisor == 0) {
+		return cmp ? 0x40 : 0xC0;
+	}
+
+	return divide(dividend, divisor, 18, 18, 8, 17);
+}
+
+// first minimum of 8 lanes
+CANDIDATE groupMin(const unsigned short *sad, int idx)
+{
+	CANDIDATE g;
+#if CV_SIMD128
+	g.sad = v_reduce_min(v_load(sad));
+#else
+	g.sad = *std::min_element(sad, sad + 8);
+#endif
+	g.idx = idx;
+	while (sad[g.idx - idx] != g.sad) {
+		g.idx++;
+	}
+	return g;
+}
+
+bool isAdjacent(const CANDIDATE &a, const CANDIDATE &b)
+{
+	return (a.idx == b.idx + 1) || (b.idx == a.idx + 1);
+}
+
+} // namespace
+
+SoftBM::SoftBM(const SOFT_BM_PARAM &param)
+{
+	_param = param;
+
+	_param.blockSize = std::min(std::max(_param.blockSize | 1, 3), 31);
+	_param.numDisparities = std::min(std::max(
+		(_param.numDisparities + SOFT_BM_PARALLEL - 1) & ~(SOFT_BM_PARALLEL - 1),
+		SOFT_BM_PARALLEL), SOFT_BM_MAX_DISPARITIES);
+	_param.uniThreshold &= 0x3FF;
+}
+
+SoftBM::~SoftBM()
+{
+}
+
+//=============================================================================
+// Prefilter (xsbl2.v)
+//-----------------------------------------------------------------------------
+// x-Sobel clipped to [-32, 31] and offset by 32. The first and the last
+// columns are 32, the first and the last rows are never written by the
+// FPGA and stay 0 as the firmware cleared them.
+//=============================================================================
+void SoftBM::prefilter(const cv::Mat &src, cv::Mat &dst, bool reverse) const
+{
+	int rows = src.rows;
+	int cols = src.cols;
+	int margin = reverse ? SOFT_BM_LANE_OFS : 0;
+	dst.create(rows, cols + 2 * margin, CV_8UC1);
+	dst.setTo(0);
+
+	int nchunks = (rows + SOFT_BM_ROW_CHUNK - 1) / SOFT_BM_ROW_CHUNK;
+	threadPool.parallelFor(nchunks, [&](int c) {
+		std::vector<unsigned char> line(cols);
+		int end = std::min(rows - 1, (c + 1) * SOFT_BM_ROW_CHUNK);
+		for (int y = std::max(1, c * SOFT_BM_ROW_CHUNK); y < end; y++) {
+			const unsigned char *s0 = src.ptr(y - 1);
+			const unsigned char *s1 = src.ptr(y);
+			const unsigned char *s2 = src.ptr(y + 1);
+			unsigned char *d = reverse ? line.data() : dst.ptr(y);
+
+			d[0] = 32;
+			d[cols - 1] = 32;
+
+			int x = 1;
+#if CV_SIMD128
+			v_int16x8 vlo = v_setall_s16(-32);
+			v_int16x8 vhi = v_setall_s16(31);
+			v_int16x8 vofs = v_setall_s16(32);
+			for (; x <= cols - 9; x += 8) {
+				v_int16x8 d0 = v_reinterpret_as_s16(v_load_expand(s0 + x + 1)) - v_reinterpret_as_s16(v_load_expand(s0 + x - 1));
+				v_int16x8 d1 = v_reinterpret_as_s16(v_load_expand(s1 + x + 1)) - v_reinterpret_as_s16(v_load_expand(s1 + x - 1));
+				v_int16x8 d2 = v_reinterpret_as_s16(v_load_expand(s2 + x + 1)) - v_reinterpret_as_s16(v_load_expand(s2 + x - 1));
+				v_int16x8 v = d0 + d1 + d1 + d2;
+				v = v_min(v_max(v, vlo), vhi) + vofs;
+				v_pack_u_store(d + x, v);
+			}
+#endif
+
+			for (; x < cols - 1; x++) {
+				int v = (s0[x + 1] - s0[x - 1]) + 2 * (s1[x + 1] - s1[x - 1]) + (s2[x + 1] - s2[x - 1]);
+				d[x] = (unsigned char)(std::min(std::max(v, -32), 31) + 32);
+			}
+
+			// mirrored so that the disparities of a pixel are contiguous
+			if (reverse) {
+				unsigned char *r = dst.ptr(y) + margin + cols - 1;
+				for (x = 0; x < cols; x++) {
+					r[-x] = d[x];
+				}
+			}
+		}
+	});
+}
+
+//=============================================================================
+// Disparity Decision (bm_calc_det.v, bm_calc_upd.v, bm_calc_uni.v)
+//-----------------------------------------------------------------------------
+// sad[SOFT_BM_LANE_OFS + d] is the SAD of disparity d in [-1, ndisp].
+// Returns the depth map word (bm_obuf2.v).
+//=============================================================================
+short SoftBM::decide(const unsigned short *sad) const
+{
+	int min1 = 0, min2 = 0;
+	int disp1 = 0, disp2 = 0;
+	int frac = 0;
+
+	int nphase = _param.numDisparities / SOFT_BM_PARALLEL;
+	for (int p = 0; p < nphase; p++) {
+		const unsigned short *s = sad + SOFT_BM_LANE_OFS + p * SOFT_BM_PARALLEL;
+
+		// tournament over 32 disparities, groups of 8 first
+		CANDIDATE g0 = groupMin(s, 0);
+		CANDIDATE g1 = groupMin(s + 8, 8);
+		CANDIDATE g2 = groupMin(s + 16, 16);
+		CANDIDATE g3 = groupMin(s + 24, 24);
+		CANDIDATE w0 = (g1.sad < g0.sad) ? g1 : g0;
+		CANDIDATE l0 = (g1.sad < g0.sad) ? g0 : g1;
+		CANDIDATE w1 = (g3.sad < g2.sad) ? g3 : g2;
+		CANDIDATE l1 = (g3.sad < g2.sad) ? g2 : g3;
+		CANDIDATE m1 = (w1.sad < w0.sad) ? w1 : w0;
+		CANDIDATE m2a = (w1.sad < w0.sad) ? w0 : w1;
+		CANDIDATE m2b = (l1.sad < l0.sad) ? l1 : l0;
+
+		// 2nd minimum, not adjacent to the 1st if possible
+		CANDIDATE m2 = m2a;
+		if (((m2b.sad < m2a.sad) && !isAdjacent(m2b, m1)) || isAdjacent(m2a, m1)) {
+			m2 = m2b;
+		}
+
+		int detDisp1 = (p << 5) | m1.idx;
+		int detDisp2 = (p << 5) | m2.idx;
+
+		// merge with the previous phases, the fraction is only needed
+		// when the 1st minimum is updated
+		if (p == 0) {
+			min1 = m1.sad; disp1 = detDisp1;
+			min2 = m2.sad; disp2 = detDisp2;
+			frac = calcFrac(s[m1.idx - 1], m1.sad, s[m1.idx + 1]);
+			continue;
+		}
+
+		bool d1s1 = (m1.sad < min1);
+		bool d2s1 = (m2.sad < min1);
+		bool d1s2 = (m1.sad < min2);
+		bool d2s2 = (m2.sad < min2);
+		bool adj = (detDisp1 == ((disp1 + 1) & 0xFF));
+
+		if (d1s1 && d2s1) {
+			min2 = m2.sad; disp2 = detDisp2;
+		}
+		else if (d1s1) {
+			if (!adj) {
+				min2 = min1; disp2 = disp1;
+			}
+			else if (d2s2) {
+				min2 = m2.sad; disp2 = detDisp2;
+			}
+		}
+		else if (d1s2) {
+			if (!adj) {
+				min2 = m1.sad; disp2 = detDisp1;
+			}
+			else if (d2s2) {
+				min2 = m2.sad; disp2 = detDisp2;
+			}
+			continue;
+		}
+		else {
+			continue;
+		}
+		min1 = m1.sad; disp1 = detDisp1;
+		frac = calcFrac(s[m1.idx - 1], m1.sad, s[m1.idx + 1]);
+	}
+
+	// uniqueness filter on the final minimums
+	if (_param.uniEnable) {
+		int ratio = divide(min1, min2, 17, 17, 11, 16) & 0x3FF;
+		if (ratio > _param.uniThreshold) {
+			disp1 = _param.uniMode ? 0xFF : 0x00;
+			frac = _param.uniMode ? 0xFF : 0x00;
+		}
+	}
+
+	// (u8.0) + (s-1.8) -> (s11.4), invalid if not positive
+	int depth = (disp1 << 8) + (signed char)frac;
+	if (depth <= 0) {
+		return -1;
+	}
+	return (short)((short)depth >> 4);
+}
+
+//=============================================================================
+// Block Matching (bm_calc_sad.v)
+//-----------------------------------------------------------------------------
+// colSum holds the SAD of wsz rows for every column and disparity of the
+// band, updated per row by subtracting the oldest row and adding the new
+// one, both saturated as the 10-bit HSAD buffer. The window SAD slides
+// horizontally over the column sums.
+//=============================================================================
+void SoftBM::matchBand(int band, int numBands, cv::Mat &depth)
+{
+	int rows = _left.rows;
+	int cols = _left.cols;
+	int ndisp = _param.numDisparities;
+	int wsz = _param.blockSize;
+	int hwsz = wsz / 2;
+	int sadWdt = cols - ndisp - 1 - 2 * hwsz;
+	int ds = ndisp + 2 * SOFT_BM_LANE_OFS; // lanes per column
+
+	// output columns [i0, i1) need the column sums of [i0, i1 + wsz - 1)
+	int i0 = sadWdt * band / numBands;
+	int i1 = sadWdt * (band + 1) / numBands;
+	int nk = i1 - i0 + wsz - 1;
+
+	std::vector<unsigned short> &colSum = _colSum[band];
+	colSum.resize(nk * ds);
+	unsigned short sad[SOFT_BM_MAX_DISPARITIES + 2 * SOFT_BM_LANE_OFS];
+
+	// column k is left pixel x = ndisp + k, lane j of the mirrored right
+	// row at cols - 1 - x is disparity j - SOFT_BM_LANE_OFS
+	int x0 = ndisp + i0;
+
+	for (int r = 0; r < rows; r++) {
+		const unsigned char *lp = _left.ptr(r) + x0;
+		const unsigned char *rp = _right.ptr(r) + cols - 1 - x0;
+		const unsigned char *lpo = (r >= wsz) ? _left.ptr(r - wsz) + x0 : nullptr;
+		const unsigned char *rpo = (r >= wsz) ? _right.ptr(r - wsz) + cols - 1 - x0 : nullptr;
+
+		for (int k = 0; k < nk; k++) {
+			unsigned short *c = &colSum[k * ds];
+			int j = 0;
+#if CV_SIMD128
+			v_uint8x16 vl = v_setall_u8(lp[k]);
+			v_uint16x8 vmax = v_setall_u16(SOFT_BM_HSAD_MAX);
+			if (r == 0) {
+				for (; j < ds; j += 16) {
+					v_uint16x8 a0, a1;
+					v_expand(v_absdiff(vl, v_load(rp - k + j)), a0, a1);
+					v_store(c + j, a0);
+					v_store(c + j + 8, a1);
+				}
+			}
+			else if (lpo) {
+				v_uint8x16 vlo = v_setall_u8(lpo[k]);
+				for (; j < ds; j += 16) {
+					v_uint16x8 a0, a1, o0, o1;
+					v_expand(v_absdiff(vl, v_load(rp - k + j)), a0, a1);
+					v_expand(v_absdiff(vlo, v_load(rpo - k + j)), o0, o1);
+					v_store(c + j, v_min((v_load(c + j) - o0) + a0, vmax));
+					v_store(c + j + 8, v_min((v_load(c + j + 8) - o1) + a1, vmax));
+				}
+			}
+			else {
+				for (; j < ds; j += 16) {
+					v_uint16x8 a0, a1;
+					v_expand(v_absdiff(vl, v_load(rp - k + j)), a0, a1);
+					v_store(c + j, v_min(v_load(c + j) + a0, vmax));
+					v_store(c + j + 8, v_min(v_load(c + j + 8) + a1, vmax));
+				}
+			}
+#endif
+			for (; j < ds; j++) {
+				int a = abs(lp[k] - rp[j - k]);
+				if (r == 0) {
+					c[j] = (unsigned short)a;
+					continue;
+				}
+				int v = c[j];
+				if (lpo) {
+					v = std::max(v - abs(lpo[k] - rpo[j - k]), 0);
+				}
+				c[j] = (unsigned short)std::min(v + a, SOFT_BM_HSAD_MAX);
+			}
+		}
+
+		if (r < wsz - 1) {
+			continue;
+		}
+
+		// first output column at ndisp + hwsz + 1 as bm_obuf2.v writes it
+		short *dp = depth.ptr<short>(r - hwsz) + ndisp + hwsz + 1;
+		memset(sad, 0, sizeof(sad));
+		for (int k = 0; k < wsz - 1; k++) {
+			const unsigned short *c = &colSum[k * ds];
+			for (int j = 0; j < ds; j++) {
+				sad[j] += c[j];
+			}
+		}
+		for (int i = i0; i < i1; i++) {
+			const unsigned short *cn = &colSum[(i - i0 + wsz - 1) * ds];
+			const unsigned short *co = (i > i0) ? &colSum[(i - i0 - 1) * ds] : nullptr;
+			int j = 0;
+#if CV_SIMD128
+			for (; j < ds; j += 8) {
+				v_uint16x8 v = v_load(sad + j) + v_load(cn + j);
+				if (co) {
+					v = v - v_load(co + j);
+				}
+				v_store(sad + j, v);
+			}
+#endif
+			for (; j < ds; j++) {
+				sad[j] = (unsigned short)(sad[j] + cn[j] - (co ? co[j] : 0));
+			}
+			dp[i] = decide(sad);
+		}
+	}
+}
+
+void SoftBM::compute(const cv::Mat &left, const cv::Mat &right, cv::Mat &depth)
+{
+	int rows = left.rows;
+	int cols = left.cols;
+	int wsz = _param.blockSize;
+	int sadWdt = cols - _param.numDisparities - 1 - 2 * (wsz / 2);
+
+	// pixels the FPGA does not write keep 0xFFFF the firmware cleared them to
+	depth = framePool.acquire(rows, cols, CV_16SC1);
+	depth.setTo(-1);
+	if ((sadWdt <= 0) || (rows < wsz)) {
+		return;
+	}
+
+	prefilter(left, _left, false);
+	prefilter(right, _right, true);
+
+	int numBands = std::max(1, std::min(threadPool.getNumThreads() + 1, sadWdt / SOFT_BM_MIN_BAND));
+	_colSum.resize(numBands);
+	threadPool.parallelFor(numBands, [&](int b) {
+		matchBand(b, numBands, depth);
+	});
+}
+
+unsigned long SoftBM::getSize() const
+{
+	unsigned long size = sizeof(SoftBM) +
+		_left.total() * _left.elemSize() +
+		_right.total() * _right.elemSize();
+	for (const std::vector<unsigned short> &c : _colSum) {
+		size += c.capacity() * sizeof(unsigned short);
+	}
+	return size;
+}
@@ -0,0 +1,256 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/SoftGFTT.h"
+#include "core/xThread.h"
+#include "core/FramePool.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+extern xThreadPool threadPool;
+extern FramePool framePool;
+
+#define SOFT_GFTT_BORDER		2			// lines gftt_obuf.v does not write at the top and bottom
+#define SOFT_GFTT_SQRT_MAX		0x3FFFFF	// square root input saturates at 22 bits
+#define SOFT_GFTT_MIN_BAND		16			// output rows per band
+
+namespace {
+
+//=============================================================================
+// Sobel and Gradient Products (gftt_sbl.v, gftt_eig.v)
+//-----------------------------------------------------------------------------
+// |dx|^2, |dx||dy| and |dy|^2 of the center row, all u22.-6. The FPGA
+// multiplies the absolute values, so the cross term is never negative.
+// The first and last columns are 0.
+//=============================================================================
+void gradientRow(
+	const unsigned char *p0,
+	const unsigned char *p1,
+	const unsigned char *p2,
+	int cols,
+	unsigned short *xx,
+	unsigned short *xy,
+	unsigned short *yy)
+{
+	xx[0] = xy[0] = yy[0] = 0;
+	xx[cols - 1] = xy[cols - 1] = yy[cols - 1] = 0;
+
+	int x = 1;
+#if CV_SIMD128
+	for (; x <= cols - 9; x += 8) {
+		v_int16x8 l0 = v_reinterpret_as_s16(v_load_expand(p0 + x - 1));
+		v_int16x8 c0 = v_reinterpret_as_s16(v_load_expand(p0 + x));
+		v_int16x8 r0 = v_reinterpret_as_s16(v_load_expand(p0 + x + 1));
+		v_int16x8 l1 = v_reinterpret_as_s16(v_load_expand(p1 + x - 1));
+		v_int16x8 r1 = v_reinterpret_as_s16(v_load_expand(p1 + x + 1));
+		v_int16x8 l2 = v_reinterpret_as_s16(v_load_expand(p2 + x - 1));
+		v_int16x8 c2 = v_reinterpret_as_s16(v_load_expand(p2 + x));
+		v_int16x8 r2 = v_reinterpret_as_s16(v_load_expand(p2 + x + 1));
+
+		v_int16x8 d1 = r1 - l1;
+		v_int16x8 dc = c2 - c0;
+		v_uint16x8 ax = v_abs((r0 - l0) + (d1 + d1) + (r2 - l2));
+		v_uint16x8 ay = v_abs((l2 - l0) + (dc + dc) + (r2 - r0));
+
+		v_uint32x4 lo, hi;
+		v_mul_expand(ax, ax, lo, hi);
+		v_store(xx + x, v_pack(lo >> 6, hi >> 6));
+		v_mul_expand(ax, ay, lo, hi);
+		v_store(xy + x, v_pack(lo >> 6, hi >> 6));
+		v_mul_expand(ay, ay, lo, hi);
+		v_store(yy + x, v_pack(lo >> 6, hi >> 6));
+	}
+#endif
+	for (; x < cols - 1; x++) {
+		int dx = (p0[x + 1] - p0[x - 1]) + 2 * (p1[x + 1] - p1[x - 1]) + (p2[x + 1] - p2[x - 1]);
+		int dy = (p2[x - 1] - p0[x - 1]) + 2 * (p2[x] - p0[x]) + (p2[x + 1] - p0[x + 1]);
+		int ax = abs(dx);
+		int ay = abs(dy);
+		xx[x] = (unsigned short)((ax * ax) >> 6);
+		xy[x] = (unsigned short)((ax * ay) >> 6);
+		yy[x] = (unsigned short)((ay * ay) >> 6);
+	}
+}
+
+//=============================================================================
+// Horizontal Box Filter (gftt_box.v)
+//-----------------------------------------------------------------------------
+// 3-tap sum written to the line buffer, the first and last columns are 0.
+// It fits in 16 bits, only the vertical sum saturates.
+//=============================================================================
+void boxRow(const unsigned short *src, int cols, unsigned short *dst)
+{
+	dst[0] = 0;
+	dst[cols - 1] = 0;
+
+	int x = 1;
+#if CV_SIMD128
+	for (; x <= cols - 9; x += 8) {
+		v_store(dst + x, v_load(src + x - 1) + v_load(src + x) + v_load(src + x + 1));
+	}
+#endif
+	for (; x < cols - 1; x++) {
+		dst[x] = (unsigned short)(src[x - 1] + src[x] + src[x + 1]);
+	}
+}
+
+#if CV_SIMD128
+// (a + c) - sqrt(s x1024) with s saturated at 22 bits. The CORDIC core
+// truncates the square root, the float estimate is off by one at most
+// and is fixed up in integers.
+inline v_uint32x4 eigen4(const v_uint32x4 &apc, const v_uint32x4 &s)
+{
+	v_uint32x4 one = v_setall_u32(1);
+	v_uint32x4 sl = v_min(s, v_setall_u32(SOFT_GFTT_SQRT_MAX));
+	v_uint32x4 n = sl << 10;
+	v_float32x4 f = v_sqrt(v_cvt_f32(v_reinterpret_as_s32(sl))) * v_setall_f32(32.0f);
+	v_uint32x4 r = v_min(v_reinterpret_as_u32(v_trunc(f)), v_setall_u32(0xFFFF));
+	r = r - ((r * r > n) & one);
+	r = r + (((n - r * r) > (r + r)) & one);
+	return v_max(apc, r) - r;
+}
+#endif
+
+//=============================================================================
+// Minimum Eigenvalue (gftt_box.v, gftt_eig.v)
+//-----------------------------------------------------------------------------
+// Vertical sums of the 3 box rows saturate at 16 bits, in any order as
+// they are never negative. The result is twice the minimum eigenvalue,
+// (a + c) - sqrt((a - c)^2 + 4b^2), in u21.-5 saturated to 16 bits.
+// Returns the maximum of the row.
+//=============================================================================
+unsigned short eigenRow(
+	const unsigned short *const xx[3],
+	const unsigned short *const xy[3],
+	const unsigned short *const yy[3],
+	int cols,
+	unsigned short *dst)
+{
+	unsigned short max = 0;
+
+	int x = 0;
+#if CV_SIMD128
+	v_uint16x8 vmax = v_setzero_u16();
+	for (; x <= cols - 8; x += 8) {
+		v_uint16x8 a = v_load(xx[0] + x) + v_load(xx[1] + x) + v_load(xx[2] + x);
+		v_uint16x8 b = v_load(xy[0] + x) + v_load(xy[1] + x) + v_load(xy[2] + x);
+		v_uint16x8 c = v_load(yy[0] + x) + v_load(yy[1] + x) + v_load(yy[2] + x);
+
+		v_uint32x4 a0, a1, c0, c1, m0, m1, b0, b1;
+		v_expand(a, a0, a1);
+		v_expand(c, c0, c1);
+		v_uint16x8 amc = v_absdiff(a, c);
+		v_mul_expand(amc, amc, m0, m1);
+		v_mul_expand(b, b, b0, b1);
+
+		v_uint16x8 e = v_pack(
+			eigen4(a0 + c0, (m0 >> 10) + (b0 >> 8)),
+			eigen4(a1 + c1, (m1 >> 10) + (b1 >> 8)));
+		v_store(dst + x, e);
+		vmax = v_max(vmax, e);
+	}
+	max = v_reduce_max(vmax);
+#endif
+	for (; x < cols; x++) {
+		unsigned int a = std::min(xx[0][x] + xx[1][x] + xx[2][x], 0xFFFF);
+		unsigned int b = std::min(xy[0][x] + xy[1][x] + xy[2][x], 0xFFFF);
+		unsigned int c = std::min(yy[0][x] + yy[1][x] + yy[2][x], 0xFFFF);
+		unsigned int amc = (a > c) ? a - c : c - a;
+		unsigned int s = std::min(((amc * amc) >> 10) + ((b * b) >> 8), (unsigned int)SOFT_GFTT_SQRT_MAX);
+		int r = (int)sqrt((double)(s << 10));
+		int e = std::min(std::max((int)(a + c) - r, 0), 0xFFFF);
+		dst[x] = (unsigned short)e;
+		max = std::max(max, dst[x]);
+	}
+	return max;
+}
+
+} // namespace
+
+
+//=============================================================================
+// Software GFTT
+//=============================================================================
+SoftGFTT::SoftGFTT()
+{
+}
+
+SoftGFTT::~SoftGFTT()
+{
+}
+
+//=============================================================================
+// Row Band
+//-----------------------------------------------------------------------------
+// Output rows [y0, y1) need the Sobel rows centered at [y0 - 1, y1].
+// The horizontal box sums of the last 3 of them are kept per product,
+// slot y % 3 for the Sobel row centered at y.
+//=============================================================================
+void SoftGFTT::computeBand(const cv::Mat &image, int band, int numBands, cv::Mat &eig)
+{
+	int rows = image.rows;
+	int cols = image.cols;
+	int outRows = rows - 2 * SOFT_GFTT_BORDER;
+	int y0 = SOFT_GFTT_BORDER + outRows * band / numBands;
+	int y1 = SOFT_GFTT_BORDER + outRows * (band + 1) / numBands;
+
+	std::vector<unsigned short> &buf = _buf[band];
+	buf.resize(12 * cols);
+	unsigned short *grad[3];
+	unsigned short *box[3][3];
+	for (int p = 0; p < 3; p++) {
+		grad[p] = &buf[p * cols];
+		for (int slot = 0; slot < 3; slot++) {
+			box[p][slot] = &buf[(3 + 3 * p + slot) * cols];
+		}
+	}
+
+	unsigned short max = 0;
+	for (int y = y0 - 1; y <= y1; y++) {
+		gradientRow(image.ptr(y - 1), image.ptr(y), image.ptr(y + 1), cols, grad[0], grad[1], grad[2]);
+		for (int p = 0; p < 3; p++) {
+			boxRow(grad[p], cols, box[p][y % 3]);
+		}
+		if (y < y0 + 1) {
+			continue;
+		}
+		unsigned short m = eigenRow(box[0], box[1], box[2], cols, eig.ptr<unsigned short>(y - 1));
+		max = std::max(max, m);
+	}
+	_max[band] = max;
+}
+
+void SoftGFTT::compute(const cv::Mat &image, cv::Mat &eig, unsigned short *maxEigen)
+{
+	int rows = image.rows;
+	int cols = image.cols;
+	int outRows = rows - 2 * SOFT_GFTT_BORDER;
+
+	// lines the FPGA does not write keep 0 the firmware cleared them to
+	eig = framePool.acquire(rows, cols, CV_16UC1);
+	eig.setTo(0);
+	*maxEigen = 0;
+	if ((outRows <= 0) || (cols < 3)) {
+		return;
+	}
+
+	int numBands = std::max(1, std::min(threadPool.getNumThreads() + 1, outRows / SOFT_GFTT_MIN_BAND));
+	_buf.resize(numBands);
+	_max.assign(numBands, 0);
+	threadPool.parallelFor(numBands, [&](int b) {
+		computeBand(image, b, numBands, eig);
+	});
+	*maxEigen = *std::max_element(_max.begin(), _max.end());
+}
+
+unsigned long SoftGFTT::getSize() const
+{
+	unsigned long size = sizeof(SoftGFTT) + _max.capacity() * sizeof(unsigned short);
+	for (const std::vector<unsigned short> &b : _buf) {
+		size += b.capacity() * sizeof(unsigned short);
+	}
+	return size;
+}
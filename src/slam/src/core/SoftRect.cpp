@@ -0,0 +1,213 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/SoftRect.h"
+#include "core/StereoCameraModel.h"
+#include "core/Logger.h"
+#include "core/xThread.h"
+#include "core/FramePool.h"
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+
+extern xThreadPool threadPool;
+extern FramePool framePool;
+
+#define SOFT_RECT_FRAC_BITS		5			// u10.5 / u9.5 source coordinates
+#define SOFT_RECT_MAX_WIDTH		1024		// xsrc integer part is 10 bits
+#define SOFT_RECT_MAX_HEIGHT	512			// ysrc integer part is 9 bits
+#define SOFT_RECT_OUTSIDE		0x80000000	// source out of the image, output 0
+#define SOFT_RECT_TILE_WIDTH	64
+#define SOFT_RECT_TILE_HEIGHT	16
+
+namespace {
+
+// source pixels and fractions of a packed coordinate, the right and lower
+// neighbors repeat the last column and row
+inline void fetch(
+	const cv::Mat &src,
+	unsigned int m,
+	unsigned short &p00,
+	unsigned short &p01,
+	unsigned short &p10,
+	unsigned short &p11,
+	unsigned short &xf,
+	unsigned short &yf)
+{
+	if (m & SOFT_RECT_OUTSIDE) {
+		p00 = p01 = p10 = p11 = 0;
+		xf = yf = 0;
+		return;
+	}
+	int xi = (m >> SOFT_RECT_FRAC_BITS) & 0x3FF;
+	int yi = (m >> (15 + SOFT_RECT_FRAC_BITS)) & 0x1FF;
+	const unsigned char *s = src.ptr(yi) + xi;
+	int dx = (xi < src.cols - 1) ? 1 : 0;
+	int dy = (yi < src.rows - 1) ? (int)src.step : 0;
+	p00 = s[0];
+	p01 = s[dx];
+	p10 = s[dy];
+	p11 = s[dy + dx];
+	xf = (unsigned short)(m & 0x1F);
+	yf = (unsigned short)((m >> 15) & 0x1F);
+}
+
+//=============================================================================
+// Bilinear Interpolation (rect_intp.v)
+//-----------------------------------------------------------------------------
+// (u8.0) x (u1.5) x (u1.5) summed in u8.10, rounded half up to u8.0.
+//=============================================================================
+inline unsigned char interpolate(int p00, int p01, int p10, int p11, int xf, int yf)
+{
+	int xfi = 32 - xf;
+	int yfi = 32 - yf;
+	int sum = p00 * xfi * yfi + p01 * xf * yfi + p10 * xfi * yf + p11 * xf * yf;
+	return (unsigned char)((sum + 512) >> 10);
+}
+
+} // namespace
+
+
+//=============================================================================
+// Software Rectification
+//=============================================================================
+SoftRect::SoftRect()
+{
+}
+
+SoftRect::~SoftRect()
+{
+}
+
+//=============================================================================
+// Remap Tables
+//-----------------------------------------------------------------------------
+// Source coordinates are rounded half up to 1/32 pixel as rect_remap()
+// does for the FPGA. Coordinates out of the image are marked, the FPGA
+// leaves those pixels unwritten.
+//=============================================================================
+bool SoftRect::init(const StereoCameraModel &model, const cv::Size &size)
+{
+	_size = cv::Size();
+	if (!model.hasRawModel()) {
+		LOG_WARN("No raw camera model in the calibration files\n");
+		return false;
+	}
+	if ((size.width < 2) || (size.height < 2) ||
+		(size.width > SOFT_RECT_MAX_WIDTH) || (size.height > SOFT_RECT_MAX_HEIGHT)) {
+		LOG_WARN("Illegal image size for rectification (%d,%d)\n", size.width, size.height);
+		return false;
+	}
+
+	float maxX = (float)((size.width - 1) << SOFT_RECT_FRAC_BITS);
+	float maxY = (float)((size.height - 1) << SOFT_RECT_FRAC_BITS);
+	for (int lr = 0; lr < 2; lr++) {
+		cv::Mat mapX, mapY;
+		cv::initUndistortRectifyMap(
+			model.rawK(lr), model.rawD(lr), model.rectR(lr), model.P(lr).colRange(0, 3),
+			size, CV_32FC1, mapX, mapY);
+
+		std::vector<unsigned int> &map = _map[lr];
+		map.resize(size.area());
+		for (int y = 0; y < size.height; y++) {
+			const float *mx = mapX.ptr<float>(y);
+			const float *my = mapY.ptr<float>(y);
+			unsigned int *m = &map[y * size.width];
+			for (int x = 0; x < size.width; x++) {
+				float xs = mx[x] * (1 << SOFT_RECT_FRAC_BITS) + 0.5f;
+				float ys = my[x] * (1 << SOFT_RECT_FRAC_BITS) + 0.5f;
+				if (!((xs >= 0.0f) && (xs < maxX + 1.0f) && (ys >= 0.0f) && (ys < maxY + 1.0f))) {
+					m[x] = SOFT_RECT_OUTSIDE;
+					continue;
+				}
+				m[x] = ((unsigned int)cvFloor(ys) << 15) | (unsigned int)cvFloor(xs);
+			}
+		}
+	}
+
+	_size = size;
+	return true;
+}
+
+void SoftRect::remapTile(int lr, const cv::Mat &src, cv::Mat &dst, int tile) const
+{
+	int cols = _size.width;
+	int rows = _size.height;
+	int tilesX = (cols + SOFT_RECT_TILE_WIDTH - 1) / SOFT_RECT_TILE_WIDTH;
+	int x0 = (tile % tilesX) * SOFT_RECT_TILE_WIDTH;
+	int y0 = (tile / tilesX) * SOFT_RECT_TILE_HEIGHT;
+	int x1 = std::min(x0 + SOFT_RECT_TILE_WIDTH, cols);
+	int y1 = std::min(y0 + SOFT_RECT_TILE_HEIGHT, rows);
+
+	for (int y = y0; y < y1; y++) {
+		const unsigned int *m = &_map[lr][y * cols];
+		unsigned char *d = dst.ptr(y);
+		int x = x0;
+#if CV_SIMD128
+		// gather 8 pixels, then weight them in 32 bits
+		unsigned short p00[8], p01[8], p10[8], p11[8], xf[8], yf[8];
+		v_uint16x8 v32 = v_setall_u16(32);
+		v_uint32x4 rnd = v_setall_u32(512);
+		for (; x <= x1 - 8; x += 8) {
+			for (int i = 0; i < 8; i++) {
+				fetch(src, m[x + i], p00[i], p01[i], p10[i], p11[i], xf[i], yf[i]);
+			}
+			v_uint16x8 vxf = v_load(xf);
+			v_uint16x8 vyf = v_load(yf);
+			v_uint16x8 vxfi = v32 - vxf;
+			v_uint16x8 vyfi = v32 - vyf;
+
+			v_uint32x4 s0, s1, t0, t1;
+			v_mul_expand(v_load(p00), vxfi * vyfi, s0, s1);
+			v_mul_expand(v_load(p01), vxf * vyfi, t0, t1);
+			s0 += t0;
+			s1 += t1;
+			v_mul_expand(v_load(p10), vxfi * vyf, t0, t1);
+			s0 += t0;
+			s1 += t1;
+			v_mul_expand(v_load(p11), vxf * vyf, t0, t1);
+			s0 += t0;
+			s1 += t1;
+			v_pack_store(d + x, v_pack((s0 + rnd) >> 10, (s1 + rnd) >> 10));
+		}
+#endif
+		for (; x < x1; x++) {
+			unsigned short p00, p01, p10, p11, xf, yf;
+			fetch(src, m[x], p00, p01, p10, p11, xf, yf);
+			d[x] = interpolate(p00, p01, p10, p11, xf, yf);
+		}
+	}
+}
+
+void SoftRect::compute(const cv::Mat &rawLeft, const cv::Mat &rawRight, cv::Mat &left, cv::Mat &right)
+{
+	if ((_size.area() == 0) || (rawLeft.size() != _size) || (rawRight.size() != _size)) {
+		LOG_WARN("Rectification skipped (%d,%d)\n", rawLeft.cols, rawLeft.rows);
+		left = rawLeft;
+		right = rawRight;
+		return;
+	}
+
+	// recycled buffers no previous frame refers to any more
+	left = framePool.acquire(_size, CV_8UC1);
+	right = framePool.acquire(_size, CV_8UC1);
+
+	int tiles =
+		((_size.width + SOFT_RECT_TILE_WIDTH - 1) / SOFT_RECT_TILE_WIDTH) *
+		((_size.height + SOFT_RECT_TILE_HEIGHT - 1) / SOFT_RECT_TILE_HEIGHT);
+	threadPool.parallelFor(2 * tiles, [&](int i) {
+		if (i < tiles) {
+			remapTile(0, rawLeft, left, i);
+		}
+		else {
+			remapTile(1, rawRight, right, i - tiles);
+		}
+	});
+}
+
+unsigned long SoftRect::getSize() const
+{
+	return (unsigned long)(sizeof(SoftRect) +
+		(_map[0].capacity() + _map[1].capacity()) * sizeof(unsigned int));
+}
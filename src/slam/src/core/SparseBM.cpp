@@ -0,0 +1,239 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/SparseBM.h"
+#include "core/xThread.h"
+#include "core/FramePool.h"
+#include "core/Logger.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <climits>
+#include <string.h>
+
+extern xThreadPool threadPool;
+extern FramePool framePool;
+
+#define SPARSE_BM_CHUNK				64		// keypoints per parallel task
+#define SPARSE_BM_MAX_DISPARITIES	256
+#define SPARSE_BM_MIN_DISPARITY		0.5f	// same as the LK methods
+
+SparseBM::SparseBM(const SPARSE_BM_PARAM &param)
+{
+	_param = param;
+
+	// SAD is accumulated in 16 bits
+	_param.blockSize = std::min(std::max(_param.blockSize | 1, 3), 31);
+	_param.preFilterCap = std::min(std::max(_param.preFilterCap, 1), 65535 / (2 * _param.blockSize * _param.blockSize));
+	_param.numDisparities = std::min(std::max((_param.numDisparities + 15) & ~15, 16), SPARSE_BM_MAX_DISPARITIES);
+	if (_param.gridStep > 0) {
+		_param.gridStep = (_param.gridStep + 3) & ~3;
+	}
+}
+
+SparseBM::~SparseBM()
+{
+}
+
+//=============================================================================
+// Prefilter
+//=============================================================================
+// x-Sobel clipped to [-cap, cap] and offset by cap, same as StereoBM
+void SparseBM::prefilter(const cv::Mat &src, cv::Mat &dst, int pad) const
+{
+	int rows = src.rows;
+	int cols = src.cols;
+	int cap = _param.preFilterCap;
+	dst.create(rows, cols + pad, CV_8UC1);
+
+	for (int y = 0; y < rows; y++) {
+		const unsigned char *s0 = src.ptr(y > 0 ? y - 1 : (rows > 1 ? 1 : 0));
+		const unsigned char *s1 = src.ptr(y);
+		const unsigned char *s2 = src.ptr(y < rows - 1 ? y + 1 : (rows > 1 ? rows - 2 : 0));
+		unsigned char *d = dst.ptr(y);
+
+		memset(d, cap, pad + 1);
+		d += pad;
+		d[cols - 1] = (unsigned char)cap;
+
+		int x = 1;
+#if CV_SIMD128
+		v_int16x8 vcap = v_setall_s16((short)cap);
+		v_int16x8 vncap = v_setall_s16((short)-cap);
+		for (; x <= cols - 9; x += 8) {
+			v_int16x8 d0 = v_reinterpret_as_s16(v_load_expand(s0 + x + 1)) - v_reinterpret_as_s16(v_load_expand(s0 + x - 1));
+			v_int16x8 d1 = v_reinterpret_as_s16(v_load_expand(s1 + x + 1)) - v_reinterpret_as_s16(v_load_expand(s1 + x - 1));
+			v_int16x8 d2 = v_reinterpret_as_s16(v_load_expand(s2 + x + 1)) - v_reinterpret_as_s16(v_load_expand(s2 + x - 1));
+			v_int16x8 v = d0 + d1 + d1 + d2;
+			v = v_min(v_max(v, vncap), vcap) + vcap;
+			v_pack_u_store(d + x, v);
+		}
+#endif
+
+		for (; x < cols - 1; x++) {
+			int v = (s0[x + 1] - s0[x - 1]) + 2 * (s1[x + 1] - s1[x - 1]) + (s2[x + 1] - s2[x - 1]);
+			d[x] = (unsigned char)(std::min(std::max(v, -cap), cap) + cap);
+		}
+	}
+}
+
+void SparseBM::setImages(const cv::Mat &left, const cv::Mat &right)
+{
+	prefilter(left, _left, 0);
+	prefilter(right, _right, _param.numDisparities);
+}
+
+//=============================================================================
+// Block Matching
+//=============================================================================
+bool SparseBM::matchPoint(int x, int y, float &disparity) const
+{
+	int h = _param.blockSize / 2;
+	int bs = _param.blockSize;
+	int ndisp = _param.numDisparities;
+	int cap = _param.preFilterCap;
+
+	if ((y - h < 0) || (y + h >= _left.rows) || (x - h < 1) || (x + h >= _left.cols - 1)) {
+		return false;
+	}
+
+	// windows running out of the right image are not candidates
+	int maxD = std::min(ndisp - 1, x - h);
+
+	// texture
+	int texture = 0;
+	for (int r = -h; r <= h; r++) {
+		const unsigned char *lp = _left.ptr(y + r) + x - h;
+		for (int c = 0; c < bs; c++) {
+			texture += abs(lp[c] - cap);
+		}
+	}
+	if (texture < _param.textureThreshold) {
+		return false;
+	}
+
+	// SAD for all disparities, lane j is disparity (ndisp - 1 - j)
+	unsigned short cost[SPARSE_BM_MAX_DISPARITIES];
+#if CV_SIMD128
+	v_uint16x8 acc[SPARSE_BM_MAX_DISPARITIES / 8];
+	for (int k = 0; k < ndisp / 8; k++) {
+		acc[k] = v_setzero_u16();
+	}
+	for (int r = -h; r <= h; r++) {
+		const unsigned char *lp = _left.ptr(y + r) + x - h;
+		const unsigned char *rp = _right.ptr(y + r) + ndisp + x - h - (ndisp - 1);
+		for (int c = 0; c < bs; c++) {
+			v_uint8x16 lv = v_setall_u8(lp[c]);
+			for (int k = 0; k < ndisp; k += 16) {
+				v_uint16x8 lo, hi;
+				v_expand(v_absdiff(lv, v_load(rp + c + k)), lo, hi);
+				acc[k / 8] += lo;
+				acc[k / 8 + 1] += hi;
+			}
+		}
+	}
+	for (int k = 0; k < ndisp / 8; k++) {
+		v_store(cost + 8 * k, acc[k]);
+	}
+#else
+	memset(cost, 0, sizeof(cost));
+	for (int r = -h; r <= h; r++) {
+		const unsigned char *lp = _left.ptr(y + r) + x - h;
+		const unsigned char *rp = _right.ptr(y + r) + ndisp + x - h - (ndisp - 1);
+		for (int c = 0; c < bs; c++) {
+			for (int j = 0; j < ndisp; j++) {
+				cost[j] += (unsigned short)abs(lp[c] - rp[c + j]);
+			}
+		}
+	}
+#endif
+
+	// best disparity
+	int best = 0;
+	int minsad = INT_MAX;
+	for (int d = 0; d <= maxD; d++) {
+		int sad = cost[ndisp - 1 - d];
+		if (sad < minsad) {
+			minsad = sad;
+			best = d;
+		}
+	}
+
+	// uniqueness
+	if (_param.uniquenessRatio > 0) {
+		int thresh = minsad + (minsad * _param.uniquenessRatio) / 100;
+		for (int d = 0; d <= maxD; d++) {
+			if (((d < best - 1) || (d > best + 1)) && (cost[ndisp - 1 - d] <= thresh)) {
+				return false;
+			}
+		}
+	}
+
+	// parabolic subpixel
+	disparity = (float)best;
+	if ((best > 0) && (best < maxD)) {
+		int n = cost[ndisp - best];
+		int p = cost[ndisp - 2 - best];
+		int denom = n + p - 2 * minsad;
+		if (denom > 0) {
+			disparity += (float)(n - p) / (2.0f * denom);
+		}
+	}
+
+	return true;
+}
+
+void SparseBM::match(
+	const std::vector<cv::Point2f> &leftCorners,
+	std::vector<cv::Point2f> &rightCorners,
+	std::vector<unsigned char> &status) const
+{
+	int npoints = (int)leftCorners.size();
+	rightCorners.resize(npoints);
+	status.resize(npoints);
+
+	int nchunks = (npoints + SPARSE_BM_CHUNK - 1) / SPARSE_BM_CHUNK;
+	threadPool.parallelFor(nchunks, [&](int c) {
+		int end = std::min(npoints, (c + 1) * SPARSE_BM_CHUNK);
+		for (int i = c * SPARSE_BM_CHUNK; i < end; i++) {
+			const cv::Point2f &pt = leftCorners[i];
+			float disparity = 0.0f;
+			bool valid = matchPoint(cvRound(pt.x), cvRound(pt.y), disparity);
+
+			rightCorners[i] = cv::Point2f(pt.x - disparity, pt.y);
+			status[i] = valid && (disparity > SPARSE_BM_MIN_DISPARITY);
+		}
+	});
+}
+
+// disparity x16 on a regular grid, 0 elsewhere, same format as the dense methods
+void SparseBM::computeGrid(cv::Mat &disp) const
+{
+	disp = framePool.acquire(_left.rows, _left.cols, CV_16SC1);
+	disp.setTo(0);
+
+	int step = _param.gridStep;
+	if (step <= 0) {
+		return;
+	}
+
+	int nrows = (_left.rows + step - 1) / step;
+	threadPool.parallelFor(nrows, [&](int r) {
+		int y = r * step;
+		short *dp = disp.ptr<short>(y);
+		for (int x = 0; x < _left.cols; x += step) {
+			float disparity;
+			if (matchPoint(x, y, disparity) && (disparity > SPARSE_BM_MIN_DISPARITY)) {
+				dp[x] = (short)cvRound(disparity * 16.0f);
+			}
+		}
+	});
+}
+
+unsigned long SparseBM::getSize() const
+{
+	return (unsigned long)(
+		sizeof(SparseBM) +
+		_left.total() * _left.elemSize() +
+		_right.total() * _right.elemSize());
+}
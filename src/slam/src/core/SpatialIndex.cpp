@@ -0,0 +1,118 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/SpatialIndex.h"
+#include <math.h>
+#include <algorithm>
+
+SpatialIndex::SpatialIndex(float voxelSize)
+{
+	_voxelSize = voxelSize;
+	_minVariance = 0.0f;
+	_numEntries = 0;
+}
+
+SpatialIndex::~SpatialIndex()
+{
+}
+
+void SpatialIndex::clear()
+{
+	_voxels.clear();
+	_minVariance = 0.0f;
+	_numEntries = 0;
+}
+
+// 21 bits for each axis
+long long SpatialIndex::key(int vx, int vy, int vz) const
+{
+	return
+		((long long)(vx & 0x1FFFFF) << 42) |
+		((long long)(vy & 0x1FFFFF) << 21) |
+		((long long)(vz & 0x1FFFFF));
+}
+
+int SpatialIndex::voxel(float val) const
+{
+	return (int)floorf(val / _voxelSize);
+}
+
+void SpatialIndex::insert(int id, float x, float y, float z, float variance)
+{
+	SPATIAL_ENTRY entry;
+	entry.id = id;
+	entry.x = x;
+	entry.y = y;
+	entry.z = z;
+	entry.variance = variance;
+
+	_voxels[key(voxel(x), voxel(y), voxel(z))].push_back(entry);
+
+	if ((_numEntries == 0) || (variance < _minVariance)) {
+		_minVariance = variance;
+	}
+	_numEntries++;
+}
+
+void SpatialIndex::radiusSearch(
+	float x, float y, float z,
+	float variance,
+	float radiusBase,
+	float radiusScale,
+	std::vector<int> &ids) const
+{
+	ids.clear();
+	if (_numEntries == 0) {
+		return;
+	}
+
+	// the largest radius is given to the oldest node
+	float maxRadius = radiusBase + radiusScale * sqrtf(std::max(variance - _minVariance, 0.0f));
+	int vx0 = voxel(x - maxRadius);
+	int vy0 = voxel(y - maxRadius);
+	int vz0 = voxel(z - maxRadius);
+	int vx1 = voxel(x + maxRadius);
+	int vy1 = voxel(y + maxRadius);
+	int vz1 = voxel(z + maxRadius);
+
+	auto check = [&](const std::vector<SPATIAL_ENTRY> &entries) {
+		for (auto itr = entries.begin(); itr != entries.end(); itr++) {
+			float r = radiusBase + radiusScale * sqrtf(std::max(variance - itr->variance, 0.0f));
+			float dx = itr->x - x;
+			float dy = itr->y - y;
+			float dz = itr->z - z;
+			if (dx * dx + dy * dy + dz * dz <= r * r) {
+				ids.push_back(itr->id);
+			}
+		}
+	};
+
+	double numCells = (double)(vx1 - vx0 + 1) * (vy1 - vy0 + 1) * (vz1 - vz0 + 1);
+	if (numCells > (double)_voxels.size()) {
+		// the radius covers the map, visit all voxels
+		for (auto itr = _voxels.begin(); itr != _voxels.end(); itr++) {
+			check(itr->second);
+		}
+	}
+	else {
+		for (int vz = vz0; vz <= vz1; vz++) {
+			for (int vy = vy0; vy <= vy1; vy++) {
+				for (int vx = vx0; vx <= vx1; vx++) {
+					auto itr = _voxels.find(key(vx, vy, vz));
+					if (itr != _voxels.end()) {
+						check(itr->second);
+					}
+				}
+			}
+		}
+	}
+}
+
+unsigned long SpatialIndex::getSize() const
+{
+	return (unsigned long)(
+		sizeof(SpatialIndex) +
+		_voxels.size() * (16 + sizeof(long long) + sizeof(std::vector<SPATIAL_ENTRY>)) +
+		_numEntries * sizeof(SPATIAL_ENTRY));
+}
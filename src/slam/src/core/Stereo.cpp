@@ -4,6 +4,7 @@
 //=============================================================================
 #include <core/Stereo.h>
 #include "opencv/CvLKStereo.h"
+#include "core/EpipolarLK.h"
 #include "core/Parameters.h"
 
 std::vector<cv::Point2f> computeCorrespondences(
@@ -50,6 +51,38 @@ std::vector<cv::Point2f> computeCorrespondences(
 	return rightCorners;
 }
 
+std::vector<cv::Point2f> computeCorrespondencesEpipolar(
+	const cv::Mat &leftImage,
+	const cv::Mat &rightImage,
+	const std::vector<cv::Point2f> &leftCorners,
+	std::vector<unsigned char> &status)
+{
+	// local parameters
+	EPIPOLAR_LK_PARAM param;
+	param.winWidth = 15;
+	param.winHeight = 3;
+	param.maxLevel = 5;
+	param.iterations = 30;
+	param.epsilon = 0.01f;
+	param.minDisparity = 0.5f;
+	param.maxDisparity = 128.0f;
+	param.minEigThreshold = 1e-4f;
+	param.maxError = 32.0f;
+
+	// search correspondences on the same rows of the right image,
+	// disparity bounds are checked inside
+	std::vector<cv::Point2f> rightCorners;
+	calcEpipolarLK(
+		leftImage,
+		rightImage,
+		leftCorners,
+		rightCorners,
+		status,
+		param);
+
+	return rightCorners;
+}
+
 std::vector<cv::Point3f> generateKeypoints3DStereo(
 	const std::vector<cv::Point2f> &leftCorners,
 	const std::vector<cv::Point2f> &rightCorners,
@@ -73,7 +106,8 @@ std::vector<cv::Point3f> generateKeypoints3DStereo(
 			if (
 				(depthMethod == DEPTH_METHOD_CV_BM) ||
 				(depthMethod == DEPTH_METHOD_CV_SGBM) ||
-				(depthMethod == DEPTH_METHOD_FPGA_BM)
+				(depthMethod == DEPTH_METHOD_FPGA_BM) ||
+				(depthMethod == DEPTH_METHOD_SOFT_BM)
 			){
 				// from dense depth map
 				short tmps = disp.at<short>((int)leftCorners[i].y, (int)leftCorners[i].x);
@@ -117,12 +151,13 @@ std::vector<cv::Point3f> generateKeypoints3DStereo(
 }
 
 void generateKeypoints3D(
-	SensorData data,
-	StereoCameraModel StereoCameraModel,
-	std::vector<cv::KeyPoint> kpts,
+	const SensorData &data,
+	const StereoCameraModel &StereoCameraModel,
+	const std::vector<cv::KeyPoint> &kpts,
 	std::vector<cv::Point3f> &kpts3d,
 	cv::Mat disp,
-	int depthMethod)
+	int depthMethod,
+	const SparseBM *sparseBM)
 {
 	// convert cv::KeyPoint to cv::Point2f
 	std::vector<cv::Point2f> leftCorners;
@@ -139,6 +174,19 @@ void generateKeypoints3D(
 			leftCorners,
 			status);
 	}
+	else if (depthMethod == DEPTH_METHOD_EPI_LK)
+	{
+		rightCorners = computeCorrespondencesEpipolar(
+			data.imageLeft(),
+			data.imageRight(),
+			leftCorners,
+			status);
+	}
+	else if (depthMethod == DEPTH_METHOD_SPARSE_BM)
+	{
+		// images are set by the caller
+		sparseBM->match(leftCorners, rightCorners, status);
+	}
 
 	// 3D coodinates of the key points
 	float maxDepth = 0.000000;
@@ -154,6 +202,31 @@ void generateKeypoints3D(
 		depthMethod);
 }
 
+//=============================================================================
+// Remove keypoints whose 3D coords are invalid, "kpts" and "kpts3d" stay
+// paired. Returns the number of removed keypoints.
+//=============================================================================
+int removeKeypointsWithoutDepth(
+	std::vector<cv::KeyPoint> &kpts,
+	std::vector<cv::Point3f> &kpts3d)
+{
+	int num = 0;
+	for (int i = 0; i < (int)kpts.size(); i++)
+	{
+		if (isFinite(kpts3d[i])) {
+			kpts[num] = kpts[i];
+			kpts3d[num] = kpts3d[i];
+			num++;
+		}
+	}
+
+	int removed = (int)kpts.size() - num;
+	kpts.resize(num);
+	kpts3d.resize(num);
+
+	return removed;
+}
+
 cv::Point3f projectDisparityTo3D(
 	const cv::Point2f &pt2d,
 	float disp,
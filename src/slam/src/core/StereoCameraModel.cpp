@@ -16,6 +16,24 @@ StereoCameraModel::StereoCameraModel() {
 StereoCameraModel::~StereoCameraModel() {
 }
 
+// reads a matrix written by cv::FileStorage, empty if not found
+static cv::Mat readMatrix(cv::FileStorage &fs, const char *name)
+{
+	cv::FileNode n = fs[name];
+	if (n.type() == cv::FileNode::NONE) {
+		return cv::Mat();
+	}
+	int rows = (int)n["rows"];
+	int cols = (int)n["cols"];
+	std::vector<double> data;
+	n["data"] >> data;
+	if ((int)data.size() != rows * cols) {
+		LOG_WARN("Illegal matrix %s (%d,%d)\n", name, rows, cols);
+		return cv::Mat();
+	}
+	return cv::Mat(rows, cols, CV_64FC1, data.data()).clone();
+}
+
 bool StereoCameraModel::load(
 	const std::string &fileNameLeft,
 	const std::string &fileNameRight,
@@ -24,6 +42,11 @@ bool StereoCameraModel::load(
 	_P[0] = cv::Mat(3, 4, CV_64FC1);
 	_P[1] = cv::Mat(3, 4, CV_64FC1);
 	_imageSize = cv::Size();
+	for (int lr = 0; lr < 2; lr++) {
+		_rawK[lr] = cv::Mat();
+		_rawD[lr] = cv::Mat();
+		_rectR[lr] = cv::Mat();
+	}
 
 	// read calibration files
 	if (!fileNameRight.empty()) {
@@ -58,6 +81,14 @@ bool StereoCameraModel::load(
 					_P[lr] = cv::Mat(rows, cols, CV_64FC1, data.data()).clone();
 				}
 
+				// for the rectification of raw images
+				_rawK[lr] = readMatrix(fs, "camera_matrix");
+				_rawD[lr] = readMatrix(fs, "distortion_coefficients");
+				_rectR[lr] = readMatrix(fs, "rectification_matrix");
+				if (_rectR[lr].empty()) {
+					_rectR[lr] = cv::Mat::eye(3, 3, CV_64FC1);
+				}
+
 				fs.release();
 			}
 			else {
@@ -115,6 +146,12 @@ bool StereoCameraModel::load(
 			_P[lr].at<double>(1, 1) *= sy; // fy
 			_P[lr].at<double>(1, 2) *= sy; // cy
 			_P[lr].at<double>(1, 3) *= sy; // Ty
+			if (!_rawK[lr].empty()) {
+				_rawK[lr].at<double>(0, 0) *= sx;
+				_rawK[lr].at<double>(0, 2) *= sx;
+				_rawK[lr].at<double>(1, 1) *= sy;
+				_rawK[lr].at<double>(1, 2) *= sy;
+			}
 		}
 	}
 
@@ -136,6 +173,9 @@ unsigned long StereoCameraModel::getSize()
 	unsigned long memUsed = (unsigned long)(
 		sizeof(StereoCameraModel) +
 		(sizeof(cv::Mat) + _P[0].total() * _P[0].elemSize()) * 2 +
+		(sizeof(cv::Mat) + _rawK[0].total() * _rawK[0].elemSize()) * 2 +
+		(sizeof(cv::Mat) + _rawD[0].total() * _rawD[0].elemSize()) * 2 +
+		(sizeof(cv::Mat) + _rectR[0].total() * _rectR[0].elemSize()) * 2 +
 		_localTransform.getSize());
 
 	return memUsed;
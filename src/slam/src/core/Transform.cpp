@@ -3,11 +3,12 @@
 // SPDX-License-Identifier: MIT
 //=============================================================================
 #include "core/Transform.h"
+#include <opencv2/core/hal/intrin.hpp>
 #include <iomanip>
 
 Transform::Transform()
 {
-	data_ = cv::Mat::zeros(3, 4, CV_32FC1);
+	std::fill(data_, data_ + 12, 0.0f);
 }
 
 Transform::~Transform()
@@ -19,19 +20,18 @@ Transform::Transform(
 	float r21, float r22, float r23, float o24,
 	float r31, float r32, float r33, float o34)
 {
-	data_ = cv::Mat(3, 4, CV_32FC1);
-	data_.at<float>(0, 0) = r11;
-	data_.at<float>(0, 1) = r12;
-	data_.at<float>(0, 2) = r13;
-	data_.at<float>(0, 3) = o14;
-	data_.at<float>(1, 0) = r21;
-	data_.at<float>(1, 1) = r22;
-	data_.at<float>(1, 2) = r23;
-	data_.at<float>(1, 3) = o24;
-	data_.at<float>(2, 0) = r31;
-	data_.at<float>(2, 1) = r32;
-	data_.at<float>(2, 2) = r33;
-	data_.at<float>(2, 3) = o34;
+	data_[0] = r11;
+	data_[1] = r12;
+	data_[2] = r13;
+	data_[3] = o14;
+	data_[4] = r21;
+	data_[5] = r22;
+	data_[6] = r23;
+	data_[7] = o24;
+	data_[8] = r31;
+	data_[9] = r32;
+	data_[10] = r33;
+	data_[11] = o34;
 }
 
 Transform::Transform(
@@ -39,28 +39,29 @@ Transform::Transform(
 	double r21, double r22, double r23, double o24,
 	double r31, double r32, double r33, double o34)
 {
-	data_ = cv::Mat(3, 4, CV_32FC1);
-	data_.at<float>(0, 0) = (float)r11;
-	data_.at<float>(0, 1) = (float)r12;
-	data_.at<float>(0, 2) = (float)r13;
-	data_.at<float>(0, 3) = (float)o14;
-	data_.at<float>(1, 0) = (float)r21;
-	data_.at<float>(1, 1) = (float)r22;
-	data_.at<float>(1, 2) = (float)r23;
-	data_.at<float>(1, 3) = (float)o24;
-	data_.at<float>(2, 0) = (float)r31;
-	data_.at<float>(2, 1) = (float)r32;
-	data_.at<float>(2, 2) = (float)r33;
-	data_.at<float>(2, 3) = (float)o34;
+	data_[0] = (float)r11;
+	data_[1] = (float)r12;
+	data_[2] = (float)r13;
+	data_[3] = (float)o14;
+	data_[4] = (float)r21;
+	data_[5] = (float)r22;
+	data_[6] = (float)r23;
+	data_[7] = (float)o24;
+	data_[8] = (float)r31;
+	data_[9] = (float)r32;
+	data_[10] = (float)r33;
+	data_[11] = (float)o34;
 }
 
 Transform::Transform(const cv::Mat & mat)
 {
+	// copied, the matrix is not shared with "mat"
+	cv::Mat dst(3, 4, CV_32FC1, data_);
 	if (mat.type() == CV_32FC1) {
-		data_ = mat;
+		mat.copyTo(dst);
 	}
 	else {
-		mat.convertTo(data_, CV_32F);
+		mat.convertTo(dst, CV_32F);
 	}
 }
 
@@ -87,11 +88,13 @@ Transform::Transform(float x, float y, float z, float roll, float pitch, float y
 
 bool Transform::isNull() const
 {
-	if (data_.empty() || (cv::countNonZero(data_) == 0)) {
-		return true;
+	for (int i = 0; i < 12; i++) {
+		if (data_[i] != 0.0f) {
+			return false;
+		}
 	}
 
-	return false;
+	return true;
 }
 
 void Transform::setNull()
@@ -111,15 +114,26 @@ Transform Transform::getIdentity()
 
 Transform Transform::inverse() const
 {
-	Eigen::Matrix4f e4f = toEigen4f();
+	// inverse of the 3x3 part from the cross products of its rows,
+	// the result is null if it is not invertible
+	const float *m = data_;
+	float c0[3] = { m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8] };
+	float c1[3] = { m[9] * m[2] - m[10] * m[1], m[10] * m[0] - m[8] * m[2], m[8] * m[1] - m[9] * m[0] };
+	float c2[3] = { m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4] };
+	float det = m[0] * c0[0] + m[1] * c0[1] + m[2] * c0[2];
+	if (det == 0.0f) {
+		return Transform();
+	}
 
-	// Computation of matrix inverse and determinant, with invertibility check.
-	bool invertible = false;
-	Eigen::Matrix4f inverse;
-	Eigen::Matrix4f::RealScalar det;
-	e4f.computeInverseAndDetWithCheck(inverse, det, invertible);
-	
-	Transform tr = fromEigen4f(inverse);
+	float id = 1.0f / det;
+	Transform tr;
+	float *r = tr.data_;
+	for (int i = 0; i < 3; i++) {
+		r[i * 4 + 0] = c0[i] * id;
+		r[i * 4 + 1] = c1[i] * id;
+		r[i * 4 + 2] = c2[i] * id;
+		r[i * 4 + 3] = -(r[i * 4 + 0] * m[3] + r[i * 4 + 1] * m[7] + r[i * 4 + 2] * m[11]);
+	}
 
 	return tr;
 }
@@ -187,16 +201,45 @@ Eigen::Matrix4f Transform::toEigen4f() const
 	return e4f;
 }
 
+Eigen::Isometry3d Transform::toIsometry3d() const
+{
+	Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+	pose.matrix().topRows<3>() = toEigen3x4f().cast<double>();
+
+	return pose;
+}
+
 Transform Transform::operator*(const Transform & tr) const
 {
-	// 4 x 4 matrix multiplication
-	Eigen::Matrix4f e4f = toEigen4f() * tr.toEigen4f();
+	// [Ra|ta] * [Rb|tb] = [Ra*Rb|Ra*tb+ta], each row is a linear
+	// combination of the rows of "tr"
+	const float *a = data_;
+	const float *b = tr.data_;
+	Transform out;
+#if CV_SIMD128
+	v_float32x4 b0 = v_load(b), b1 = v_load(b + 4), b2 = v_load(b + 8);
+	for (int i = 0; i < 3; i++) {
+		const float *ai = a + i * 4;
+		v_float32x4 ti(0.0f, 0.0f, 0.0f, ai[3]);
+		v_store(out.data_ + i * 4,
+			v_muladd(v_setall_f32(ai[0]), b0, v_muladd(v_setall_f32(ai[1]), b1, v_muladd(v_setall_f32(ai[2]), b2, ti))));
+	}
+#else
+	for (int i = 0; i < 3; i++) {
+		const float *ai = a + i * 4;
+		for (int j = 0; j < 4; j++) {
+			out.data_[i * 4 + j] = ai[0] * b[j] + ai[1] * b[4 + j] + ai[2] * b[8 + j];
+		}
+		out.data_[i * 4 + 3] += ai[3];
+	}
+#endif
 
 	// make sure rotation is always normalized!
-	Eigen::Affine3f af = Eigen::Affine3f(e4f);
-	af.linear() = Eigen::Quaternionf(af.linear()).normalized().toRotationMatrix();
+	Eigen::Map<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>> m(out.data_);
+	Eigen::Matrix3f rot = m.leftCols<3>();
+	m.leftCols<3>() = Eigen::Quaternionf(rot).normalized().toRotationMatrix();
 
-	return fromEigen3f(af);
+	return out;
 }
 
 Transform & Transform::operator*=(const Transform & tr)
@@ -205,7 +248,19 @@ Transform & Transform::operator*=(const Transform & tr)
 	return *this;
 }
 
+void Transform::transformPoints(const cv::Point3f *src, cv::Point3f *dst, int n) const
+{
+	const float r11 = data_[0], r12 = data_[1], r13 = data_[2], o14 = data_[3];
+	const float r21 = data_[4], r22 = data_[5], r23 = data_[6], o24 = data_[7];
+	const float r31 = data_[8], r32 = data_[9], r33 = data_[10], o34 = data_[11];
+	for (int i = 0; i < n; i++) {
+		float x = src[i].x, y = src[i].y, z = src[i].z;
+		dst[i].x = r11 * x + r12 * y + r13 * z + o14;
+		dst[i].y = r21 * x + r22 * y + r23 * z + o24;
+		dst[i].z = r31 * x + r32 * y + r33 * z + o34;
+	}
+}
+
 unsigned long Transform::getSize() {
-	unsigned long memUsed = (unsigned long)(data_.total() * data_.elemSize());
-	return memUsed;
+	return 0;
 }
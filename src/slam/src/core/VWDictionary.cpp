@@ -5,18 +5,23 @@
 #include "core/VWDictionary.h"
 #include "core/Perf.h"
 
+#include <algorithm>
+
 extern Perf perf;
 
 VWDictionary::VWDictionary()
 {
 	_lastWordId = 0;
+	_removedCount = 0;
 	_flannIndex = new FlannIndex();
+	_vocabulary = new Vocabulary();
 }
 
 VWDictionary::~VWDictionary()
 {
 	this->clear();
 	delete _flannIndex;
+	delete _vocabulary;
 }
 
 void VWDictionary::clear()
@@ -28,7 +33,9 @@ void VWDictionary::clear()
 
 	_visualWords.clear();
 	_lastWordId = 0;
+	_removedCount = 0;
 	_mapIndexId.clear();
+	_mapIdIndex.clear();
 	_flannIndex->release();
 }
 
@@ -37,8 +44,18 @@ int VWDictionary::getNextId()
 	return _lastWordId++;
 }
 
+// NOTE:the vocabulary is kept by clear()
+bool VWDictionary::loadVocabulary(const std::string &path)
+{
+	return _vocabulary->load(path);
+}
+
 std::list<int> VWDictionary::addNewWords(const cv::Mat descriptorsIn, int nodeId)
 {
+	if (_vocabulary->isLoaded()) {
+		return quantizeWords(descriptorsIn, nodeId);
+	}
+
 	// local parameter
 	float nndrRatio = 0.8f;
 
@@ -66,6 +83,10 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat descriptorsIn, int nodeId
 			float dist = dists.at<float>(i, j);
 			int index = (int)results.at<size_t>(i, j);
 			auto itr = _mapIndexId.find(index); // VW index associated with KD-tree index
+			if (itr == _mapIndexId.end()) {
+				// not found, only removed VWs around
+				continue;
+			}
 			fullResults.insert(std::pair<float, int>(dist, itr->second));
 		}
 
@@ -96,6 +117,7 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat descriptorsIn, int nodeId
 				index = _flannIndex->addPoints(descriptors.row(i)).front();
 			}
 			_mapIndexId.insert(std::pair<int, int>(index, vw->id())); // <KDTree index, VW ID>
+			_mapIdIndex.insert(std::pair<int, int>(vw->id(), index)); // <VW ID, KDTree index>
 
 			wordIds.push_back(vw->id());
 		}
@@ -114,6 +136,98 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat descriptorsIn, int nodeId
 	return wordIds;
 }
 
+//==================================================================
+// With a fixed vocabulary, each descriptor is given the word at the
+// leaf of the vocabulary tree. VisualWord holding the references is
+// created when the word is observed for the first time.
+//==================================================================
+std::list<int> VWDictionary::quantizeWords(const cv::Mat &descriptors, int nodeId)
+{
+	std::list<int> wordIds;
+	for (int i = 0; i < descriptors.rows; i++)
+	{
+		int vwid = _vocabulary->quantize(descriptors.ptr<unsigned char>(i));
+
+		auto itr = _visualWords.find(vwid);
+		if (itr == _visualWords.end()) {
+			VisualWord *vw = new VisualWord(vwid, descriptors.row(i), nodeId);
+			_visualWords.insert(std::pair<int, VisualWord *>(vwid, vw));
+		}
+		else {
+			itr->second->addRef(nodeId);
+		}
+
+		wordIds.push_back(vwid);
+	}
+
+	return wordIds;
+}
+
+//==================================================================
+// Existing VWs of the descriptors, the dictionary is not updated.
+// Returns sorted unique VW IDs, descriptors that would make a new
+// VW are ignored.
+//==================================================================
+std::vector<int> VWDictionary::findWords(const cv::Mat &descriptorsIn)
+{
+	std::vector<int> wordIds;
+	if (_vocabulary->isLoaded())
+	{
+		for (int i = 0; i < descriptorsIn.rows; i++)
+		{
+			int vwid = _vocabulary->quantize(descriptorsIn.ptr<unsigned char>(i));
+			if (_visualWords.find(vwid) != _visualWords.end()) {
+				wordIds.push_back(vwid);
+			}
+		}
+	}
+	else if (_flannIndex->isBuilt())
+	{
+		// same NNDR as addNewWords()
+		float nndrRatio = 0.8f;
+		cv::Mat descriptors;
+		descriptorsIn.convertTo(descriptors, CV_32F);
+
+		cv::Mat results;
+		cv::Mat dists;
+		int KNN = 2;
+		int KNN_CHECKS = 32;
+		_flannIndex->knnSearch(descriptors, results, dists, KNN, KNN_CHECKS);
+
+		for (int i = 0; i < descriptors.rows; i++)
+		{
+			int best = -1;
+			float bestDist = 0.0f;
+			float secondDist = 0.0f;
+			int num = 0;
+			for (int j = 0; j < dists.cols; j++)
+			{
+				auto itr = _mapIndexId.find((int)results.at<size_t>(i, j));
+				if (itr == _mapIndexId.end()) {
+					continue;
+				}
+				if (num == 0) {
+					best = itr->second;
+					bestDist = dists.at<float>(i, j);
+				}
+				else {
+					secondDist = dists.at<float>(i, j);
+				}
+				num++;
+			}
+
+			if ((num == 2) && (bestDist <= nndrRatio * secondDist)) {
+				wordIds.push_back(best);
+			}
+		}
+	}
+
+	std::sort(wordIds.begin(), wordIds.end());
+	wordIds.erase(std::unique(wordIds.begin(), wordIds.end()), wordIds.end());
+
+	return wordIds;
+}
+
 const VisualWord* VWDictionary::getWord(int id) const
 {
 	auto itr = _visualWords.find(id);
@@ -126,12 +240,94 @@ const VisualWord* VWDictionary::getWord(int id) const
 	}
 }
 
+void VWDictionary::removeWord(int id)
+{
+	auto itr = _visualWords.find(id);
+	if (itr == _visualWords.end()) {
+		return;
+	}
+
+	auto itr_index = _mapIdIndex.find(id);
+	if (itr_index != _mapIdIndex.end()) {
+		_flannIndex->removePoint(itr_index->second);
+		_mapIndexId.erase(itr_index->second);
+		_mapIdIndex.erase(itr_index);
+	}
+
+	delete itr->second;
+	_visualWords.erase(itr);
+	_removedCount++;
+}
+
+//==================================================================
+// Removes VWs referred only by the given node. Called when the node
+// leaves the short-term memory, such VWs were never observed again
+// by the following nodes.
+//==================================================================
+int VWDictionary::removeSingleRefWords(const std::list<int> &wordIds, int nodeId)
+{
+	int removed = 0;
+	for (auto itr = wordIds.begin(); itr != wordIds.end(); itr++)
+	{
+		auto itr_vw = _visualWords.find(*itr);
+		if (itr_vw == _visualWords.end()) {
+			continue;
+		}
+
+		const std::map<int, int> &refs = itr_vw->second->getReferences();
+		if ((refs.size() == 1) && (refs.begin()->first == nodeId)) {
+			removeWord(*itr);
+			removed++;
+		}
+	}
+
+	return removed;
+}
+
+//==================================================================
+// Keeps the number of VWs below "maxWords". VWs referred by fewer
+// nodes are removed first, older ones first among them.
+//==================================================================
+int VWDictionary::limitWords(int maxWords)
+{
+	int removed = 0;
+	if (maxWords <= 0) {
+		return removed;
+	}
+
+	for (int refs = 1; (int)_visualWords.size() > maxWords; refs++)
+	{
+		auto itr = _visualWords.begin();
+		while ((itr != _visualWords.end()) && ((int)_visualWords.size() > maxWords))
+		{
+			int id = itr->first;
+			int numRefs = (int)itr->second->getReferences().size();
+			itr++;
+			if (numRefs <= refs) {
+				removeWord(id);
+				removed++;
+			}
+		}
+	}
+
+	return removed;
+}
+
+// rebuild the KD-tree once a quarter of the points are removed
+void VWDictionary::compact()
+{
+	unsigned int removedFeatures = _flannIndex->removedFeatures();
+	if (removedFeatures * 4 > _flannIndex->indexedFeatures() + removedFeatures) {
+		_flannIndex->compact();
+	}
+}
+
 void VWDictionary::getMemoryUsed()
 {
 	unsigned long memUsed = (unsigned long)(
 		sizeof(VWDictionary) +
-		sizeof(std::map<int, int>) +
-		_mapIndexId.size() * (12 + sizeof(int) + sizeof(int)));
+		sizeof(std::map<int, int>) * 2 +
+		(_mapIndexId.size() + _mapIdIndex.size()) * (12 + sizeof(int) + sizeof(int)));
 
 	for (auto itr = _visualWords.begin(); itr != _visualWords.end(); itr++) {
 		memUsed += itr->second->getSize();
@@ -140,4 +336,11 @@ void VWDictionary::getMemoryUsed()
 	perf.registerMemoryUsed("VWDictionary", memUsed);
 
 	perf.registerMemoryUsed("_flannIndex", _flannIndex->getSize());
+
+	// mapped, not allocated
+	perf.registerMemoryUsed("Vocabulary", _vocabulary->getSize());
+
+	// number of VWs, not memory
+	perf.registerMemoryUsed("VWNumWords", (unsigned long)_visualWords.size());
+	perf.registerMemoryUsed("VWNumRemoved", (unsigned long)_removedCount);
 }
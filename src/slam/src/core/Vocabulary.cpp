@@ -0,0 +1,164 @@
+//=============================================================================
+// Copyright (C) 2023 Nu-Gate Technology. All rights reserved.
+// SPDX-License-Identifier: MIT
+//=============================================================================
+#include "core/Vocabulary.h"
+#include "core/Logger.h"
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/hal/hal.hpp>
+#include <limits.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+Vocabulary::Vocabulary()
+{
+	_data = 0;
+	_dataSize = 0;
+	_header = 0;
+	_nodes = 0;
+}
+
+Vocabulary::~Vocabulary()
+{
+	release();
+}
+
+bool Vocabulary::load(const std::string &path)
+{
+	release();
+
+#ifndef _WIN32
+	//==================================================================
+	// map the file read-only
+	//==================================================================
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		LOG_WARN("failed to open %s\n", path.c_str());
+		return false;
+	}
+
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(VOCAB_HEADER))) {
+		LOG_WARN("invalid vocabulary file %s\n", path.c_str());
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		LOG_WARN("mmap failed\n");
+		return false;
+	}
+	_data = data;
+	_dataSize = (size_t)st.st_size;
+#else
+	//==================================================================
+	// no mmap, read the whole file
+	//==================================================================
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (fp == 0) {
+		LOG_WARN("failed to open %s\n", path.c_str());
+		return false;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (size < (long)sizeof(VOCAB_HEADER)) {
+		LOG_WARN("invalid vocabulary file %s\n", path.c_str());
+		fclose(fp);
+		return false;
+	}
+
+	_data = new char[size];
+	_dataSize = (size_t)size;
+	size_t readSize = fread(_data, 1, _dataSize, fp);
+	fclose(fp);
+	if (readSize != _dataSize) {
+		LOG_WARN("failed to read %s\n", path.c_str());
+		release();
+		return false;
+	}
+#endif
+
+	//==================================================================
+	// check the header
+	//==================================================================
+	const VOCAB_HEADER *header = (const VOCAB_HEADER*)_data;
+	if ((header->magic != VOCAB_MAGIC) ||
+		(header->version != VOCAB_VERSION) ||
+		(header->descBytes != VOCAB_DESC_BYTES) ||
+		(header->numNodes == 0) ||
+		(_dataSize < sizeof(VOCAB_HEADER) + (size_t)header->numNodes * sizeof(VOCAB_NODE)))
+	{
+		LOG_WARN("invalid vocabulary file %s\n", path.c_str());
+		release();
+		return false;
+	}
+
+	_header = header;
+	_nodes = (const VOCAB_NODE*)((const char*)_data + sizeof(VOCAB_HEADER));
+
+	LOG_INFO("vocabulary loaded (%d words, k=%d, L=%d)\n",
+		_header->numWords, _header->branching, _header->depth);
+
+	return true;
+}
+
+void Vocabulary::release()
+{
+	if (_data) {
+#ifndef _WIN32
+		munmap(_data, _dataSize);
+#else
+		delete[] (char*)_data;
+#endif
+	}
+
+	_data = 0;
+	_dataSize = 0;
+	_header = 0;
+	_nodes = 0;
+}
+
+//==================================================================
+// Descends the tree from the root, choosing the closest child in
+// Hamming distance at each level. Returns the word ID of the leaf.
+//==================================================================
+int Vocabulary::quantize(const unsigned char *desc) const
+{
+	if (!_nodes) {
+		return 0;
+	}
+
+	int numNodes = (int)_header->numNodes;
+	int idx = 0;
+	while (_nodes[idx].numChildren > 0)
+	{
+		int first = _nodes[idx].firstChild;
+		int last = first + _nodes[idx].numChildren;
+		if ((first <= idx) || (last > numNodes)) {
+			// broken file
+			return 0;
+		}
+
+		int best = first;
+		int bestDist = INT_MAX;
+		for (int i = first; i < last; i++) {
+			int dist = cv::hal::normHamming(desc, _nodes[i].desc, VOCAB_DESC_BYTES);
+			if (dist < bestDist) {
+				bestDist = dist;
+				best = i;
+			}
+		}
+		idx = best;
+	}
+
+	return _nodes[idx].wordId;
+}
@@ -16,15 +16,23 @@
 #include "core/Logger.h"
 #include "core/GFTT.h"
 #include "opencv/CvORB.h"
+#include "core/OrbDescriptor.h"
+#include "core/SparseBM.h"
+#include "core/SoftBM.h"
+#include "core/SoftGFTT.h"
+#include "core/SoftRect.h"
 #include "core/Stereo.h"
 #include "core/EigenTypes.h"
 #include "core/GraphVertex.h"
 #include "core/GraphEdge.h"
 #include "core/HyperGraph.h"
 #include "core/FPGA.h"
+#include "core/Imu.h"
 #include "core/Parameters.h"
 #include "core/Perf.h"
 #include "core/Optimizer.h"
+#include "core/xThread.h"
+#include "core/FramePool.h"
 #include "octomap/octomap.h"
 #include "octomap/OcTree.h"
 
@@ -37,6 +45,8 @@
 
 APP_SETTING appSetting;
 Perf perf;
+xThreadPool threadPool;
+FramePool framePool;
 
 int appStereoCapture (Fpga *fpga, ARG_PARAMS args);
 int appFrameGrabber(Fpga *fpga, ARG_PARAMS args);
@@ -74,6 +84,9 @@ int main(int argc, char * argv[])
 	REMOTE_SETTING remoteSetting;
 	parseArguments(argc, argv, &args, &appSetting, &remoteSetting);
 
+	// worker threads
+	threadPool.create(appSetting.numThreads);
+
 
 	//==================================================================
 	// Initialize Hardware
@@ -131,20 +144,113 @@ int main(int argc, char * argv[])
 	StereoCameraModel stereoCameraModel;
 	stereoCameraModel.load(args.pathLeftCalib, args.pathRightCalib, appSetting.doResize);
 
+	// rectification of raw input images on the CPU
+	SoftRect softRect;
+	if (appSetting.rawInput) {
+		cv::Size rectSize = appSetting.doResize ? cv::Size(640, 480) : stereoCameraModel.imageSize();
+		if (!softRect.init(stereoCameraModel, rectSize)) {
+			LOG_ERROR("failed to build the rectification tables\n");
+		}
+	}
+
 	int totalImages = (int)camera->filenames().size();
 	LOG_INFO("Processing %d images...\n", totalImages);
 
+	// gyro rotation as the motion prior, from the FPGA sample ring
+	// for sensor input or from a recorded log
+	Imu imu;
+	if (appSetting.useImu) {
+		if (!args.pathImu.empty() && !imu.load(args.pathImu)) {
+			LOG_ERROR("failed to load IMU log %s\n", args.pathImu.c_str());
+		}
+		if (!args.pathImuCalib.empty() && !imu.loadExtrinsic(args.pathImuCalib)) {
+			LOG_ERROR("failed to load IMU extrinsic %s\n", args.pathImuCalib.c_str());
+		}
+	}
+
 	Odometry odom;
+	odom.setTracking(appSetting.odomTracking != 0);
+	odom.setLocalMap(appSetting.odomLocalMap != 0);
+	odom.setRelocalization(appSetting.relocTopK > 0);
+	if (appSetting.useImu) {
+		odom.setImu(&imu);
+	}
 	ODOM_INFO odomInfo;
 	Mapper mapper;
 	mapper.init();
+	if (!args.pathVocabulary.empty()) {
+		if (!mapper.loadVocabulary(args.pathVocabulary)) {
+			LOG_ERROR("failed to load vocabulary %s\n", args.pathVocabulary.c_str());
+		}
+	}
 
 	//==================================================================
 	// Main Loop
 	//==================================================================
+	// stereo matchers are created once
+	cv::Ptr<cv::StereoBM> bm;
+	cv::Ptr<cv::StereoSGBM> sgbm;
+	if (appSetting.depthMethod == DEPTH_METHOD_CV_BM) {
+		int setNumDisparities = 64; // max search range
+		int setUniquenessRatio = 10; // NNDR
+		cv::Rect roi1, roi2;
+		bm = cv::StereoBM::create(16, 9);
+		bm->setROI1(roi1);
+		bm->setROI2(roi2);
+		bm->setPreFilterCap(31);
+		bm->setBlockSize(21);
+		bm->setMinDisparity(0);
+		bm->setNumDisparities(setNumDisparities);
+		bm->setTextureThreshold(10);
+		bm->setUniquenessRatio(setUniquenessRatio);
+		bm->setSpeckleWindowSize(50);
+		bm->setSpeckleRange(32);
+		bm->setDisp12MaxDiff(1);
+	}
+	else if (appSetting.depthMethod == DEPTH_METHOD_CV_SGBM) {
+		sgbm = cv::StereoSGBM::create(
+			-64, // minDisparity
+			128, // numDisparities
+			11, // blockSize
+			100, // P1
+			1000, // P2
+			32, // disp12MaxDiff
+			0, // uniquenessRatio
+			15, // speckleWindowSize
+			1000, // speckleRange
+			16, // mode
+			cv::StereoSGBM::MODE_HH); // speckleRange
+	}
+
+	SPARSE_BM_PARAM sparseBMParam;
+	sparseBMParam.blockSize = 15;
+	sparseBMParam.numDisparities = 64;
+	sparseBMParam.preFilterCap = 31;
+	sparseBMParam.textureThreshold = 10;
+	sparseBMParam.uniquenessRatio = 10;
+	sparseBMParam.gridStep = 16; // for the occupancy map
+	SparseBM sparseBM(sparseBMParam);
+
+	// same settings as the FPGA (BmSetting, UniFiltCtrl)
+	SOFT_BM_PARAM softBMParam;
+	softBMParam.blockSize = 21;
+	softBMParam.numDisparities = 64;
+	softBMParam.uniEnable = 0;
+	softBMParam.uniMode = 0;
+	softBMParam.uniThreshold = 0;
+	SoftBM softBM(softBMParam);
+
+	SoftGFTT softGFTT;
+
+	// feature storage of the frame loop, reserved once
+	OrbDescriptor orb(appSetting.descMethod);
 	std::vector<cv::KeyPoint> kpts2d;
+	std::vector<cv::KeyPoint> kpts2dCopy;
 	cv::Mat desc;
 	std::vector<cv::Point3f> kpts3d;
+	kpts2d.reserve(FRAME_POOL_KEYPOINTS);
+	kpts2dCopy.reserve(FRAME_POOL_KEYPOINTS);
+	kpts3d.reserve(FRAME_POOL_KEYPOINTS);
 	int iteration = 0;
 	while (1)
 	{
@@ -161,6 +267,14 @@ int main(int argc, char * argv[])
 			camera->captureFromFile(data, appSetting);
 			perf.stopTime("captureImageLR");
 
+			if (appSetting.rawInput && !data.imageLeft().empty()) {
+				perf.startTime("rectify");
+				cv::Mat left, right;
+				softRect.compute(data.imageLeft(), data.imageRight(), left, right);
+				data.setStereoImage(left, right);
+				perf.stopTime("rectify");
+			}
+
 			// FPGA test mode
 			if (appSetting.useFpga)
 			{
@@ -184,6 +298,11 @@ int main(int argc, char * argv[])
 		{
 			// real-time process
 			camera->captureFromFpga(&fpga, data, appSetting);
+
+			// inertial samples up to the frame
+			if (appSetting.useImu && (fpga.receiveImu(imu) < 0) && (iteration == 0)) {
+				LOG_WARN("IMU not found by the remote app\n");
+			}
 		}
 
 		// end of the files
@@ -194,65 +313,123 @@ int main(int argc, char * argv[])
 		//--------------------------------------------------------------
 		// Generate features
 		//--------------------------------------------------------------
-		if (appSetting.depthMethod == DEPTH_METHOD_CV_BM) {
-			int setNumDisparities = 64; // max search range
-			int setUniquenessRatio = 10; // NNDR
-			cv::Rect roi1, roi2;
-			cv::Ptr<cv::StereoBM> bm = cv::StereoBM::create(16, 9);
-			bm->setROI1(roi1);
-			bm->setROI2(roi2);
-			bm->setPreFilterCap(31);
-			bm->setBlockSize(21);
-			bm->setMinDisparity(0);
-			bm->setNumDisparities(setNumDisparities);
-			bm->setTextureThreshold(10);
-			bm->setUniquenessRatio(setUniquenessRatio);
-			bm->setSpeckleWindowSize(50);
-			bm->setSpeckleRange(32);
-			bm->setDisp12MaxDiff(1);
-
-			cv::Mat disp;
-			bm->compute(data.imageLeft(), data.imageRight(), disp);
-			data.setImageDepth(disp);
-		}
-		else if (appSetting.depthMethod == DEPTH_METHOD_CV_SGBM) {
-			cv::Ptr<cv::StereoSGBM> sgbm = cv::StereoSGBM::create(
-				-64, // minDisparity
-				128, // numDisparities
-				11, // blockSize
-				100, // P1
-				1000, // P2
-				32, // disp12MaxDiff
-				0, // uniquenessRatio
-				15, // speckleWindowSize
-				1000, // speckleRange
-				16, // mode
-				cv::StereoSGBM::MODE_HH); // speckleRange
-
-			cv::Mat disp;
-			sgbm->compute(data.imageLeft(), data.imageRight(), disp);
-			data.setImageDepth(disp);
-		}
+		// task graph on the thread pool
+		//   stage 1: depth map || (tracking or keypoint detection)
+		//   stage 2: description || 3D coords of the keypoints
+		// the depth map and the keypoints only depend on the input
+		// images, the description and the 3D coords only depend on
+		// the keypoints and the depth map.
+		auto depthTask = [&]() {
+			perf.startTime("depth");
+			if (appSetting.depthMethod == DEPTH_METHOD_CV_BM) {
+				cv::Mat disp = framePool.acquire(data.imageLeft().size(), CV_16SC1);
+				bm->compute(data.imageLeft(), data.imageRight(), disp);
+				data.setImageDepth(disp);
+			}
+			else if (appSetting.depthMethod == DEPTH_METHOD_CV_SGBM) {
+				cv::Mat disp = framePool.acquire(data.imageLeft().size(), CV_16SC1);
+				sgbm->compute(data.imageLeft(), data.imageRight(), disp);
+				data.setImageDepth(disp);
+			}
+			else if (appSetting.depthMethod == DEPTH_METHOD_SPARSE_BM) {
+				// keypoints are matched in generateKeypoints3D(),
+				// the grid is only for the occupancy map
+				cv::Mat disp;
+				sparseBM.setImages(data.imageLeft(), data.imageRight());
+				sparseBM.computeGrid(disp);
+				data.setImageDepth(disp);
+			}
+			else if (appSetting.depthMethod == DEPTH_METHOD_SOFT_BM) {
+				cv::Mat disp;
+				softBM.compute(data.imageLeft(), data.imageRight(), disp);
+				data.setImageDepth(disp);
+			}
+			perf.stopTime("depth");
+		};
+
+		// keypoints of the key frame are tracked, the detection and
+		// the description run only when the tracking fails, a key frame
+		// is pending or the mapper needs the features of a full node
+		bool tracked = false;
+		auto kptsTask = [&]() {
+			if (appSetting.odomTracking && !mapper.needsFeatures()) {
+				perf.startTime("track");
+				tracked = odom.track(data, kpts2d, desc);
+				perf.stopTime("track");
+			}
+			if (tracked) {
+				return;
+			}
 
-		perf.startTime("kpts");
-		if (appSetting.kptsMethod == KPTS_METHOD_CV_GFTT) {
-			generateKeypoints(data.imageLeft(), kpts2d);
+			perf.startTime("kpts");
+			if (appSetting.kptsMethod == KPTS_METHOD_CV_GFTT) {
+				generateKeypoints(data.imageLeft(), kpts2d);
+			}
+			else if (appSetting.kptsMethod == KPTS_METHOD_FPGA_GFTT) {
+				generateKeypoints2(data.imageEigen(), data.maxEigen(), kpts2d);
+			}
+			else if (appSetting.kptsMethod == KPTS_METHOD_SOFT_GFTT) {
+				cv::Mat eig;
+				unsigned short maxEigen;
+				softGFTT.compute(data.imageLeft(), eig, &maxEigen);
+				data.setImageEigen(eig);
+				data.setMaxEigen(maxEigen);
+				generateKeypoints2(data.imageEigen(), data.maxEigen(), kpts2d);
+			}
+			perf.stopTime("kpts");
+
+			// the image border check of the descriptor is applied
+			// beforehand to keep "kpts3d" paired
+			runByImageBorder(kpts2d, data.imageLeft().size(), ORB_EDGE_THRESHOLD);
+		};
+
+		threadPool.parallelInvoke({ depthTask, kptsTask });
+
+		// the descriptor may update the keypoint angle,
+		// the 3D coords are computed from a copy
+		auto kpts3dTask = [&]() {
+			perf.startTime("kpts3d");
+			generateKeypoints3D(data, stereoCameraModel, kpts2dCopy, kpts3d, data.imageDepth(), appSetting.depthMethod, &sparseBM);
+			perf.stopTime("kpts3d");
+		};
+
+		auto descTask = [&]() {
+			perf.startTime("desc");
+			// the previous frame keeps its descriptors, create() must not
+			// write into them when the number of keypoints is the same
+			desc.release();
+			if (appSetting.descMethod == DESC_METHOD_CV_ORB) {
+				computeDescriptor(data.imageLeft(), cv::noArray(), kpts2d, true, desc);
+			}
+			else {
+				orb.compute(data.imageLeft(), kpts2d, desc);
+			}
+			perf.stopTime("desc");
+		};
+
+		kpts2dCopy = kpts2d;
+		if (tracked) {
+			// descriptors are inherited from the key frame
+			kpts3dTask();
 		}
-		else if (appSetting.kptsMethod == KPTS_METHOD_FPGA_GFTT) {
-			generateKeypoints2(data.imageEigen(), data.maxEigen(), kpts2d);
+		else if (appSetting.lazyFeatures) {
+			// lazy mode, depth is resolved first and the descriptors are
+			// computed only for the keypoints with valid 3D coords
+			kpts3dTask();
+			removeKeypointsWithoutDepth(kpts2d, kpts3d);
+			descTask();
+		}
+		else {
+			threadPool.parallelInvoke({ descTask, kpts3dTask });
 		}
-		perf.stopTime("kpts");
-
-		perf.startTime("desc");
-		computeDescriptor(data.imageLeft(), cv::noArray(), kpts2d, true, desc);
-		perf.stopTime("desc");
-
-		perf.startTime("kpts3d");
-		generateKeypoints3D(data, stereoCameraModel, kpts2d, kpts3d, data.imageDepth(), appSetting.depthMethod);
-		perf.stopTime("kpts3d");
 
 		data.setFeatures(kpts2d, kpts3d, desc, data.imageDepth());
 
+		// descriptors for vocabulary training
+		if (appSetting.saveDescriptor) {
+			data.saveDescriptor();
+		}
+
 		// for debugging
 		if (iteration == 0)
 		{
@@ -288,12 +465,26 @@ int main(int argc, char * argv[])
 		odom.process(data, &odomInfo);
 		perf.stopTime("odom.process");
 
+		// the lost frame is located in the map with its features
+		if (odomInfo.lost && (appSetting.relocTopK > 0)) {
+			perf.startTime("relocalize");
+			Transform pose;
+			cv::Mat covariance;
+			if (mapper.relocalize(data, appSetting.relocTopK, pose, covariance)) {
+				odom.relocalize(data, pose, covariance, &odomInfo);
+			}
+			perf.stopTime("relocalize");
+		}
+
 		//--------------------------------------------------------------
 		// Map Generator
 		//--------------------------------------------------------------
-		perf.startTime("mapper.process");
-		mapper.process(data, odomInfo, appSetting);
-		perf.stopTime("mapper.process");
+		// frames still lost are not mapped
+		if (!odomInfo.lost || (appSetting.relocTopK == 0)) {
+			perf.startTime("mapper.process");
+			mapper.process(data, odomInfo, appSetting);
+			perf.stopTime("mapper.process");
+		}
 
 		//--------------------------------------------------------------
 		// Memory Usage
@@ -301,6 +492,19 @@ int main(int argc, char * argv[])
 		if (appSetting.memory && (iteration % 10) == 9) {
 			odom.getMemoryUsed();
 			mapper.getMemoryUsed();
+			perf.registerMemoryUsed("FramePool", framePool.getSize());
+			if (appSetting.rawInput) {
+				perf.registerMemoryUsed("SoftRect", softRect.getSize());
+			}
+			if (appSetting.depthMethod == DEPTH_METHOD_SOFT_BM) {
+				perf.registerMemoryUsed("SoftBM", softBM.getSize());
+			}
+			if (appSetting.kptsMethod == KPTS_METHOD_SOFT_GFTT) {
+				perf.registerMemoryUsed("SoftGFTT", softGFTT.getSize());
+			}
+			if (appSetting.descMethod != DESC_METHOD_CV_ORB) {
+				perf.registerMemoryUsed("OrbDescriptor", orb.getSize());
+			}
 		}
 
 		LOG_INFO("Iteration %d/%d\n", iteration, totalImages - 1);
@@ -521,35 +725,46 @@ void buildOccupancyGridMap(
 
 			cv::Mat depth = node->sensorData().disparity();
 			int scale = node->sensorData().dispScale();
+			const StereoCameraModel &stereoCameraModel = node->sensorData().stereoCameraModel();
+			const Transform &localTransform = stereoCameraModel.localTransform();
+			const Transform &worldPose = optimized_poses[i];
 
+			// points of a row are moved to the world frame at once
+			std::vector<cv::Point3f> pts3d;
+			pts3d.reserve(depth.cols);
 			for (int row = 0; row < depth.rows; row++)
 			{
+				pts3d.clear();
 				for (int col = 0; col < depth.cols; col++)
 				{
 					float disparity = (float)(depth.at<short>(row, col) / 16.0f);
 					if (disparity > 0)
 					{
-						StereoCameraModel stereoCameraModel = node->sensorData().stereoCameraModel();
 						cv::Point2f pt2d = cv::Point2f((float)(col * scale), (float)(row * scale));
 						cv::Point3f pt3d = projectDisparityTo3D(pt2d, disparity, stereoCameraModel);
 
 						if (isFinite(pt3d))
 						{
-							pt3d = transformPoint(pt3d, stereoCameraModel.localTransform());
-							pt3d = transformPoint(pt3d, optimized_poses[i]);
-
-							octomap::point3d pt = octomap::point3d(pt3d.x, pt3d.y, pt3d.z);
-
-							octomap::point3d v(pt.x() - sensorOrigin.x(), pt.y() - sensorOrigin.y(), pt.z() - sensorOrigin.z());
-							if (v.norm() <= rangeMaxSqrd)
-							{
-								octomap::OcTreeKey key;
-								tree.coordToKeyChecked(pt, key);
-								tree.updateNode(key, true);
-							}
+							pts3d.push_back(pt3d);
 						}
 					}
 				}
+
+				localTransform.transformPoints(pts3d.data(), pts3d.data(), (int)pts3d.size());
+				worldPose.transformPoints(pts3d.data(), pts3d.data(), (int)pts3d.size());
+
+				for (int k = 0; k < (int)pts3d.size(); k++)
+				{
+					octomap::point3d pt = octomap::point3d(pts3d[k].x, pts3d[k].y, pts3d[k].z);
+
+					octomap::point3d v(pt.x() - sensorOrigin.x(), pt.y() - sensorOrigin.y(), pt.z() - sensorOrigin.z());
+					if (v.norm() <= rangeMaxSqrd)
+					{
+						octomap::OcTreeKey key;
+						tree.coordToKeyChecked(pt, key);
+						tree.updateNode(key, true);
+					}
+				}
 			}
 
 		}
@@ -87,3 +87,173 @@ int xThread::lowerProirity(void)
 	return 0;
 #endif
 }
+
+
+//=============================================================================
+// Worker Thread Pool
+//=============================================================================
+xThreadPool::xThreadPool()
+{
+	_stop = false;
+	_jobHead = nullptr;
+	_jobTail = nullptr;
+}
+
+xThreadPool::~xThreadPool()
+{
+	destroy();
+}
+
+int xThreadPool::create(int numThreads)
+{
+	destroy();
+
+	_stop = false;
+	for (int i = 0; i < numThreads; i++) {
+		xThread *th = new xThread();
+		if (th->create(worker, (void*)this) != 0) {
+			delete th;
+			break;
+		}
+		_th.push_back(th);
+	}
+
+	return (int)_th.size();
+}
+
+void xThreadPool::destroy(void)
+{
+	if (_th.empty()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_cvJob.notify_all();
+
+	for (int i = 0; i < (int)_th.size(); i++) {
+		_th[i]->join();
+		delete _th[i];
+	}
+	_th.clear();
+}
+
+void xThreadPool::parallelFor(int n, const std::function<void(int)> &func)
+{
+	if (n <= 0) {
+		return;
+	}
+
+	// no worker, or nothing to share
+	if (_th.empty() || (n == 1)) {
+		for (int i = 0; i < n; i++) {
+			func(i);
+		}
+		return;
+	}
+
+	JOB job;
+	job.func = &func;
+	job.n = n;
+	job.next = 0;
+	job.active = 0;
+	job.queued = false;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		pushJob(&job);
+	}
+	_cvJob.notify_all();
+
+	// the calling thread works as well
+	runJob(&job);
+
+	// wait for the workers still running this job, then withdraw it
+	std::unique_lock<std::mutex> lock(_mutex);
+	_cvDone.wait(lock, [&job] { return job.active == 0; });
+	if (job.queued) {
+		removeJob(&job);
+	}
+}
+
+void xThreadPool::parallelInvoke(const std::vector<std::function<void(void)>> &tasks)
+{
+	parallelFor((int)tasks.size(), [&tasks](int i) { tasks[i](); });
+}
+
+void xThreadPool::runJob(JOB *job)
+{
+	int i;
+	while ((i = job->next++) < job->n) {
+		(*job->func)(i);
+	}
+}
+
+// called with the mutex locked
+void xThreadPool::pushJob(JOB *job)
+{
+	job->prevJob = _jobTail;
+	job->nextJob = nullptr;
+	if (_jobTail) {
+		_jobTail->nextJob = job;
+	}
+	else {
+		_jobHead = job;
+	}
+	_jobTail = job;
+	job->queued = true;
+}
+
+// called with the mutex locked
+void xThreadPool::removeJob(JOB *job)
+{
+	if (job->prevJob) {
+		job->prevJob->nextJob = job->nextJob;
+	}
+	else {
+		_jobHead = job->nextJob;
+	}
+	if (job->nextJob) {
+		job->nextJob->prevJob = job->prevJob;
+	}
+	else {
+		_jobTail = job->prevJob;
+	}
+	job->queued = false;
+}
+
+void* xThreadPool::worker(void *arg)
+{
+	((xThreadPool*)arg)->workerLoop();
+	return 0;
+}
+
+void xThreadPool::workerLoop(void)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (1) {
+		_cvJob.wait(lock, [this] { return _stop || (_jobHead != nullptr); });
+		if (_stop) {
+			break;
+		}
+
+		// retire a job whose indices are all taken
+		JOB *job = _jobHead;
+		if (job->next >= job->n) {
+			removeJob(job);
+			continue;
+		}
+
+		job->active++;
+		lock.unlock();
+		runJob(job);
+		lock.lock();
+		job->active--;
+		if (job->active == 0) {
+			_cvDone.notify_all();
+		}
+	}
+}
+
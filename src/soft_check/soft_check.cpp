@@ -0,0 +1,830 @@
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/SoftBM.h"
+#include "core/SoftGFTT.h"
+#include "core/EpipolarLK.h"
+#include "opencv/CvLKStereo.h"
+#include "core/xThread.h"
+#include "core/FramePool.h"
+
+
+//******************************************************************************
+// CPU engine check against the FPGA cores and the ground truth
+//------------------------------------------------------------------------------
+// Runs the CPU engines on the simulation input images of dvp/sim and
+// compares their output bit by bit with a reference model that follows the
+// dvp/rtl modules one by one, pixel by pixel, without the band split, the
+// incremental window sums and SIMD of the engines.
+//  -bm   : SoftBM on the rectified images of the RTL testbench. The x-Sobel
+//          is compared with the testbench references ref_xsbl_*.dat, the
+//          depth map with a model of bm_calc_*.v, diven.v and bm_obuf2.v.
+//          data/ref_*.zip are extracted into sim_dir/ref as for sim_dvp.v.
+//  -gftt : SoftGFTT against gftt_sbl.v, gftt_eig.v, gftt_box.v and
+//          gftt_obuf.v, on the simulation inputs and on synthetic images
+//          that saturate the products and the box sums
+//  -epi  : EpipolarLK and calcOpticalFlowPyrLKStereo() on a synthetic
+//          rectified pair against the ground truth disparity, with the
+//          parameters of the EPI_LK and the CV_LK depth methods
+// The exit code is 1 if any output differs, the EpipolarLK error exceeds
+// EPI_MAX_MEDIAN_ERROR or EPI_MAX_P90_ERROR, or it is larger than the
+// error of CV_LK.
+// Built with the slam sources of the engines, opencv/CvLKStereo.cpp,
+// core/Logger.cpp, core/xThread.cpp and core/FramePool.cpp.
+//
+// usage: soft_check [-sim sim_dir] [-threads N] [-bm] [-gftt] [-epi]
+//   all checks run when none is selected
+//******************************************************************************
+xThreadPool threadPool;
+FramePool framePool;
+
+#define SIM_WIDTH	640
+#define SIM_HEIGHT	480
+
+#define EPI_NUM_POINTS			1500
+#define EPI_MIN_DISPARITY		2.0f	// synthetic disparity range [pixel]
+#define EPI_MAX_DISPARITY		92.0f
+#define EPI_MAX_MEDIAN_ERROR	0.15f	// pass criteria [pixel]
+#define EPI_MAX_P90_ERROR		0.5f
+#define EPI_TIMING_RUNS			10		// the fastest run is reported
+
+
+//******************************************************************************
+// Function Prototype
+//******************************************************************************
+static int readDat(const char *filename, cv::Mat &img);
+static int divEn(int dividend, int divisor, int dw, int vw, int qw, int msb);
+static void refSobel(const cv::Mat &img, std::vector<int> &sobel);
+static void refBM(const cv::Mat &left, const cv::Mat &right, const SOFT_BM_PARAM &param, cv::Mat &depth);
+static int checkSobel(const cv::Mat &img, const cv::Mat &xsbl, const char *name);
+static int checkBM(const cv::Mat &left, const cv::Mat &right);
+static unsigned int isqrt(unsigned long long n);
+static void refGFTT(const cv::Mat &img, cv::Mat &eig, unsigned short *maxEigen);
+static int checkGFTT(const cv::Mat &img, const char *name);
+static float epiDisparity(float x, int y);
+static int epiErrors(const std::vector<float> &truth, const std::vector<cv::Point2f> &rightCorners,
+	const std::vector<unsigned char> &status, const char *name, float ms, float *median, float *p90);
+static int checkEPI(void);
+
+
+//******************************************************************************
+// Check main function
+//******************************************************************************
+int main(int argc, char** argv)
+{
+	//================================================================
+	// Command Parse
+	//================================================================
+	std::string simDir = "../dvp/sim";
+	int numThreads = 3;
+	bool bm = false;
+	bool gftt = false;
+	bool epi = false;
+
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "-sim") == 0) && (i + 1 < argc)) {
+			simDir = argv[++i];
+		}
+		else if ((strcmp(argv[i], "-threads") == 0) && (i + 1 < argc)) {
+			numThreads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-bm") == 0) {
+			bm = true;
+		}
+		else if (strcmp(argv[i], "-gftt") == 0) {
+			gftt = true;
+		}
+		else if (strcmp(argv[i], "-epi") == 0) {
+			epi = true;
+		}
+		else {
+			printf("usage: soft_check [-sim sim_dir] [-threads N] [-bm] [-gftt] [-epi]\n");
+			return 1;
+		}
+	}
+
+	if (!bm && !gftt && !epi) {
+		bm = true;
+		gftt = true;
+		epi = true;
+	}
+
+	//================================================================
+	// Read the simulation input images
+	//================================================================
+	cv::Mat left, right;
+	std::string pathLeft = simDir + "/img_001_l.dat";
+	std::string pathRight = simDir + "/img_001_r.dat";
+	if (readDat(pathLeft.c_str(), left) < 0) {
+		printf("can not read %s\n", pathLeft.c_str());
+		return 1;
+	}
+	if (readDat(pathRight.c_str(), right) < 0) {
+		printf("can not read %s\n", pathRight.c_str());
+		return 1;
+	}
+
+	threadPool.create(numThreads);
+
+	int numFailed = 0;
+	if (bm) {
+		// inputs and x-Sobel outputs of the BM core in sim_dvp.v
+		const char *names[4] = { "ref_rect_l", "ref_rect_r", "ref_xsbl_l", "ref_xsbl_r" };
+		cv::Mat ref[4];
+		for (int i = 0; i < 4; i++) {
+			std::string path = simDir + "/ref/" + names[i] + ".dat";
+			if (readDat(path.c_str(), ref[i]) < 0) {
+				printf("can not read %s, extract data/%s.zip into %s/ref\n", path.c_str(), names[i], simDir.c_str());
+				threadPool.destroy();
+				return 1;
+			}
+		}
+		numFailed += checkSobel(ref[0], ref[2], "xsbl2 left ");
+		numFailed += checkSobel(ref[1], ref[3], "xsbl2 right");
+		numFailed += checkBM(ref[0], ref[1]);
+	}
+	if (gftt) {
+		numFailed += checkGFTT(left, "GFTT sim left  ");
+		numFailed += checkGFTT(right, "GFTT sim right ");
+
+		// strong edges saturate the products and the box sums
+		cv::RNG rng(1);
+		cv::Mat img(SIM_HEIGHT, SIM_WIDTH, CV_8UC1);
+		for (int i = 0; i < SIM_WIDTH * SIM_HEIGHT; i++) {
+			img.data[i] = (unsigned char)(rng.next() & 0xFF);
+		}
+		numFailed += checkGFTT(img, "GFTT noise     ");
+		for (int i = 0; i < SIM_WIDTH * SIM_HEIGHT; i++) {
+			img.data[i] = ((((i % SIM_WIDTH) + (i / SIM_WIDTH)) % 7) < 3) ? 255 : 0;
+		}
+		numFailed += checkGFTT(img, "GFTT stripes   ");
+		for (int i = 0; i < SIM_WIDTH * SIM_HEIGHT; i++) {
+			img.data[i] = (rng.next() & 1) ? 255 : 0;
+		}
+		numFailed += checkGFTT(img, "GFTT binary    ");
+	}
+	if (epi) {
+		numFailed += checkEPI();
+	}
+
+	threadPool.destroy();
+
+	printf("%s\n", numFailed ? "FAILED" : "PASSED");
+	return numFailed ? 1 : 0;
+}
+
+
+//******************************************************************************
+// Simulation image, pixels in hex, one row per line
+//******************************************************************************
+static int readDat(const char *filename, cv::Mat &img)
+{
+	FILE *fp = fopen(filename, "r");
+	if (fp == NULL) {
+		return -1;
+	}
+
+	img = cv::Mat(SIM_HEIGHT, SIM_WIDTH, CV_8UC1);
+	int num = 0;
+	unsigned int val;
+	while ((num < SIM_WIDTH * SIM_HEIGHT) && (fscanf(fp, "%x", &val) == 1)) {
+		img.data[num++] = (unsigned char)val;
+	}
+	fclose(fp);
+
+	return (num == SIM_WIDTH * SIM_HEIGHT) ? num : -1;
+}
+
+
+//******************************************************************************
+// diven.v, non-restoring divider
+//------------------------------------------------------------------------------
+// "dividend" is "dw" bits signed, "divisor" "vw" bits unsigned, the quotient
+// "qw" bits. The partial remainder is dw + vw - msb bits.
+//******************************************************************************
+static int divEn(int dividend, int divisor, int dw, int vw, int qw, int msb)
+{
+	int rw = dw + vw - msb;
+	long long maskD = (1LL << dw) - 1;
+	long long maskR = (1LL << rw) - 1;
+	long long maskV1 = (1LL << (vw + 1)) - 1;
+	long long maskQ = (1LL << qw) - 1;
+
+	// sign extension of the dividend
+	long long a = dividend & maskD;
+	if ((a >> (dw - 1)) & 1) {
+		a |= maskR ^ maskD;
+	}
+	long long b = divisor & ((1LL << vw) - 1);
+	int signB = (int)((b >> (vw - 1)) & 1);
+
+	// add or subtract the divisor, "op" 0 subtracts
+	auto update = [&](long long rem, int op) {
+		long long shifted = ((rem << 1) | (1 - op)) & maskR;
+		long long operand = (op ? 0 : maskV1) ^ (b << 1);
+		return (shifted + operand) & maskR;
+	};
+
+	int op = signB ^ (int)((a >> (rw - 1)) & 1);
+	long long rem = update(a, op);
+	long long q = 0;
+	for (int i = 0; i < qw; i++) {
+		op = signB ^ (int)((rem >> (rw - 1)) & 1);
+		rem = update(rem, op);
+		q = ((q << 1) | (1 - op)) & maskQ;
+	}
+
+	return (int)((q + signB) & maskQ);
+}
+
+
+//******************************************************************************
+// xsbl2.v, x-Sobel prefilter, 6 bits offset binary
+//------------------------------------------------------------------------------
+// The first and the last rows and columns are 32 (zero gradient).
+//******************************************************************************
+static void refSobel(const cv::Mat &img, std::vector<int> &sobel)
+{
+	int width = img.cols;
+	int height = img.rows;
+	sobel.assign(width * height, 0);
+	for (int y = 1; y < height - 1; y++) {
+		for (int x = 0; x < width; x++) {
+			int val = 32;
+			if ((x != 0) && (x != width - 1)) {
+				int sum = 0;
+				for (int k = -1; k <= 1; k++) {
+					const unsigned char *row = img.ptr<unsigned char>(y + k);
+					sum += ((k == 0) ? 2 : 1) * (row[x + 1] - row[x - 1]);
+				}
+				val = std::min(std::max(sum, -32), 31) + 32;
+			}
+			sobel[y * width + x] = val;
+		}
+	}
+}
+
+
+//******************************************************************************
+// FPGA BM core
+//------------------------------------------------------------------------------
+// SAD of lane j is disparity j - 1, the 32 lanes of a phase cover disparities
+// 32p - 1 to 32p + 32. Each phase decides its 1st/2nd minimum by the
+// bm_calc_det.v tournament, and bm_calc_upd.v merges the phases.
+//******************************************************************************
+struct BM_CANDIDATE {
+	int left;	// SAD of the lower neighbor
+	int center;	// SAD
+	int right;	// SAD of the upper neighbor
+	int index;	// disparity in the phase
+};
+
+static void refBM(const cv::Mat &left, const cv::Mat &right, const SOFT_BM_PARAM &param, cv::Mat &depth)
+{
+	int width = left.cols;
+	int height = left.rows;
+	int wsz = param.blockSize;
+	int ndisp = param.numDisparities;
+	int hw = wsz / 2;
+
+	std::vector<int> sobelL, sobelR;
+	refSobel(left, sobelL);
+	refSobel(right, sobelR);
+
+	// column sums of the SAD window (HSAD), 10 bits saturating
+	int hsadWidth = width - ndisp - 1;
+	int sadWidth = hsadWidth - 2 * hw;
+	int lanes = ndisp + 2; // disparity -1 to ndisp
+	std::vector<int> colSum(hsadWidth * lanes, 0);
+	std::vector<int> sad(lanes);
+
+	depth = cv::Mat(height, width, CV_16SC1, cv::Scalar(-1));
+	for (int r = 0; r < height; r++)
+	{
+		for (int k = 0; k < hsadWidth; k++) {
+			int x = ndisp + k;
+			for (int d = -1; d <= ndisp; d++) {
+				int &c = colSum[k * lanes + d + 1];
+				int add = abs(sobelL[r * width + x] - sobelR[r * width + x - d]);
+				if (r == 0) {
+					c = add;
+					continue;
+				}
+				if (r >= wsz) {
+					int sub = abs(sobelL[(r - wsz) * width + x] - sobelR[(r - wsz) * width + x - d]);
+					c = std::max(c - sub, 0);
+				}
+				c = std::min(c + add, 1023);
+			}
+		}
+		if (r < wsz - 1) {
+			continue;
+		}
+
+		int y = r - hw;
+		for (int i = 0; i < sadWidth; i++)
+		{
+			std::fill(sad.begin(), sad.end(), 0);
+			for (int k = i; k < i + wsz; k++) {
+				for (int j = 0; j < lanes; j++) {
+					sad[j] += colSum[k * lanes + j];
+				}
+			}
+
+			int min1 = 0, min2 = 0, disp1 = 0, disp2 = 0, frac = 0;
+			for (int p = 0; p < ndisp / 32; p++)
+			{
+				const int *s = &sad[32 * p];
+
+				// stage 1, pairs of lanes with their neighbors
+				std::vector<BM_CANDIDATE> cand;
+				for (int j = 0; j < 16; j++) {
+					int cmp = (s[2 * j + 2] < s[2 * j + 1]);
+					int b = 2 * j + 1 + cmp;
+					BM_CANDIDATE c = { s[b - 1], s[b], s[b + 1], 2 * j + cmp };
+					cand.push_back(c);
+				}
+
+				// stages 2 and 3
+				while (cand.size() > 4) {
+					std::vector<BM_CANDIDATE> next;
+					for (size_t j = 0; j < cand.size(); j += 2) {
+						next.push_back((cand[j + 1].center < cand[j].center) ? cand[j + 1] : cand[j]);
+					}
+					cand.swap(next);
+				}
+
+				// 1st and 2nd minimum of the last 4, the 2nd is not
+				// adjacent to the 1st
+				BM_CANDIDATE w0, l0, w1, l1;
+				if (cand[1].center < cand[0].center) { w0 = cand[1]; l0 = cand[0]; }
+				else { w0 = cand[0]; l0 = cand[1]; }
+				if (cand[3].center < cand[2].center) { w1 = cand[3]; l1 = cand[2]; }
+				else { w1 = cand[2]; l1 = cand[3]; }
+
+				BM_CANDIDATE m1, m2a;
+				if (w1.center < w0.center) { m1 = w1; m2a = w0; }
+				else { m1 = w0; m2a = w1; }
+				BM_CANDIDATE m2b = (l1.center < l0.center) ? l1 : l0;
+
+				auto adjacent = [&m1](const BM_CANDIDATE &c) {
+					return (c.index == m1.index + 1) || (m1.index == c.index + 1);
+				};
+				BM_CANDIDATE m2 = (((m2b.center < m2a.center) && !adjacent(m2b)) || adjacent(m2a)) ? m2b : m2a;
+
+				// bm_calc_frac.v, sub-pixel fraction of the 1st minimum
+				int dlr = m1.left - m1.right;
+				int dlc = m1.left - m1.center;
+				int drc = m1.right - m1.center;
+				int cmp = (m1.left < m1.right);
+				int negative = (dlc < 0) || (drc < 0);
+				int dividend = negative ? 0 : dlr;
+				int divisor = 2 * (cmp ? drc : dlc);
+				int f = (divisor == 0) ? (cmp ? 0x40 : 0xC0) : divEn(dividend, divisor, 18, 18, 8, 17);
+
+				// bm_calc_upd.v, merge with the previous phases
+				int d1 = (p << 5) | m1.index;
+				int d2 = (p << 5) | m2.index;
+				int s1 = m1.center;
+				int s2 = m2.center;
+				int updateFrac;
+				if (p == 0) {
+					min1 = s1; disp1 = d1;
+					min2 = s2; disp2 = d2;
+					updateFrac = 1;
+				}
+				else {
+					int a = (s1 < min1), b = (s2 < min1), c = (s1 < min2), e = (s2 < min2);
+					int adj = (d1 == ((disp1 + 1) & 255));
+					int n1, n2, nd1, nd2;
+					if (a && b) {
+						n1 = s1; nd1 = d1; n2 = s2; nd2 = d2; updateFrac = 1;
+					}
+					else if (a && !b && e) {
+						n1 = s1; nd1 = d1;
+						n2 = !adj ? min1 : s2; nd2 = !adj ? disp1 : d2; updateFrac = 1;
+					}
+					else if (a && !b && !e) {
+						n1 = s1; nd1 = d1;
+						n2 = !adj ? min1 : min2; nd2 = !adj ? disp1 : disp2; updateFrac = 1;
+					}
+					else if (!a && c && e) {
+						n1 = min1; nd1 = disp1;
+						n2 = !adj ? s1 : s2; nd2 = !adj ? d1 : d2; updateFrac = 0;
+					}
+					else if (!a && c && !e) {
+						n1 = min1; nd1 = disp1;
+						n2 = !adj ? s1 : min2; nd2 = !adj ? d1 : disp2; updateFrac = 0;
+					}
+					else {
+						n1 = min1; nd1 = disp1; n2 = min2; nd2 = disp2; updateFrac = 0;
+					}
+					min1 = n1; disp1 = nd1;
+					min2 = n2; disp2 = nd2;
+				}
+				if (updateFrac) {
+					frac = f;
+				}
+			}
+
+			// bm_calc_uni.v, uniqueness filter
+			int ratio = divEn(min1, min2, 17, 17, 11, 16) & 0x3FF;
+			int d = disp1;
+			int f = frac;
+			if (param.uniEnable && (ratio > param.uniThreshold)) {
+				d = param.uniMode ? 0xFF : 0;
+				f = param.uniMode ? 0xFF : 0;
+			}
+
+			// bm_obuf2.v, s11.4
+			int val = d * 256 + (signed char)f;
+			short out = (val <= 0) ? -1 : (short)((unsigned short)val) >> 4;
+			depth.ptr<short>(y)[ndisp + hw + 1 + i] = out;
+		}
+	}
+}
+
+static int checkSobel(const cv::Mat &img, const cv::Mat &xsbl, const char *name)
+{
+	SoftBM softBM({ 21, 64, 0, 0, 0 });
+	cv::Mat sobel;
+	std::vector<int> ref;
+	softBM.prefilter(img, sobel);
+	refSobel(img, ref);
+
+	int numDiff = 0;
+	int numDiffRef = 0;
+	for (int y = 0; y < xsbl.rows; y++) {
+		for (int x = 0; x < xsbl.cols; x++) {
+			int val = xsbl.ptr<unsigned char>(y)[x];
+			if (sobel.ptr<unsigned char>(y)[x] != val) {
+				numDiff++;
+			}
+			if (ref[y * xsbl.cols + x] != val) {
+				numDiffRef++;
+			}
+		}
+	}
+
+	printf("BM %s: %d pixels differ from the testbench, %d in the model\n", name, numDiff, numDiffRef);
+
+	return (numDiff || numDiffRef) ? 1 : 0;
+}
+
+static int checkBM(const cv::Mat &left, const cv::Mat &right)
+{
+	// the FPGA setting first, then window, range and uniqueness variations
+	SOFT_BM_PARAM params[] = {
+		{ 21,  64, 0, 0,    0 },
+		{ 21, 128, 1, 0,  900 },
+		{ 15,  32, 1, 1,  700 },
+		{ 21,  64, 1, 0, 1000 },
+		{ 31,  96, 0, 0,    0 },
+	};
+
+	int numFailed = 0;
+	for (const SOFT_BM_PARAM &param : params)
+	{
+		SoftBM softBM(param);
+		cv::Mat depth, ref;
+		softBM.compute(left, right, depth);
+		refBM(left, right, param, ref);
+
+		int numDiff = 0;
+		int numValid = 0;
+		for (int y = 0; y < ref.rows; y++) {
+			for (int x = 0; x < ref.cols; x++) {
+				short a = depth.ptr<short>(y)[x];
+				if (a != ref.ptr<short>(y)[x]) {
+					numDiff++;
+				}
+				if (a > 0) {
+					numValid++;
+				}
+			}
+		}
+
+		printf("BM wsz %d ndisp %d uni %d/%d/%d: %d pixels differ, %d valid\n",
+			param.blockSize, param.numDisparities, param.uniEnable, param.uniMode, param.uniThreshold,
+			numDiff, numValid);
+		if (numDiff) {
+			numFailed++;
+		}
+	}
+
+	return numFailed;
+}
+
+
+//******************************************************************************
+// Bit by bit integer square root, the truncating root of the CORDIC core
+//******************************************************************************
+static unsigned int isqrt(unsigned long long n)
+{
+	unsigned long long root = 0;
+	unsigned long long bit = 1ULL << 32;
+	while (bit > n) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (n >= root + bit) {
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (unsigned int)root;
+}
+
+
+//******************************************************************************
+// FPGA GFTT core
+//------------------------------------------------------------------------------
+// gftt_sbl.v   : 3x3 Sobel of rows k to k + 2, zero at the first and the last
+//                columns
+// gftt_eig.v   : |dx|^2, |dx||dy| and |dy|^2, 22 bits, the lower 6 bits
+//                dropped
+// gftt_box.v   : 3x3 box sums, saturating at 16 bits
+// eigenvalue   : (a + c) - sqrt((a - c)^2 + 4b^2) with the 22 bits
+//                saturation of the root input
+// gftt_obuf.v  : two lines at the top and the bottom stay 0
+//******************************************************************************
+static void refGFTT(const cv::Mat &img, cv::Mat &eig, unsigned short *maxEigen)
+{
+	int width = img.cols;
+	int height = img.rows;
+	eig = cv::Mat(height, width, CV_16UC1, cv::Scalar(0));
+	*maxEigen = 0;
+	if (height < 5) {
+		return;
+	}
+
+	// Sobel and products
+	int sobelRows = height - 2;
+	std::vector<unsigned int> prod[3];
+	for (int ch = 0; ch < 3; ch++) {
+		prod[ch].assign(sobelRows * width, 0);
+	}
+	for (int k = 0; k < sobelRows; k++) {
+		const unsigned char *row0 = img.ptr<unsigned char>(k);
+		const unsigned char *row1 = img.ptr<unsigned char>(k + 1);
+		const unsigned char *row2 = img.ptr<unsigned char>(k + 2);
+		for (int c = 1; c < width - 1; c++) {
+			int dx = (row0[c + 1] - row0[c - 1]) + 2 * (row1[c + 1] - row1[c - 1]) + (row2[c + 1] - row2[c - 1]);
+			int dy = (row2[c - 1] - row0[c - 1]) + 2 * (row2[c] - row0[c]) + (row2[c + 1] - row0[c + 1]);
+			unsigned int ax = (unsigned int)abs(dx);
+			unsigned int ay = (unsigned int)abs(dy);
+			prod[0][k * width + c] = ((ax * ax) & 0x3FFFFF) >> 6;
+			prod[1][k * width + c] = ((ax * ay) & 0x3FFFFF) >> 6;
+			prod[2][k * width + c] = ((ay * ay) & 0x3FFFFF) >> 6;
+		}
+	}
+
+	// box sums of rows k - 2 to k
+	int boxRows = height - 4;
+	std::vector<unsigned int> box[3];
+	std::vector<unsigned int> hsum(sobelRows * width);
+	for (int ch = 0; ch < 3; ch++) {
+		std::fill(hsum.begin(), hsum.end(), 0);
+		for (int k = 0; k < sobelRows; k++) {
+			for (int c = 1; c < width - 1; c++) {
+				const unsigned int *p = &prod[ch][k * width + c];
+				hsum[k * width + c] = p[-1] + p[0] + p[1];
+			}
+		}
+		box[ch].assign(boxRows * width, 0);
+		for (int k = 2; k < sobelRows; k++) {
+			for (int c = 0; c < width; c++) {
+				unsigned int s = hsum[k * width + c] + hsum[(k - 1) * width + c] + hsum[(k - 2) * width + c];
+				box[ch][(k - 2) * width + c] = (s >> 16) ? 0xFFFF : s;
+			}
+		}
+	}
+
+	// 2x min eigenvalue
+	for (int k = 0; k < boxRows; k++) {
+		unsigned short *out = eig.ptr<unsigned short>(k + 2);
+		for (int c = 0; c < width; c++) {
+			unsigned int a = box[0][k * width + c];
+			unsigned int b = box[1][k * width + c];
+			unsigned int cc = box[2][k * width + c];
+			unsigned int amc = (unsigned int)abs((int)a - (int)cc) & 0xFFFF;
+			unsigned int s = ((amc * amc) >> 10) + ((b * b) >> 8);
+			if (s >> 22) {
+				s = 0x3FFFFF;
+			}
+			// root of s / 2^22 in 16 bits fraction
+			unsigned int root = isqrt((unsigned long long)(s << 9) * 2) & 0xFFFF;
+			int e = (int)(a + cc) - (int)root;
+			unsigned short val = (unsigned short)std::min(std::max(e, 0), 0xFFFF);
+			out[c] = val;
+			*maxEigen = std::max(*maxEigen, val);
+		}
+	}
+}
+
+static int checkGFTT(const cv::Mat &img, const char *name)
+{
+	SoftGFTT softGFTT;
+	cv::Mat eig, ref;
+	unsigned short maxEigen, maxRef;
+	softGFTT.compute(img, eig, &maxEigen);
+	refGFTT(img, ref, &maxRef);
+
+	int numDiff = 0;
+	int numNonZero = 0;
+	for (int y = 0; y < ref.rows; y++) {
+		for (int x = 0; x < ref.cols; x++) {
+			unsigned short a = eig.ptr<unsigned short>(y)[x];
+			if (a != ref.ptr<unsigned short>(y)[x]) {
+				numDiff++;
+			}
+			if (a) {
+				numNonZero++;
+			}
+		}
+	}
+
+	printf("%s: %d pixels differ, %d non-zero, max %d (reference %d)\n",
+		name, numDiff, numNonZero, maxEigen, maxRef);
+
+	return (numDiff || (maxEigen != maxRef)) ? 1 : 0;
+}
+
+
+//******************************************************************************
+// Synthetic rectified pair
+//------------------------------------------------------------------------------
+// A smooth random texture seen by both cameras, right(x) = left(x + d) with
+// the disparity d varying smoothly from EPI_MIN_DISPARITY to
+// EPI_MAX_DISPARITY over the image.
+//******************************************************************************
+static float epiDisparity(float x, int y)
+{
+	float range = EPI_MAX_DISPARITY - EPI_MIN_DISPARITY;
+	return EPI_MIN_DISPARITY + range * (0.5f + 0.5f * sinf(x * 0.004f + y * 0.006f));
+}
+
+static int checkEPI(void)
+{
+	const int width = SIM_WIDTH;
+	const int height = SIM_HEIGHT;
+
+	// texture twice as wide as the image, smoothed along the rows
+	int texWidth = width * 2;
+	int texOffset = width / 2;
+	cv::RNG rng(2);
+	std::vector<float> texture(texWidth * height);
+	for (int i = 0; i < texWidth * height; i++) {
+		texture[i] = (float)(rng.next() % 256);
+	}
+	for (int pass = 0; pass < 2; pass++) {
+		for (int y = 0; y < height; y++) {
+			float *row = &texture[y * texWidth];
+			for (int x = 1; x < texWidth - 1; x++) {
+				row[x] = (row[x - 1] + 2 * row[x] + row[x + 1]) / 4;
+			}
+		}
+	}
+
+	cv::Mat left(height, width, CV_8UC1);
+	cv::Mat right(height, width, CV_8UC1);
+	for (int y = 0; y < height; y++) {
+		const float *row = &texture[y * texWidth];
+		for (int x = 0; x < width; x++) {
+			float tx[2] = { (float)(x + texOffset), x + epiDisparity((float)x, y) + texOffset };
+			unsigned char *dst[2] = { left.ptr<unsigned char>(y), right.ptr<unsigned char>(y) };
+			for (int k = 0; k < 2; k++) {
+				int ix = std::max(0, std::min(texWidth - 2, (int)floorf(tx[k])));
+				float a = tx[k] - ix;
+				dst[k][x] = (unsigned char)lrintf(row[ix] * (1 - a) + row[ix + 1] * a);
+			}
+		}
+	}
+
+	std::vector<cv::Point2f> leftCorners;
+	for (int i = 0; i < EPI_NUM_POINTS; i++) {
+		float x = (float)(20 + rng.next() % (width - 40));
+		float y = (float)(5 + rng.next() % (height - 10));
+		leftCorners.push_back(cv::Point2f(x, y));
+	}
+
+	// ground truth, solve x + d(x) = xl by bisection, x + d(x) is increasing
+	std::vector<float> truth;
+	for (int i = 0; i < (int)leftCorners.size(); i++) {
+		float xl = leftCorners[i].x;
+		int y = (int)leftCorners[i].y;
+		float lo = xl - EPI_MAX_DISPARITY;
+		float hi = xl - EPI_MIN_DISPARITY;
+		for (int k = 0; k < 40; k++) {
+			float mid = (lo + hi) / 2;
+			if (mid + epiDisparity(mid, y) < xl) {
+				lo = mid;
+			}
+			else {
+				hi = mid;
+			}
+		}
+		truth.push_back((lo + hi) / 2);
+	}
+
+	// parameters of computeCorrespondencesEpipolar()
+	EPIPOLAR_LK_PARAM param;
+	param.winWidth = 15;
+	param.winHeight = 3;
+	param.maxLevel = 5;
+	param.iterations = 30;
+	param.epsilon = 0.01f;
+	param.minDisparity = 0.5f;
+	param.maxDisparity = 128.0f;
+	param.minEigThreshold = 1e-4f;
+	param.maxError = 32.0f;
+
+	std::vector<cv::Point2f> epiCorners;
+	std::vector<unsigned char> epiStatus;
+	float epiMs = FLT_MAX;
+	for (int k = 0; k < EPI_TIMING_RUNS; k++) {
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		calcEpipolarLK(left, right, leftCorners, epiCorners, epiStatus, param);
+		std::chrono::duration<float, std::milli> t = std::chrono::steady_clock::now() - t0;
+		epiMs = std::min(epiMs, t.count());
+	}
+
+	// computeCorrespondences() with its parameters and disparity check
+	std::vector<cv::Point2f> lkCorners;
+	std::vector<unsigned char> lkStatus;
+	std::vector<float> lkErr;
+	float lkMs = FLT_MAX;
+	for (int k = 0; k < EPI_TIMING_RUNS; k++) {
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		calcOpticalFlowPyrLKStereo(left, right, leftCorners, lkCorners, lkStatus, lkErr,
+			cv::Size(15, 3), 5,
+			cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01f),
+			cv::OPTFLOW_LK_GET_MIN_EIGENVALS, 1e-4);
+		for (int i = 0; i < (int)lkStatus.size(); i++) {
+			float disparity = leftCorners[i].x - lkCorners[i].x;
+			if (lkStatus[i] && ((disparity <= 0.5f) || (disparity > 128.0f))) {
+				lkStatus[i] = 0;
+			}
+		}
+		std::chrono::duration<float, std::milli> t = std::chrono::steady_clock::now() - t0;
+		lkMs = std::min(lkMs, t.count());
+	}
+
+	float epiMedian, epiP90, lkMedian, lkP90;
+	if (epiErrors(truth, epiCorners, epiStatus, "EPI_LK", epiMs, &epiMedian, &epiP90) < 0 ||
+		epiErrors(truth, lkCorners, lkStatus, "CV_LK ", lkMs, &lkMedian, &lkP90) < 0) {
+		return 1;
+	}
+
+	return ((epiMedian > EPI_MAX_MEDIAN_ERROR) || (epiP90 > EPI_MAX_P90_ERROR) ||
+		(epiMedian > lkMedian) || (epiP90 > lkP90)) ? 1 : 0;
+}
+
+// truth[i] < 0 when the point is outside the right image
+static int epiErrors(const std::vector<float> &truth, const std::vector<cv::Point2f> &rightCorners,
+	const std::vector<unsigned char> &status, const char *name, float ms, float *median, float *p90)
+{
+	int numVisible = 0;
+	int numValid = 0;
+	int numFalse = 0;
+	std::vector<float> errors;
+	for (int i = 0; i < (int)truth.size(); i++) {
+		if (truth[i] < 0) {
+			if (status[i]) {
+				numFalse++;
+			}
+			continue;
+		}
+		numVisible++;
+		if (status[i]) {
+			numValid++;
+			errors.push_back(fabsf(rightCorners[i].x - truth[i]));
+		}
+	}
+
+	if (errors.empty()) {
+		printf("%s : no valid points\n", name);
+		return -1;
+	}
+	std::sort(errors.begin(), errors.end());
+	*median = errors[errors.size() / 2];
+	*p90 = errors[errors.size() * 9 / 10];
+	int numGood = (int)(std::lower_bound(errors.begin(), errors.end(), 0.5f) - errors.begin());
+
+	printf("%s disparity %.0f-%.0f : %d visible, %d valid, %d within 0.5 px, %d valid outside the right image, median %.3f px, p90 %.3f px, %.2f ms\n",
+		name, EPI_MIN_DISPARITY, EPI_MAX_DISPARITY, numVisible, numValid, numGood, numFalse, *median, *p90, ms);
+
+	return 0;
+}
@@ -0,0 +1,418 @@
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/hal/hal.hpp>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "../slam/include/core/Vocabulary.h"
+
+
+//******************************************************************************
+// Vocabulary training tool
+//------------------------------------------------------------------------------
+// Builds a hierarchical binary vocabulary (k-majority tree) from ORB
+// descriptors dumped by the slam application with "-savedesc" option.
+//
+// usage: vocab_train [-k branching] [-l depth] [-n maxDescriptors]
+//                    [-i iterations] [-o output] desc_0000.txt desc_0001.txt ...
+//******************************************************************************
+struct TRAIN_ITEM {
+	int node;
+	int level;
+	std::vector<int> indices;
+};
+
+
+//******************************************************************************
+// Function Prototype
+//******************************************************************************
+static int readDescriptors(const char *filename, std::vector<unsigned char> &data);
+static void subsample(std::vector<int> &indices, int maxNum, cv::RNG &rng);
+static int cluster(
+	const std::vector<unsigned char> &data,
+	const std::vector<int> &indices,
+	int k,
+	int iterations,
+	cv::RNG &rng,
+	std::vector<unsigned char> &centers,
+	std::vector<int> &assign);
+static int writeVocabulary(
+	const char *filename,
+	const std::vector<VOCAB_NODE> &nodes,
+	int branching,
+	int depth,
+	int numWords);
+
+
+//******************************************************************************
+// Vocabulary training main function
+//******************************************************************************
+int main(int argc, char** argv)
+{
+	//================================================================
+	// Command Parse
+	//================================================================
+	int branching = 10;
+	int depth = 5;
+	int maxDescriptors = 1000000;
+	int iterations = 10;
+	std::string output = "vocabulary.bin";
+	std::vector<std::string> inputs;
+
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "-k") == 0) && (i + 1 < argc)) {
+			branching = atoi(argv[++i]);
+		}
+		else if ((strcmp(argv[i], "-l") == 0) && (i + 1 < argc)) {
+			depth = atoi(argv[++i]);
+		}
+		else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+			maxDescriptors = atoi(argv[++i]);
+		}
+		else if ((strcmp(argv[i], "-i") == 0) && (i + 1 < argc)) {
+			iterations = atoi(argv[++i]);
+		}
+		else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+			output = argv[++i];
+		}
+		else {
+			inputs.push_back(argv[i]);
+		}
+	}
+
+	if (inputs.empty() || (branching < 2) || (depth < 1) || (iterations < 1)) {
+		printf("usage: vocab_train [-k branching] [-l depth] [-n maxDescriptors] [-i iterations] [-o output] desc_files...\n");
+		return 1;
+	}
+
+	//================================================================
+	// Read descriptors
+	//================================================================
+	std::vector<unsigned char> data;
+	for (int i = 0; i < (int)inputs.size(); i++) {
+		if (readDescriptors(inputs[i].c_str(), data) < 0) {
+			printf("can not open %s\n", inputs[i].c_str());
+		}
+	}
+
+	int numDescriptors = (int)(data.size() / VOCAB_DESC_BYTES);
+	printf("%d descriptors from %d files\n", numDescriptors, (int)inputs.size());
+	if (numDescriptors == 0) {
+		return 1;
+	}
+
+	cv::RNG rng(0); // fixed seed, reproducible
+	std::vector<int> all(numDescriptors);
+	for (int i = 0; i < numDescriptors; i++) {
+		all[i] = i;
+	}
+	subsample(all, maxDescriptors, rng);
+
+	//================================================================
+	// Build the tree in breadth-first order
+	//================================================================
+	std::vector<VOCAB_NODE> nodes(1);
+	memset(&nodes[0], 0, sizeof(VOCAB_NODE));
+
+	std::deque<TRAIN_ITEM> queue(1);
+	queue.front().node = 0;
+	queue.front().level = 0;
+	queue.front().indices.swap(all);
+
+	int numWords = 0;
+	while (!queue.empty())
+	{
+		TRAIN_ITEM item;
+		item.node = queue.front().node;
+		item.level = queue.front().level;
+		item.indices.swap(queue.front().indices);
+		queue.pop_front();
+
+		// split the node into k clusters
+		std::vector<unsigned char> centers;
+		std::vector<int> assign;
+		int numClusters = 0;
+		if ((item.level < depth) && ((int)item.indices.size() > branching)) {
+			numClusters = cluster(data, item.indices, branching, iterations, rng, centers, assign);
+		}
+
+		if (numClusters < 2) {
+			// leaf, a visual word
+			nodes[item.node].wordId = ++numWords;
+			continue;
+		}
+
+		// children are appended contiguously
+		nodes[item.node].firstChild = (int)nodes.size();
+		nodes[item.node].numChildren = numClusters;
+		for (int c = 0; c < numClusters; c++)
+		{
+			VOCAB_NODE child;
+			memset(&child, 0, sizeof(VOCAB_NODE));
+			memcpy(child.desc, &centers[c * VOCAB_DESC_BYTES], VOCAB_DESC_BYTES);
+
+			queue.push_back(TRAIN_ITEM());
+			TRAIN_ITEM &next = queue.back();
+			next.node = (int)nodes.size();
+			next.level = item.level + 1;
+			for (int i = 0; i < (int)item.indices.size(); i++) {
+				if (assign[i] == c) {
+					next.indices.push_back(item.indices[i]);
+				}
+			}
+
+			nodes.push_back(child);
+		}
+	}
+
+	printf("%d nodes, %d words\n", (int)nodes.size(), numWords);
+
+	//================================================================
+	// Write the vocabulary
+	//================================================================
+	if (writeVocabulary(output.c_str(), nodes, branching, depth, numWords) != 0) {
+		printf("can not write %s\n", output.c_str());
+		return 1;
+	}
+	printf("saved to %s\n", output.c_str());
+
+	return 0;
+}
+
+
+//******************************************************************************
+// readDescriptors
+//------------------------------------------------------------------------------
+// one descriptor per line in hexadecimal (SensorData::saveDescriptor format).
+//******************************************************************************
+static int readDescriptors(const char *filename, std::vector<unsigned char> &data)
+{
+	FILE *fp = fopen(filename, "r");
+	if (fp == 0) {
+		return -1;
+	}
+
+	char line[256];
+	int num = 0;
+	while (fgets(line, sizeof(line), fp) != 0)
+	{
+		if ((int)strlen(line) < VOCAB_DESC_BYTES * 2) {
+			continue;
+		}
+
+		unsigned char desc[VOCAB_DESC_BYTES];
+		bool valid = true;
+		for (int i = 0; i < VOCAB_DESC_BYTES; i++) {
+			unsigned int val;
+			if (sscanf(&line[i * 2], "%2x", &val) != 1) {
+				valid = false;
+				break;
+			}
+			desc[i] = (unsigned char)val;
+		}
+
+		if (valid) {
+			data.insert(data.end(), desc, desc + VOCAB_DESC_BYTES);
+			num++;
+		}
+	}
+	fclose(fp);
+
+	return num;
+}
+
+
+//******************************************************************************
+// subsample
+//------------------------------------------------------------------------------
+// keep randomly selected "maxNum" indices.
+//******************************************************************************
+static void subsample(std::vector<int> &indices, int maxNum, cv::RNG &rng)
+{
+	int num = (int)indices.size();
+	if ((maxNum <= 0) || (num <= maxNum)) {
+		return;
+	}
+
+	// partial Fisher-Yates shuffle
+	for (int i = 0; i < maxNum; i++) {
+		int j = i + (int)rng.uniform(0, num - i);
+		std::swap(indices[i], indices[j]);
+	}
+	indices.resize(maxNum);
+}
+
+
+//******************************************************************************
+// cluster
+//------------------------------------------------------------------------------
+// k-majority clustering in Hamming space, seeded by k-means++.
+// returns the number of non-empty clusters. empty clusters are removed from
+// "centers" and "assign" is renumbered accordingly.
+//******************************************************************************
+static int cluster(
+	const std::vector<unsigned char> &data,
+	const std::vector<int> &indices,
+	int k,
+	int iterations,
+	cv::RNG &rng,
+	std::vector<unsigned char> &centers,
+	std::vector<int> &assign)
+{
+	int num = (int)indices.size();
+	const int bytes = VOCAB_DESC_BYTES;
+	const int bits = VOCAB_DESC_BYTES * 8;
+
+	//================================================================
+	// k-means++ seeding
+	//================================================================
+	centers.assign(k * bytes, 0);
+	std::vector<double> minDist(num, (double)INT_MAX);
+
+	int first = (int)rng.uniform(0, num);
+	memcpy(&centers[0], &data[indices[first] * bytes], bytes);
+	for (int c = 1; c < k; c++)
+	{
+		double sum = 0.0;
+		for (int i = 0; i < num; i++) {
+			double d = cv::hal::normHamming(&data[indices[i] * bytes], &centers[(c - 1) * bytes], bytes);
+			if (d * d < minDist[i]) {
+				minDist[i] = d * d;
+			}
+			sum += minDist[i];
+		}
+
+		int selected = (int)rng.uniform(0, num);
+		if (sum > 0.0) {
+			double r = rng.uniform(0.0, sum);
+			for (int i = 0; i < num; i++) {
+				r -= minDist[i];
+				if (r <= 0.0) {
+					selected = i;
+					break;
+				}
+			}
+		}
+		memcpy(&centers[c * bytes], &data[indices[selected] * bytes], bytes);
+	}
+
+	//================================================================
+	// k-majority iteration
+	//================================================================
+	assign.assign(num, -1);
+	std::vector<int> counts(k * bits);
+	std::vector<int> sizes(k);
+	for (int iter = 0; iter < iterations; iter++)
+	{
+		// assign to the nearest center
+		bool changed = false;
+		for (int i = 0; i < num; i++) {
+			const unsigned char *desc = &data[indices[i] * bytes];
+			int best = 0;
+			int bestDist = INT_MAX;
+			for (int c = 0; c < k; c++) {
+				int d = cv::hal::normHamming(desc, &centers[c * bytes], bytes);
+				if (d < bestDist) {
+					bestDist = d;
+					best = c;
+				}
+			}
+			if (assign[i] != best) {
+				assign[i] = best;
+				changed = true;
+			}
+		}
+
+		if (!changed) {
+			break;
+		}
+
+		// update the centers by bitwise majority
+		std::fill(counts.begin(), counts.end(), 0);
+		std::fill(sizes.begin(), sizes.end(), 0);
+		for (int i = 0; i < num; i++) {
+			const unsigned char *desc = &data[indices[i] * bytes];
+			int *count = &counts[assign[i] * bits];
+			for (int b = 0; b < bits; b++) {
+				count[b] += (desc[b >> 3] >> (7 - (b & 7))) & 1;
+			}
+			sizes[assign[i]]++;
+		}
+
+		for (int c = 0; c < k; c++) {
+			if (sizes[c] == 0) {
+				// keep the previous center
+				continue;
+			}
+			unsigned char *center = &centers[c * bytes];
+			memset(center, 0, bytes);
+			for (int b = 0; b < bits; b++) {
+				if (counts[c * bits + b] * 2 > sizes[c]) {
+					center[b >> 3] |= (unsigned char)(1 << (7 - (b & 7)));
+				}
+			}
+		}
+	}
+
+	//================================================================
+	// remove empty clusters
+	//================================================================
+	std::vector<int> remap(k, -1);
+	int numClusters = 0;
+	std::fill(sizes.begin(), sizes.end(), 0);
+	for (int i = 0; i < num; i++) {
+		sizes[assign[i]]++;
+	}
+	for (int c = 0; c < k; c++) {
+		if (sizes[c] > 0) {
+			if (numClusters != c) {
+				memcpy(&centers[numClusters * bytes], &centers[c * bytes], bytes);
+			}
+			remap[c] = numClusters++;
+		}
+	}
+	centers.resize(numClusters * bytes);
+	for (int i = 0; i < num; i++) {
+		assign[i] = remap[assign[i]];
+	}
+
+	return numClusters;
+}
+
+
+//******************************************************************************
+// writeVocabulary
+//******************************************************************************
+static int writeVocabulary(
+	const char *filename,
+	const std::vector<VOCAB_NODE> &nodes,
+	int branching,
+	int depth,
+	int numWords)
+{
+	FILE *fp = fopen(filename, "wb");
+	if (fp == 0) {
+		return -1;
+	}
+
+	VOCAB_HEADER header;
+	memset(&header, 0, sizeof(header));
+	header.magic = VOCAB_MAGIC;
+	header.version = VOCAB_VERSION;
+	header.descBytes = VOCAB_DESC_BYTES;
+	header.branching = branching;
+	header.depth = depth;
+	header.numNodes = (unsigned int)nodes.size();
+	header.numWords = numWords;
+
+	size_t written = fwrite(&header, sizeof(header), 1, fp);
+	written += fwrite(&nodes[0], sizeof(VOCAB_NODE), nodes.size(), fp);
+	fclose(fp);
+
+	return (written == nodes.size() + 1) ? 0 : -1;
+}